@@ -19,15 +19,37 @@
 // please see accompanying README.md for more information
 
 #include "VCFtoSummStats.hpp"
+#include "vcfsummstats.h"
 
 #include <iostream>
 #include <cstdlib>
 #include <fstream>
+#include <sstream>
 #include <unistd.h>
+#include <getopt.h>
 #include <map>
 #include <time.h>
 #include <math.h>
 #include <cstring>
+#include <climits>
+#include <vector>
+#include <algorithm>
+#include <cctype>
+#include <iterator>
+#include <cstdio>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <csignal>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#ifdef HAVE_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+#include <unordered_map>
 using namespace std;
 
 // for boost libraries for decompressing:
@@ -35,6 +57,16 @@ using namespace std;
 #include <boost/iostreams/filter/gzip.hpp>
 #include <boost/iostreams/filter/bzip2.hpp>
 
+// a few hot kernels are compiled for several x86-64 levels, and the loader picks
+// one of them from CPUID at startup (see printCPUpath()); other compilers and
+// platforms get a single version
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 12 && defined(__x86_64__) && defined(__ELF__)
+#define CPU_DISPATCH_CLONES 1
+#define CPU_DISPATCH __attribute__(( target_clones( "arch=x86-64-v4", "arch=x86-64-v3", "arch=x86-64-v2", "default" ) ))
+#else
+#define CPU_DISPATCH
+#endif
+
 
 // global variables
 const int NUM_META_COLS = 9;    // exected number of fields of data prior to samples in VCF
@@ -46,265 +78,613 @@ const int ENTRIES_IN_PL = 3; // number of separate numbers in PL part of format
 const string MISSING_DATA_INDICATOR = "NA";
 bool VERBOSE = false;
 const size_t MAX_BUFFER_SIZE = 512; // length of char arrays used as buffers
+const size_t LINE_READER_BLOCK_SIZE = 4 << 20; // bytes read from the VCF at a time; see readVCFline()
 const char VCF_DELIM = '\t'; // VCF files must be tab delimited
 const double OVERALL_DP_MIN_THRESHOLD_DEFAULT = 2.0;
 double OVERALL_DP_MIN_THRESHOLD;
-size_t MAX_TOKEN_LENGTH = 80;
-
-
+// codes for a decoded diploid GT subfield; the last two are "half calls" like 0/. or ./1
+const char GT_CODE_HOMO_REF = 0, GT_CODE_HET = 1, GT_CODE_HOMO_ALT = 2, GT_CODE_MISSING = 3, GT_CODE_REF_ONLY = 4, GT_CODE_ALT_ONLY = 5;
+const int NUM_GT_CODES = 6;
+const int VALID_ALLELES_BY_GT_CODE[NUM_GT_CODES] = { 2, 2, 2, 0, 1, 1 }; // called alleles per code
+const int ALT_ALLELES_BY_GT_CODE[NUM_GT_CODES] = { 0, 1, 2, 0, 0, 1 };   // alt alleles per code
+const int MEDIAN_NOT_AVAILABLE = INT_MIN; // flag for writing MISSING_DATA_INDICATOR instead of a median
+// genotype cache (see --build-cache and summarizeFromCache()):
+const string GENOTYPE_CACHE_SUFFIX = "_GenotypeCache.bin";
+const char GENOTYPE_CACHE_MAGIC[8] = { 'V', 'S', 'S', 'G', 'T', 'C', '0', '2' };
+const unsigned char CACHE_RECORD_IS_SNP = 1, CACHE_RECORD_HAS_DP = 2, CACHE_RECORD_HAS_GQ = 4;
+const unsigned char CACHE_BYTE_MISSING = 255; // DP and GQ are stored as single bytes, saturating at 254
+bool BUILD_CACHE = false;   // write a genotype cache alongside the normal outputs
+bool IGNORE_CACHE = false;  // parse the VCF even if a valid genotype cache exists
+// compiled --filter expressions; see compileFilterExpression()
+const int FILTER_OP_QUAL = 0, FILTER_OP_FILTER = 1, FILTER_OP_CHROM = 2, FILTER_OP_INFO = 3, FILTER_OP_INFO_FLAG = 4, FILTER_OP_MAF = 5, FILTER_OP_CALLRATE = 6, FILTER_OP_POS = 10;
+const int FILTER_OP_AND = 7, FILTER_OP_OR = 8, FILTER_OP_NOT = 9;
+const int FILTER_CMP_LT = 0, FILTER_CMP_LE = 1, FILTER_CMP_GT = 2, FILTER_CMP_GE = 3, FILTER_CMP_EQ = 4, FILTER_CMP_NE = 5, FILTER_CMP_IN = 6;
+vector< vector<FilterInstruction> > SITE_FILTERS;       // terms that only need the meta columns
+vector< vector<FilterInstruction> > GENOTYPE_FILTERS;   // terms that need decoded genotypes (MAF, CALLRATE)
+// INFO keys to extract; see tokenizeINFO()
+INFOkeyTable INFO_KEYS;
+int INFO_KEY_DP;            // index of DP in INFO_KEYS
+vector<int> INFO_OUTPUT_COLS;   // keys from --info-cols, written as extra output columns
+bool SAMPLE_STATS = false;  // write per-sample QC statistics; see accumulateSampleStats()
+const int SAMPLE_DP_HISTOGRAM_BINS = 256;   // DP values above 254 share the last bin
+// per-population Hardy-Weinberg exact tests (--hwe); see lookUpHWEpvalue()
+bool HWE_TESTS = false;
+const int HWE_TABLE_MAX_SAMPLES = 32;   // p-values for up to this many genotypes are precomputed
+vector<double> HWE_SMALL_TABLE;
+unordered_map<unsigned long long int, double> HWE_PVALUE_MEMO;
+// windowed LD between kept SNPs (--ld-snps, --ld-bp, --ld-bin); 0 means no limit / pairwise output
+int LD_WINDOW_SNPS = 0;
+long int LD_WINDOW_BP = 0;
+long int LD_BIN_WIDTH = 0;
+// site frequency spectra (--sfs); a size for every population, or sizes by population name
+int SFS_SIZE_ALL = 0;
+map<string, int> SFS_SIZES_BY_POP;
+map< pair<int, int>, vector< vector<double> > > SFS_PROJECTION_TABLES; // see getProjectionWeights()
+bool SPLIT_BY_CHROM = false;    // one summary file per CHROM plus an index; see selectChromOutputFile()
+// checkpoints of long runs (--checkpoint, --resume); see writeCheckpoint()
+unsigned long int CHECKPOINT_INTERVAL = 0;  // VCF data lines between checkpoints; 0 = no checkpoints
+bool RESUME = false;
+string COMMAND_LINE;    // the arguments other than --resume, which a resumed run must repeat
+const string CHECKPOINT_SUFFIX = "_checkpoint.txt";
+const string CHECKPOINT_HEADER = "VCFtoSummStats checkpoint 1";
+// tallies of a batch of SNPs at a time, one block of samples at a time (--record-batch); see reduceGenotypeBatch()
+int GENOTYPE_BATCH_RECORDS = 0;     // SNPs per batch; 0 = each SNP is tallied as it is read
+const int GENOTYPE_BATCH_SAMPLE_BLOCK = 4096;
+// the sample columns of each line decoded by several threads (--sample-threads); see decodeSampleChunks()
+int SAMPLE_THREADS = 0;             // threads per line, the calling one included; 0 or 1 = decoded in one piece
+const int SAMPLE_CHUNK_MIN = 4096;  // fewest samples per chunk; fewer samples than two chunks' worth are decoded in one piece
+const int SAMPLE_HISTOGRAM_SIZE = 1024;     // DP and GQ of -1 (no call) up to 1022 go into the chunks' histograms
+// PLINK 1 binary genotypes of the summarized SNPs (--export-plink); see setUpPlinkExport()
+string PLINK_PREFIX;    // empty = no export
+const unsigned char PLINK_BED_MAGIC[3] = { 0x6c, 0x1b, 0x01 };  // SNP-major
+// .bed codes, with ALT as the .bim's first allele: 0 = ALT/ALT, 1 = missing, 2 = het, 3 = REF/REF
+const unsigned char PLINK_CODE_BY_GT_CODE[NUM_GT_CODES] = { 3, 2, 0, 1, 1, 1 };
+// record index of an uncompressed VCF (--build-index, --index-interval); see buildRecordIndex()
+bool BUILD_INDEX = false;
+unsigned long int RECORD_INDEX_INTERVAL = 65536;    // data lines between index entries
+const string RECORD_INDEX_SUFFIX = "_RecordIndex.tsv";
+const string RECORD_INDEX_HEADER = "VCFtoSummStats record index 1";
+const size_t RECORD_INDEX_PEEK = 1024;  // bytes read at an indexed line for its CHROM and POS
+// asynchronous reading of the VCF (--read-ahead, --read-throttle); see ReadAheadState
+int READ_AHEAD_DEPTH = 0;       // reads kept in flight; 0 = the VCF is read through an ifstream
+const int READ_AHEAD_MAX_DEPTH = 256;
+const size_t READ_AHEAD_BUFFER_SIZE = 1 << 20;
+const int READ_AHEAD_FREE = 0, READ_AHEAD_IN_FLIGHT = 1, READ_AHEAD_READY = 2;
+long int READ_THROTTLE_MS = 0;  // test mode: no read finishes sooner than this after it starts
+// per-genotype masks (--min-gt-dp, --max-gt-dp, --min-gt-gq): a call whose DP or GQ
+// is outside them counts as missing; see decodeSampleColumns()
+int MIN_GT_DP = 0, MAX_GT_DP = INT_MAX, MIN_GT_GQ = 0;
+// --preview: a few lines from places spread over the whole VCF; see previewVCF()
+int PREVIEW_POINTS = 0;     // places to summarize lines at; 0 = summarize every line
+const int PREVIEW_LINES_PER_POINT = 100;
+const size_t PREVIEW_BLOCK_SIZE = 1 << 16;  // bytes read at a time at each place
+// .bcf input; see readBCFheader() and readBCFrecord()
+const char BCF_MAGIC[5] = { 'B', 'C', 'F', 2, 2 };
+const int BCF_TYPE_INT8 = 1, BCF_TYPE_INT16 = 2, BCF_TYPE_INT32 = 3, BCF_TYPE_FLOAT = 5, BCF_TYPE_CHAR = 7;
+const int BCF_TYPE_SIZES[8] = { 0, 1, 2, 4, 0, 4, 0, 1 };  // bytes per value; 0 = not a valid type
+const int32_t BCF_INT_MISSING = INT32_MIN, BCF_INT_VECTOR_END = INT32_MIN + 1;    // as returned by getBCFint()
+const uint32_t BCF_FLOAT_MISSING = 0x7F800001, BCF_FLOAT_VECTOR_END = 0x7F800002;
+// several VCFs in one run (-V more than once, or --vcf-list); see summarizeVCFfiles()
+vector<string> VCF_FILE_NAMES;  // in input order; empty for a single VCF
+int NUM_JOBS = 0;               // VCFs summarized at once; 0 = one per CPU
+vector<string> FIRST_VCF_SAMPLE_IDS;    // every VCF must have these sample columns; see checkSampleColumns()
+string WORKER_OUTPUT_BASE;      // a worker's part files are named after this instead of its VCF
+// library use (see vss_summarize()); the command-line program keeps these defaults
+vss_snp_callback SNP_SUMMARY_CALLBACK = NULL;   // gets every summarized SNP; see reportSNPsummary()
+void *SNP_SUMMARY_USER_DATA = NULL;
+bool WRITE_SUMMARY_FILES = true;
+// resident server (--serve); see serveRequests()
+string SERVE_SOCKET;                // Unix domain socket to listen on; empty = an ordinary run
+unsigned long long SERVE_MEMORY_BUDGET = 1024ULL << 20;    // bytes of genotype caches kept in memory (--serve-memory, in MB)
+int SERVE_REPLY_FD = -1;            // the connection, in the process answering a request; -1 otherwise
+const char *SERVE_CACHE_DATA = NULL;    // the genotype cache of the request's VCF, if the server holds it
+size_t SERVE_CACHE_LENGTH = 0;
+
+
+#ifndef VSS_LIBRARY
 int main(int argc, char *argv[])
 {
-    // for filtering_streambuf:
-    using namespace boost::iostreams;
-
-    clock_t startTime = clock();  // for tracking performance
+    // the library build ('make lib') leaves main() out; see vss_summarize()
+    return summarizeVCF( argc, argv );
+}
+#endif
 
-    // variables for command line arguments:
-    int numSamples, numPopulations, numFields, numFormats, firstDataLineNumber = -1;
-    int maxSubfieldsInFormat = MAX_SUBFIELDS_IN_FORMAT_DEFAULT;
-    unsigned long int VCFfileLineCount = 0;
-	bool popFileHeader;
-    char formatDelim = FORMAT_DELIM_DEFAULT;
-    string vcfName, popFileName;
-    // data file streams:
-    ifstream PopulationFile;    // population and sample designations
-    ofstream outputFile;
-    filtering_streambuf<input> myVCFin;     // filter for VCF for dealing with compression
-    ifstream vcfUnfiltered; // needed to read in unfiltered
 
-#ifdef DEBUG
-    string progname = argv[0];
-    cout << "\n\t" << progname << " is running!\n\n";
+// --------------------- function definitions --------------------------- //
+// --------------------- in alphabetical order -------------------------- //
+void abortRun( int status )
+{
+    // ends the run early, usually after an error: the command-line program exits with
+    // status, and in the library the run unwinds to vss_summarize(), which returns status
+#ifdef VSS_LIBRARY
+    throw status;
+#else
+    exit( status );
 #endif
+}
 
-    // create cross referencing for population membership by sample:
-    map<string, int> mapOfPopulations;      // key = population ID, value = integer population index
-
-	// parse command line options and open file streams for reading:
-    parseCommandLineInput(argc, argv, PopulationFile, popFileHeader, numSamples, numPopulations, numFields, numFormats, formatDelim, maxSubfieldsInFormat, vcfName, popFileName, mapOfPopulations );
 
-    createVCFfilter( myVCFin, vcfName, vcfUnfiltered );    // create filter
-    istream VCFfile( &myVCFin );            // create stream from filter
-    if ( !VCFfile.good() ) {
-        cerr << "\nError!  istream VCFfile is not good!\n";
+void accumulateSampleStats( SampleStats& stats, char* genotypeCodes, int* DPvalues, int* GQvalues, bool lookForDP, bool lookForGQ )
+{
+    // adds one kept site to the per-sample totals; DPvalues and GQvalues must
+    // still be in sample order (i.e., not yet sorted for the medians)
+    int numSamples = stats.numSamples, value;
+    char code;
+    stats.numSites++;
+    for ( int i = 0; i < numSamples; i++ ) {
+        code = genotypeCodes[i];
+        stats.calledCount[i] += ( VALID_ALLELES_BY_GT_CODE[ static_cast<int>(code) ] == 2 );
+        stats.missingCount[i] += ( code == GT_CODE_MISSING );
+        stats.hetCount[i] += ( code == GT_CODE_HET );
     }
-
-    // create cross referencing for population membership by sample:
-    //map<string, int> mapOfPopulations;      // key = population ID, value = integer population index
-    map<string, int> mapOfSamples;          // key = sample ID, value = integer representing population index
-    int numSamplesPerPopulation[numPopulations];    // for later frequency calculations
-    //makePopulationMap( mapOfPopulations, numPopulations, popFileName );
-    assignPopIndexToSamples( mapOfPopulations, mapOfSamples, PopulationFile, numSamplesPerPopulation, numPopulations, numSamples  );
-
-    // assign each sample column in the VCF to a population:
-    int *populationReference;
-    populationReference = new int[numSamples];
-    bool success = assignSamplesToPopulations(VCFfile, numSamples, numFields, mapOfSamples, populationReference, VCFfileLineCount, firstDataLineNumber);
-
-#ifdef DEBUG
-    if ( success ) {
-        cout << "\nassignSamplesToPopulations() exited cleanly\n\n";
+    if ( lookForDP ) {
+        for ( int i = 0; i < numSamples; i++ ) {
+            value = DPvalues[i];
+            if ( value >= 0 ) {
+                stats.DPcount[i]++;
+                stats.DPsum[i] += value;
+                stats.DPhistogram[ i * SAMPLE_DP_HISTOGRAM_BINS + ( value < SAMPLE_DP_HISTOGRAM_BINS ? value : SAMPLE_DP_HISTOGRAM_BINS - 1 ) ]++;
+            }
+        }
     }
-    cout << "VCFfileLineCount after assignSamplesToPopulations() is: \t" << VCFfileLineCount << endl;
-#endif
-
-    // if all has gone well to this point, the output file can be constructed:
-    setUpOutputFile( outputFile, vcfName, numPopulations, mapOfPopulations );
-
-    // after that function call, the  VCFfile stream has pointed
-    // to the first entry of the first line of data
-
-    // go through data and calculate allele frequencies:
-    parseActualData( VCFfile, numFormats, formatDelim, maxSubfieldsInFormat, VCFfileLineCount, outputFile, numSamples, numPopulations, populationReference, vcfName );
+    if ( lookForGQ ) {
+        for ( int i = 0; i < numSamples; i++ ) {
+            if ( GQvalues[i] >= 0 ) {
+                stats.GQcount[i]++;
+                stats.GQsum[i] += GQvalues[i];
+            }
+        }
+    }
+}
 
-	// cleanup: close files:
-	PopulationFile.close();
-    outputFile.close();
-	// free memory:
-	//delete mySamples;
 
+CPU_DISPATCH void accumulateSFS( PopulationDesignation& designation, int altAlleleCounts[], int validSampleCounts[] )
+{
+    // adds one site to the 1D and joint spectra of a population designation.  A
+    // population with n called alleles, k of them ALT, is projected down to its SFS
+    // size m by spreading the site over 0..m ALT alleles with hypergeometric weights;
+    // sites with fewer than m called alleles are left out of that population's spectra
+    int numPopulations = designation.numPopulations;
+    const double *weights[numPopulations];
+    for ( int pop = 0; pop < numPopulations; pop++ ) {
+        int m = designation.SFSsizes[pop];
+        weights[pop] = NULL;
+        if ( !m || validSampleCounts[pop] < m )
+            continue;
+        weights[pop] = getProjectionWeights( validSampleCounts[pop], m, altAlleleCounts[pop] );
+        vector<double>& spectrum = designation.SFS1D[pop];
+        for ( int j = 0; j <= m; j++ )
+            spectrum[j] += weights[pop][j];
+        designation.SFS1Dsites[pop]++;
+    }
+    for ( size_t i = 0; i < designation.SFSpairs.size(); i++ ) {
+        int pop1 = designation.SFSpairs[i].first, pop2 = designation.SFSpairs[i].second;
+        if ( weights[pop1] == NULL || weights[pop2] == NULL )
+            continue;
+        int columns = designation.SFSsizes[pop2] + 1;
+        double *spectrum = &designation.SFS2D[i][0];
+        for ( int j1 = 0; j1 <= designation.SFSsizes[pop1]; j1++ ) {
+            double w1 = weights[pop1][j1];
+            if ( w1 == 0.0 )
+                continue;
+            for ( int j2 = 0; j2 < columns; j2++ )
+                spectrum[ j1 * columns + j2 ] += w1 * weights[pop2][j2];
+        }
+        designation.SFS2Dsites[i]++;
+    }
+}
 
-#ifdef DEBUG
-		cout << "\nI ran!!\n\n";
-#endif
-    clock_t endTime = clock();
-    int minutes;
-	double seconds;
-    convertTimeInterval( (endTime - startTime), minutes, seconds);
-    cout << "\nIt took " << minutes << "min., " << seconds << "sec."  << " to run.\n";
 
-    return 0;
+int addINFOkey( string key )
+{
+    // returns the index of key in INFO_KEYS, adding it if needed; all keys must
+    // be added before buildINFOkeyTable() is called
+    for ( size_t i = 0; i < INFO_KEYS.keys.size(); i++ ) {
+        if ( INFO_KEYS.keys[i] == key )
+            return static_cast<int>( i );
+    }
+    INFO_KEYS.keys.push_back( key );
+    return static_cast<int>( INFO_KEYS.keys.size() ) - 1;
 }
 
 
-// --------------------- function definitions --------------------------- //
-// --------------------- in alphabetical order -------------------------- //
-void assignPopIndexToSamples( map<string, int>& mapOfPopulations, map<string, int>& mapOfSamples, ifstream& PopulationFile, int numSamplesPerPopulation[], int numPopulations, int numSamples )
+void addToGenotypeBatch( GenotypeBatch& batch, unsigned long int VCFfileLineCount, char* CHROM, char* POS, char* ID, char* REF, char* ALT, char* QUAL, int medianDP, int medianGQ, PopulationDesignation* designations, int numDesignations )
 {
-    string sampleID, popMembership;
-    int popIndex, count = 0;
-    for ( int i = 0; i < numPopulations; i++ )
-        numSamplesPerPopulation[i] = 0; // initialize to make sure it starts at zero
-    while ( PopulationFile >> sampleID >> popMembership ) {
-        // get index from population map key-value pair:
-        popIndex = mapOfPopulations[ popMembership ];
-        // insert index assign that index to the sampleID in the map of samples
-        mapOfSamples[ sampleID ] = popIndex;
-        numSamplesPerPopulation[ popIndex ]++;
+    // keeps what the summary rows of a kept SNP need besides its genotypes, which
+    // were decoded straight into the batch's next row, and writes the batch when full
+    int r = batch.numRecords;
+    batch.lineNumbers[r] = VCFfileLineCount;
+    batch.medianDPs[r] = medianDP;
+    batch.medianGQs[r] = medianGQ;
+    batch.metaFields[r * 6].assign( CHROM );
+    batch.metaFields[r * 6 + 1].assign( POS );
+    batch.metaFields[r * 6 + 2].assign( ID );
+    batch.metaFields[r * 6 + 3].assign( REF );
+    batch.metaFields[r * 6 + 4].assign( ALT );
+    batch.metaFields[r * 6 + 5].assign( QUAL );
+    if ( !INFO_OUTPUT_COLS.empty() ) {
+        // the INFO values point into the current line, which won't be there at the flush:
+        ostringstream INFOcolumns;
+        writeINFOcolumns( INFOcolumns );
+        batch.INFOcolumns[r] = INFOcolumns.str();
     }
+    batch.numRecords++;
+    if ( batch.numRecords == batch.capacity )
+        flushGenotypeBatch( batch, designations, numDesignations );
+}
 
-#ifdef DEBUG
-    // view number of samples per population:
-    cout << "\nNumber of samples per population:\n";
-    for ( int i = 0; i < numPopulations; i++ ) {
-        cout << "\t" << i << ":\t" << numSamplesPerPopulation[i] << endl;
-    }
 
-    // view maps created by last two function calls:
-    string dum;
-    int counter = 0;
-    cout << "\nmapOfPopulations:\n";
-    for( map<string, int>::const_iterator it = mapOfPopulations.begin();
-        counter < numPopulations;
-        counter++ ) {
-        dum = it->first;
-        if ( dum.length() == 1 ) {
-            dum = dum + "\t\t";
-        } else if ( dum.length() < 9 ) {
-            dum = dum + "\t";
-        }
-        cout << "\t" << (counter + 1) << "\tKey:  " << dum << "\tValue:  " << it->second << endl;
-        it++;
+void appendBCFvalues( string& text, const unsigned char*& cursor, const unsigned char* end, int type, int count )
+{
+    // writes count typed values of a BCF INFO field to text as they would be in
+    // a VCF, and moves cursor past them
+    if ( static_cast<size_t>( end - cursor ) < static_cast<size_t>( count ) * BCF_TYPE_SIZES[type] ) {
+        cout << "\nError in appendBCFvalues():\n\ta record of the BCF file is truncated or malformed.\n\tAborting ... \n\n";
+        abortRun(-5);
     }
-    cout << "\nmapOfSamples (subset):\n";
-    counter = 0;
-    for( map<string, int>::const_iterator it = mapOfSamples.begin();
-        counter < numSamples;
-        counter++ ) {
-        if ( counter % 100 == 0 || counter == (numSamples - 1) )
-            cout << "\t" << (counter + 1) << "\tKey:  " << it->first << "\t\tValue:  " << it->second << endl;
-        it++;
+    if ( type == BCF_TYPE_CHAR ) {
+        // strings are padded with '\0':
+        int length = 0;
+        while ( length < count && cursor[length] != '\0' )
+            length++;
+        text.append( reinterpret_cast<const char*>( cursor ), length );
+    } else {
+        char number[32];
+        for ( int i = 0; i < count; i++ ) {
+            const unsigned char *value = cursor + i * BCF_TYPE_SIZES[type];
+            if ( type == BCF_TYPE_FLOAT ) {
+                uint32_t bits;
+                float floatValue;
+                memcpy( &bits, value, sizeof( bits ) );
+                memcpy( &floatValue, value, sizeof( floatValue ) );
+                if ( bits == BCF_FLOAT_VECTOR_END )
+                    break;
+                if ( i > 0 )
+                    text += ',';
+                if ( bits == BCF_FLOAT_MISSING ) {
+                    text += '.';
+                } else {
+                    snprintf( number, sizeof( number ), "%g", floatValue );
+                    text += number;
+                }
+            } else {
+                int32_t intValue = getBCFint( value, type );
+                if ( intValue == BCF_INT_VECTOR_END )
+                    break;
+                if ( i > 0 )
+                    text += ',';
+                if ( intValue == BCF_INT_MISSING ) {
+                    text += '.';
+                } else {
+                    snprintf( number, sizeof( number ), "%d", intValue );
+                    text += number;
+                }
+            }
+        }
     }
-#endif
+    cursor += static_cast<size_t>( count ) * BCF_TYPE_SIZES[type];
+}
 
 
+void appendPartFile( ofstream& mergedFile, string partFileName, string sourceFile, bool withHeader )
+{
+    // adds the lines of a worker's part file to a merged output, each one after the
+    // name of the VCF it came from, and deletes the part file; the header line only
+    // goes into the merged output for the first part
+    ifstream partFile( partFileName );
+    string line;
+    bool isHeader = true;
+    if ( !partFile.is_open() ) {
+        cout << "\nError in appendPartFile():\n\tcould not read " << partFileName << "\n\tAborting ... \n\n";
+        abortRun(-4);
+    }
+    while ( getline( partFile, line ) ) {
+        if ( isHeader ) {
+            if ( withHeader )
+                mergedFile << "sourceFile\t" << line << '\n';
+            isHeader = false;
+        } else {
+            mergedFile << sourceFile << '\t' << line << '\n';
+        }
+    }
+    partFile.close();
+    remove( partFileName.c_str() );
 }
 
 
-bool assignSamplesToPopulations(istream& VCFfile, int numSamples, int numFields, map<string, int> mapOfSamples, int *populationReference, unsigned long int& VCFfileLineCount, int& firstDataLineNumber )
+bool assignSamplesToPopulations(istream& VCFfile, int numSamples, PopulationDesignation* designations, int numDesignations, string* sampleIDs, unsigned long int& VCFfileLineCount, int& firstDataLineNumber )
 {
-    int count = 0, firstSampleCol = (numFields - numSamples + 1);
-    int popIndex;
-    string x;
+    // reads the meta rows and the #CHROM header row a line at a time; the header row
+    // is split on tabs in the line buffer, since with a million samples it is the
+    // longest line of the file
+    string line;
 
-#ifdef DEBUG
-        if ( firstSampleCol != 10 ) { // expectation based upon VCF format standards
-            cout << "\nError!  First sample column was NOT estimated to be 10th field!\n";
-            cout << "\t Aborting ...\n\n";
-            exit(-2);
-        }
-#endif
     // First: get to header row (past meta-rows) in VCF file:
-    while ( VCFfile >> x ) {
-        VCFfileLineCount++; // incremement line counter; though the while loop goes one "word"
-                            // at a time, the clauses below move through lines;
-        if ( x.substr(0,2) == "##" ) {
-            VCFfile.ignore(unsigned(-1), '\n'); // move to next line
-        } else if ( x == "#CHROM" ) {
-            firstDataLineNumber = VCFfileLineCount + 1;
-            // this is the header row after the meta-data header lines
-            for ( int i = 0; i < NUM_META_COLS ; i++ ) {
-                // advance to first sample header:
+    while ( getline( VCFfile, line ) ) {
+        if ( line.empty() )
+            continue;
+        VCFfileLineCount++;
+        if ( line.compare( 0, 2, "##" ) == 0 )
+            continue;
+        if ( line.compare( 0, 7, "#CHROM\t" ) != 0 ) {
+            cout << "\nError!  VCF file not structured as expected!\n";
+            cout << "I did NOT find a header row starting with #CHROM\n\t Aborting ...\n\n";
+            abortRun(-2);
+        }
+        // this is the header row after the meta-data header lines
+        firstDataLineNumber = VCFfileLineCount + 1;
+        if ( !line.empty() && line[ line.length() - 1 ] == '\r' )
+            line.resize( line.length() - 1 );
+        const char *cursor = line.data(), *end = cursor + line.length();
+        for ( int i = 0; i < NUM_META_COLS && cursor; i++ ) {
+            // advance to first sample header:
+            cursor = static_cast<const char*>( memchr( cursor, '\t', end - cursor ) );
+            if ( cursor )
+                cursor++;
+        }
+        int count = 0;
+        for ( ; count < numSamples && cursor; count++ ) {
+            const char *tab = static_cast<const char*>( memchr( cursor, '\t', end - cursor ) );
+            sampleIDs[ count ].assign( cursor, ( tab ? tab : end ) - cursor );
+            cursor = tab ? tab + 1 : NULL;
+        }
+        if ( count < numSamples ) {
+            cout << "\nError in assignSamplesToPopulations():\n\tthe #CHROM header row has " << count << " sample columns, but the population file has ";
+            cout << numSamples << " samples.\n--> Please check that your population file designates\nsamples EXACTLY as they appear in the VCF.\n\tAborting ... \n\n";
+            abortRun(-2);
+        }
 #ifdef DEBUG
-                    if ( i == (NUM_META_COLS - 1) )
-                        cout << "\nYour VCF's last meta-field and some of the sample fields:\n" << x;
+        cout << "\nYour VCF's first and last sample fields:\n" << sampleIDs[0] << " ... " << sampleIDs[ numSamples - 1 ] << endl;
 #endif
-                VCFfile >> x;
 
-            }
+        // map sample columns to populations, once per population designation:
+        for ( int d = 0; d < numDesignations; d++ )
+            mapSamplesToPopulations( sampleIDs, numSamples, designations[d], "VCF file" );
 
-            string sampleID = x;
-            map<string, int>::iterator iter; // for checking existence in map
-            for ( count = 0; count < numSamples; count ++ ) {
-                // map sample column to population
-                iter = mapOfSamples.find( sampleID );
-                // check to make sure sampleID is in the map:
-                if ( iter == mapOfSamples.end() ) {
-                    cout << "\nError!  Sample header '" << sampleID << "' from VCF file not found in mapOfSamples!" << endl;
-                    cout << "--> Please check that your population file designates\nsamples EXACTLY as they appear in the VCF." << endl;
-                    cout << "\tAborting ... " << endl;
-                    exit(-2);
-                }
-                // get popIndex from map:
-                popIndex = mapOfSamples[ sampleID ];
-                // store popIndex in array that maps each column to a population:
-                populationReference[ count ] = popIndex;
+        return true;
+    }
 
-#ifdef DEBUG
-                    if ( popIndex != iter->second ) {
-                        cout << "\nError!  maps aren't working like you think!\n";
-                        exit(-3);
+    // execution should never reach here unless VCF file has ONLY ## rows
+    cout << "\nError!  assignSamplesToPopulations() exited with status 'false'.\n\t";
+    cout << "--> Please check that VCF has ## meta rows followed by one\n\t";
+    cout << "header row starting with #CHROM, followed by SNP datal rows.\n\tAborting ...\n\n";
+    abortRun(-2);
+
+    return false;
+}
+
+
+void buildRecordIndex( string vcfName )
+{
+    // --build-index: one pass over an uncompressed VCF, finding line ends with memchr(),
+    // that writes the byte offset, line number, CHROM and POS of every
+    // RECORD_INDEX_INTERVAL-th data line, starting with the first one.  The index
+    // holds the VCF's size and modification time, and readRecordIndex() ignores it
+    // once they change.  It is written under a temporary name and renamed when complete
+    string indexName = vcfName + RECORD_INDEX_SUFFIX;
+    unsigned long long fileSize, blockOffset = 0;
+    long long fileModTime;
+    unsigned long int lineNumber = 0, dataLines = 0, numEntries = 0;
+    bool atLineStart = true;
+    ssize_t bytesRead;
+    vector<char> blockBuffer( LINE_READER_BLOCK_SIZE );
+    char *block = blockBuffer.data();
+    char peek[RECORD_INDEX_PEEK];
+
+    int fd = open( vcfName.c_str(), O_RDONLY );
+    if ( fd < 0 || !getSourceFileStats( vcfName, fileSize, fileModTime ) ) {
+        cout << "\nError in buildRecordIndex():\n\tVCF file name '" << vcfName << "' not found!\n\t--> Check spelling and path.\n\tExiting ... \n\n";
+        abortRun( -1 );
+    }
+    ofstream indexFile( indexName + ".partial", ofstream::out | ofstream::trunc );
+    if ( indexFile.fail() ) {
+        cout << "\nError in buildRecordIndex():\n\tcould not open " << indexName << ".partial\n\t--> Please make sure you have write access to the data file directory.\n\tAborting ... \n\n";
+        abortRun(-4);
+    }
+    indexFile << RECORD_INDEX_HEADER << "\n";
+    indexFile << "VCF\t" << fileSize << "\t" << fileModTime << "\n";
+    indexFile << "interval\t" << RECORD_INDEX_INTERVAL << "\n";
+    indexFile << "byteOffset\tVCFlineNum\tCHROM\tPOS\n";
+
+    while ( ( bytesRead = read( fd, block, LINE_READER_BLOCK_SIZE ) ) > 0 ) {
+        char *cursor = block, *end = block + bytesRead;
+        while ( cursor < end ) {
+            if ( atLineStart ) {
+                lineNumber++;
+                if ( *cursor != '#' && dataLines++ % RECORD_INDEX_INTERVAL == 0 ) {
+                    // the line may run past this block, so CHROM and POS are read separately:
+                    unsigned long long offset = blockOffset + ( cursor - block );
+                    ssize_t peeked = pread( fd, peek, RECORD_INDEX_PEEK - 1, static_cast<off_t>( offset ) );
+                    peek[ peeked > 0 ? peeked : 0 ] = '\0';
+                    char *CHROMend = strchr( peek, VCF_DELIM );
+                    char *POSend = CHROMend ? strpbrk( CHROMend + 1, "\t\n" ) : NULL;
+                    if ( !POSend ) {
+                        cout << "\nError in buildRecordIndex():\n\tline " << lineNumber << " of " << vcfName << " does not start with CHROM and POS.\n\tAborting ... \n\n";
+                        abortRun(-5);
                     }
-                    if ( count % 100 == 0 || count == (numSamples - 1))
-                        cout << " ... " << sampleID << ", popIndex=" << populationReference[count];
-#endif
+                    indexFile << offset << "\t" << lineNumber << "\t" << string( peek, CHROMend ) << "\t" << string( CHROMend + 1, POSend ) << "\n";
+                    numEntries++;
+                }
+            }
+            char *newline = static_cast<char*>( memchr( cursor, '\n', end - cursor ) );
+            atLineStart = ( newline != NULL );
+            cursor = newline ? newline + 1 : end;
+        }
+        blockOffset += bytesRead;
+    }
+    close( fd );
+    indexFile << "dataLines\t" << dataLines << "\n";
+    indexFile.close();
+    if ( bytesRead < 0 || indexFile.fail() || rename( ( indexName + ".partial" ).c_str(), indexName.c_str() ) != 0 ) {
+        cout << "\nError in buildRecordIndex():\n\tcould not write " << indexName << "\n\tAborting ... \n\n";
+        abortRun(-4);
+    }
+    cout << "\nIndexed " << dataLines << " data lines of " << vcfName << " at " << numEntries << " places, in " << indexName << endl;
+}
+
 
-                // advance the VCF stream pointer to the next string
-                if ( count < (numSamples - 1) )
-                    VCFfile >> sampleID;
+void buildINFOkeyTable( INFOkeyTable& table )
+{
+    // finds a seed for which every key lands in its own slot, so that tokenizeINFO()
+    // needs one hash and at most one string comparison per INFO entry
+    size_t numKeys = table.keys.size();
+    size_t tableSize = 4;
+    while ( tableSize < 2 * numKeys )
+        tableSize <<= 1;
+    bool collision = true;
+    while ( collision ) {
+        table.mask = static_cast<unsigned int>( tableSize - 1 );
+        for ( table.seed = 1; table.seed <= 1000; table.seed++ ) {
+            table.slots.assign( tableSize, -1 );
+            collision = false;
+            for ( size_t i = 0; i < numKeys && !collision; i++ ) {
+                unsigned int slot = hashINFOkey( table.keys[i].c_str(), table.keys[i].length(), table.seed ) & table.mask;
+                if ( table.slots[slot] >= 0 )
+                    collision = true;
                 else
-                    VCFfile.ignore(unsigned(-1), '\n'); // don't yet read in first entry of next line, but set the stage to
+                    table.slots[slot] = static_cast<int>( i );
             }
+            if ( !collision )
+                break;
+        }
+        tableSize <<= 1;
+    }
+    table.values.assign( numKeys, static_cast<const char*>( NULL ) );
+    table.valueLengths.assign( numKeys, 0 );
+}
 
-#ifdef DEBUG
-                cout << "\n\nMost recently obtained string from VCFfile stream: " << sampleID << "\n\n";
-                if ( mapOfSamples.find("foobar") == mapOfSamples.end() )
-                    cout << "\nBogus call to mapOfSamples returned mapOfSamples.end()" << endl;
-#endif
-            if ( (VCFfileLineCount + 1) != firstDataLineNumber ) {
-                cout << "\nError in assignSamplesToPopulations():\n\t";
-                cout << "VCFfileLineCount + 1 (" << (VCFfileLineCount + 1) << ") != firstDataLineNumber (" << firstDataLineNumber << ")\n\t";
-                cout << "Aborting ... \n";
-                exit(-2);
-            }
 
-            return true;
-        } else {
-            cout << "\nError!  VCF file not structured as expected!\n";
-            cout << "I did NOT find a header row starting with #CHROM\n\t Aborting ...\n\n";
-            exit(-2);
-        }
+double calculateHWEpvalue( int homoRefCount, int hetCount, int homoAltCount )
+{
+    // exact test of Hardy-Weinberg equilibrium for one biallelic site, after
+    // Wigginton, Cutler & Abecasis 2005 (Am J Hum Genet 76:887-893).  The
+    // probabilities of every possible het count, given the number of genotypes and
+    // of rare alleles, are built outward from the most likely one; the p-value
+    // sums all those no more likely than the observed count
+    int genotypes = homoRefCount + hetCount + homoAltCount;
+    if ( genotypes == 0 )
+        return std::numeric_limits<double>::quiet_NaN();
+    int rareHoms = ( homoRefCount < homoAltCount ) ? homoRefCount : homoAltCount;
+    int rareCopies = 2 * rareHoms + hetCount;
+    vector<double> hetProbs( rareCopies + 1, 0.0 );
+
+    // start at the het count that is most likely under equilibrium (same parity as rareCopies):
+    int mid = static_cast<int>( ( static_cast<long long int>( rareCopies ) * ( 2 * genotypes - rareCopies ) ) / ( 2 * genotypes ) );
+    if ( ( rareCopies & 1 ) != ( mid & 1 ) )
+        mid++;
+    hetProbs[mid] = 1.0;
+    double sum = 1.0;
+    double currRareHoms = ( rareCopies - mid ) / 2, currCommonHoms = genotypes - mid - currRareHoms;
+    for ( int hets = mid; hets > 1; hets -= 2 ) {
+        hetProbs[hets - 2] = hetProbs[hets] * hets * ( hets - 1.0 ) / ( 4.0 * ( currRareHoms + 1.0 ) * ( currCommonHoms + 1.0 ) );
+        sum += hetProbs[hets - 2];
+        currRareHoms++;
+        currCommonHoms++;
+    }
+    currRareHoms = ( rareCopies - mid ) / 2;
+    currCommonHoms = genotypes - mid - currRareHoms;
+    for ( int hets = mid; hets <= rareCopies - 2; hets += 2 ) {
+        hetProbs[hets + 2] = hetProbs[hets] * 4.0 * currRareHoms * currCommonHoms / ( ( hets + 2.0 ) * ( hets + 1.0 ) );
+        sum += hetProbs[hets + 2];
+        currRareHoms--;
+        currCommonHoms--;
+    }
 
+    double pValue = 0.0, observed = hetProbs[hetCount];
+    for ( int hets = rareCopies & 1; hets <= rareCopies; hets += 2 ) {
+        if ( hetProbs[hets] <= observed * ( 1.0 + 1e-12 ) )
+            pValue += hetProbs[hets];
     }
+    pValue /= sum;
+    return ( pValue > 1.0 ) ? 1.0 : pValue;
+}
 
-    // execution should never reach here unless VCF file has ONLY ## rows
-    cout << "\nError!  assignSamplesToPopulations() exited with status 'false'.\n\t";
-    cout << "--> Please check that VCF has ## meta rows followed by one\n\t";
-    cout << "header row starting with #CHROM, followed by SNP datal rows.\n\tAborting ...\n\n";
-    exit(-2);
 
-    return false;
+void calculateFilterGenotypeStats( char* genotypeCodes, int numSamples, double& MAF, double& callRate )
+{
+    // MAF and CALLRATE as used by --filter: the minor allele frequency over all
+    // called alleles, and the fraction of samples with both alleles called
+    int codeCounts[NUM_GT_CODES] = { 0 };
+    int validAlleles = 0, altAlleles = 0;
+    for ( int i = 0; i < numSamples; i++ )
+        codeCounts[ static_cast<int>( genotypeCodes[i] ) ]++;
+    for ( int code = 0; code < NUM_GT_CODES; code++ ) {
+        validAlleles += codeCounts[code] * VALID_ALLELES_BY_GT_CODE[code];
+        altAlleles += codeCounts[code] * ALT_ALLELES_BY_GT_CODE[code];
+    }
+    if ( validAlleles ) {
+        MAF = static_cast<double>( altAlleles ) / static_cast<double>( validAlleles );
+        if ( MAF > 0.5 )
+            MAF = 1.0 - MAF;
+    } else {
+        MAF = std::numeric_limits<double>::quiet_NaN();
+    }
+    callRate = static_cast<double>( codeCounts[ static_cast<int>( GT_CODE_HOMO_REF ) ] + codeCounts[ static_cast<int>( GT_CODE_HET ) ] + codeCounts[ static_cast<int>( GT_CODE_HOMO_ALT ) ] ) / static_cast<double>( numSamples );
 }
 
 
 inline int calculateMedian( int values[], int n, int ignoreFirst )
 {
+	// values is reordered; only the element at medianSpot needs to be in its sorted place
 	int medianSpot = ignoreFirst + ((n - ignoreFirst)/2);
-	sort( values, values + n );
+	nth_element( values, values + medianSpot, values + n );
 	return( values[ medianSpot ] );
 }
 
 
-void calculateSummaryStats( istream& VCFfile, ofstream& outputFile, int numTokensInFormat, int GTtoken, int DPtoken, int GQtoken, int PLtoken, bool lookForDP, bool lookForGQ, bool lookForPL, char formatDelim, int formatOpsOrder[], int numSamples, int numPopulations, unsigned long int VCFfileLineCount, int* populationReference )
+CPU_DISPATCH bool calculateLD( uint64_t* snp1, uint64_t* snp2, uint64_t* populationMask, int numWords, double& r2, double& Dprime )
 {
-    int homoRefCount = 0, homoAltCount = 0, hetCount = 0, altAlleleCounts[numPopulations];
-    int validSampleCounts[numPopulations], DPvalues[numSamples], GQvalues[numSamples];
-    int PLvalues[ (numSamples * ENTRIES_IN_PL) ];
-    // initialize all array values to zero:
-    for ( int i = 0; i < numPopulations; i++ ) {
-        altAlleleCounts[i] = 0;
-        validSampleCounts[i] = 0;
+    // r^2 and |D'| between two SNPs over the samples in populationMask that are
+    // called at both.  The genotypes are unphased, so r^2 is the squared correlation
+    // of ALT dosages, and D is the composite genotype-based estimate, half their
+    // covariance (Weir 1979).  Returns false if either SNP doesn't vary
+    uint64_t *called1 = snp1, *alt1 = snp1 + numWords, *homoAlt1 = snp1 + 2 * numWords;
+    uint64_t *called2 = snp2, *alt2 = snp2 + numWords, *homoAlt2 = snp2 + 2 * numWords;
+    long int n = 0, a1 = 0, b1 = 0, a2 = 0, b2 = 0, a1a2 = 0, a1b2 = 0, b1a2 = 0, b1b2 = 0;
+    uint64_t mask;
+    for ( int w = 0; w < numWords; w++ ) {
+        mask = called1[w] & called2[w] & populationMask[w];
+        n += __builtin_popcountll( mask );
+        a1 += __builtin_popcountll( alt1[w] & mask );
+        b1 += __builtin_popcountll( homoAlt1[w] & mask );
+        a2 += __builtin_popcountll( alt2[w] & mask );
+        b2 += __builtin_popcountll( homoAlt2[w] & mask );
+        a1a2 += __builtin_popcountll( alt1[w] & alt2[w] & mask );
+        a1b2 += __builtin_popcountll( alt1[w] & homoAlt2[w] & mask );
+        b1a2 += __builtin_popcountll( homoAlt1[w] & alt2[w] & mask );
+        b1b2 += __builtin_popcountll( homoAlt1[w] & homoAlt2[w] & mask );
     }
+    if ( n < 2 )
+        return false;
+    // dosage x = a + b, and x^2 = a + 3b because b implies a:
+    double sumX = a1 + b1, sumXX = a1 + 3.0 * b1, sumY = a2 + b2, sumYY = a2 + 3.0 * b2;
+    double sumXY = a1a2 + a1b2 + b1a2 + b1b2;
+    double varX = n * sumXX - sumX * sumX, varY = n * sumYY - sumY * sumY;
+    if ( varX <= 0.0 || varY <= 0.0 )
+        return false;
+    double cov = n * sumXY - sumX * sumY;
+    r2 = ( cov * cov ) / ( varX * varY );
+
+    double p1 = sumX / ( 2.0 * n ), p2 = sumY / ( 2.0 * n );
+    double D = cov / ( 2.0 * n * n );
+    double Dmax = ( D > 0 ) ? min( p1 * ( 1.0 - p2 ), ( 1.0 - p1 ) * p2 ) : min( p1 * p2, ( 1.0 - p1 ) * ( 1.0 - p2 ) );
+    Dprime = ( Dmax > 0.0 ) ? fabs( D ) / Dmax : 0.0;
+    if ( Dprime > 1.0 )
+        Dprime = 1.0;
+    return true;
+}
+
+
+bool calculateSummaryStats( char* sampleData, bool keepThis, int numTokensInFormat, bool lookForDP, bool lookForGQ, bool lookForPL, char formatDelim, int formatOpsOrder[], int numSamples, PopulationDesignation* designations, int numDesignations, unsigned long int VCFfileLineCount, char* CHROM, char* POS, char* ID, char* REF, char* ALT, char* QUAL, char* FILTER, char* genotypeCodes, int* DPvalues, int* GQvalues, ofstream* cacheFile, SampleStats* sampleStats, LDwindow* LD, PlinkExport* plink, GenotypeBatch* batch, SampleThreadPool* sampleThreads, BCFreader* BCF )
+{
+    // writes one row per population designation for the current SNP and returns
+    // true, or returns false if a --filter condition on genotypes rejects it.
+    // sampleData points at the tab after FORMAT in the current line, or is NULL
+    // for a .bcf, whose record BCF holds.
+    // genotypeCodes, DPvalues, and GQvalues are work arrays of length numSamples
+    // owned by the caller so that they are not re-allocated for every SNP
+    int homoRefCount = 0, homoAltCount = 0, hetCount = 0;
+    int DPnoCall = 0, GQnoCall = 0;
     if ( lookForDP ) {
         for ( int i = 0; i < numSamples; i++ )
             DPvalues[i] = 0;
@@ -313,153 +693,30 @@ void calculateSummaryStats( istream& VCFfile, ofstream& outputFile, int numToken
         for ( int i = 0; i < numSamples; i++ )
             GQvalues[i] = 0;
     }
-    if ( lookForPL ) {
-        for ( int i = 0; i < (numSamples * ENTRIES_IN_PL); i++ )
-            PLvalues[i] = 0;
-    }
-
-    // loop over all columns of data:
-    int sampleCounter = 0, operationCode, popIndex;
-    //size_t pos, strStart[numTokensInFormat], strLen[numTokensInFormat];
-    size_t tokenLength;
-    char checkGTsep1 = '/', checkGTsep2 = '|'; // the only two expected separators
-    char allele1, allele2;
-	int DPnoCall = 0, GQnoCall = 0;
-    char* charpt, dummyChar;
-    char tokenHolder[MAX_TOKEN_LENGTH];
-    for ( sampleCounter = 0; sampleCounter < numSamples; sampleCounter++ ) {
-        
-        popIndex = populationReference[ sampleCounter ];
-        
-//        VCFfile.get( dummyChar );
-//#ifdef DEBUG
-//        if ( dummyChar != '\t' ) {
-//            cerr << "\nYo, file parsing not working way you think.\n\tIn calculateSummaryStats():\n\t";
-//            cerr << "dummyChar = " << dummyChar << endl;
-//        }
-//#endif
-        
-        // parse the current sample:
-        for ( int tokeni = 0; tokeni < numTokensInFormat; tokeni++ ) {
-            VCFfile.get( dummyChar ); // always have to clear the delims
-            if ( tokeni < ( numTokensInFormat - 1 ) )
-                VCFfile.get( tokenHolder, MAX_TOKEN_LENGTH, formatDelim ); // get up to next ':'
-            else if ( sampleCounter < ( numSamples - 1 ) )
-                VCFfile.get( tokenHolder, MAX_TOKEN_LENGTH, VCF_DELIM ); // get up to next '\t'
-            else
-                VCFfile.get( tokenHolder, MAX_TOKEN_LENGTH, '\n' ); // last possible one
-            // get operation code:
-            operationCode = formatOpsOrder[tokeni];
-            tokenLength = strlen( tokenHolder );
-            if ( operationCode == GT_OPS_CODE ) {
-                // parse the genotype data and add to correct population
-                allele1 = tokenHolder[0];
-                allele2 = tokenHolder[2]; // for biallelic SNPS, it should go like this always!
-
-                // considering the diploid genotype, there are 9 options:
-                if ( allele1 == '0' ) {
-                    if ( allele2 == '0' ) {
-                        homoRefCount++;
-                        validSampleCounts[popIndex] += 2; // diploid; no alt alleles
-                    } else if ( allele2 == '1' ) {
-                        hetCount++;
-                        validSampleCounts[popIndex] += 2; // diploid
-                        altAlleleCounts[popIndex]++; // one alt allele
-                    } else {
-                        // only allele1 was valid/called:
-                        validSampleCounts[popIndex]++;
-                    }
-                } else if ( allele1 == '1' ) {
-                    if ( allele2 == '0' ) {
-                        hetCount++;
-                        validSampleCounts[popIndex] += 2; // diploid
-                        altAlleleCounts[popIndex]++; // one alt allele
-                    } else if ( allele2 == '1' ) {
-                        homoAltCount++;
-                        validSampleCounts[popIndex] += 2; // diploid
-                        altAlleleCounts[popIndex] += 2; // two alt alleles
-                    } else {
-                        // allele 2 was not valid/called
-                        validSampleCounts[popIndex]++;
-                        altAlleleCounts[popIndex]++; // one alt allele
-                    }
-                } else {
-                    // allele 1 was not valid/called
-                    if ( allele2 == '0' || allele2 == '1' ) {
-                        validSampleCounts[popIndex]++;
-                        if ( allele2 == '1' )
-                            altAlleleCounts[popIndex]++; // one alt allele
-                    }
-                }
-
-                // now recording allele counts:
-
-//#ifdef DEBUG
-
-                if ( tokenHolder[1] != checkGTsep1 && tokenHolder[1] != checkGTsep2 ) {
-                    cerr << "\nError in calculateSummaryStats():\n\tGT token ";
-                    cerr << "does not have expected character (" << checkGTsep1 << " or " << checkGTsep2 << ") between alleles.\n\t";
-                    cerr << "I found: " << tokenHolder[1] << ", and the whole token was:\n\t";
-                    
-                    fprintf(stderr, "[start]%s[end], length = %lu\n", tokenHolder, tokenLength);
-                    fprintf(stderr, "Sample counter = %i\n", sampleCounter);
-                    
-                    cerr << "Aborting ... \n\n";
-                    exit(-1);
-                }
-//                if ( sampleCounter % 100 == 0 ) {
-//                    cout << "\nsample " << (sampleCounter+1) << ", loop count " << tokeni << ", GT is " << token << endl;
-//                    cout << "allele1 = " << allele1 << ", allele2 = " << allele2 << "\t" << allele1.length() << "\t" << allele2.length() << endl;
-//                    cout << "homoRefCount = " << homoRefCount << ", hetCount = " << hetCount << ", homoAltCount = " << homoAltCount << endl;
-//                    cout << "Valid sample counts and alt allele counts by popn:\n";
-//                    for ( int j = 0; j < numPopulations; j++ )
-//                        cout << "\t" << validSampleCounts[j] << ", " << altAlleleCounts[j];
-//                    cout << endl;
-//                }
-//#endif
-
-            } else if ( operationCode == DP_OPS_CODE && lookForDP ) {
-                // add the DP data to DP array
-				if ( tokenHolder[0] == '.' && tokenLength == 1 ) {
-					DPvalues[sampleCounter] = -1;
-					DPnoCall++;
-				} else {
-                    //fprintf(stdout, "\nDP tokenHolder is: [%s] with length %lu\n", tokenHolder, tokenLength);
-                	DPvalues[sampleCounter] = stoi(tokenHolder);
-				}
-
-//                cout << "\nsample " << (sampleCounter+1) << ", loop count " << tokeni << ", DP is " << token << endl;
-            } else if ( operationCode == GQ_OPS_CODE && lookForGQ ) {
-                // add the GQ data to the GQ array
-				if ( tokenHolder[0] == '.' && tokenLength == 1 ) {
-					GQvalues[sampleCounter] = -1;
-					GQnoCall++;
-				} else {
-                    //fprintf(stdout, "\nGQ tokenHolder is: [%s] with length %lu\n", tokenHolder, tokenLength);
-					GQvalues[sampleCounter] = stoi(tokenHolder);
-				}
-//                cout << "\nsample " << (sampleCounter+1) << ", loop count " << tokeni << ", GQ is " << token << endl;
-            } else if ( operationCode == PL_OPS_CODE && lookForPL ) {
-                
-                parsePL( tokenHolder );
-                
-            }
 
-            // otherwise just skip it
-
-            // delete the substring
-            //currentSample.erase(0, pos + formatDelim.length()); // old way replaced by prior for loop
-        }  // end of loop over tokens in sample
+    // parse all sample columns of the current line:
+    if ( BCF )
+        decodeBCFsamples( *BCF, lookForDP, lookForGQ, numSamples, genotypeCodes, DPvalues, GQvalues, DPnoCall, GQnoCall );
+    else if ( sampleThreads )
+        decodeSampleChunks( *sampleThreads, sampleData, numTokensInFormat, lookForDP, lookForGQ, lookForPL, formatDelim, formatOpsOrder, numSamples, genotypeCodes, DPvalues, GQvalues, DPnoCall, GQnoCall, keepThis && !batch );
+    else
+        decodeSampleColumns( sampleData, numTokensInFormat, lookForDP, lookForGQ, lookForPL, formatDelim, formatOpsOrder, numSamples, genotypeCodes, DPvalues, GQvalues, DPnoCall, GQnoCall, true );
+
+    // the cache needs DP and GQ in sample order, so write it before the median sorts them:
+    if ( cacheFile ) {
+        writeCacheSampleData( *cacheFile, genotypeCodes, DPvalues, GQvalues, lookForDP, lookForGQ, numSamples );
+    }
 
-    }  // end of for() loop over numSamples; used to be while() loop over lineStream
+    // --filter conditions on MAF and call rate:
+    if ( keepThis && !GENOTYPE_FILTERS.empty() ) {
+        double MAF, callRate;
+        calculateFilterGenotypeStats( genotypeCodes, numSamples, MAF, callRate );
+        keepThis = passesFilters( GENOTYPE_FILTERS, CHROM, POS, QUAL, FILTER, MAF, callRate );
+    }
 
-    // error checking:
-    if ( sampleCounter != numSamples ) {
-        cout << "\nError in calculateSummaryStats():\n\tline parsing did not give numSamples number of loops.\n\t";
-        cout << "sampleCounter = " << sampleCounter << ", but numSamples = " << numSamples;
-        cout << "\n\tThis suggests inconsistencies in VCF file construction\n\twith uneven numbers of samples per row";
-        cout << "\n\tAborting ... ";
-        exit(-5);
+    // per-sample QC needs DP and GQ in sample order too:
+    if ( keepThis && sampleStats ) {
+        accumulateSampleStats( *sampleStats, genotypeCodes, DPvalues, GQvalues, lookForDP, lookForGQ );
     }
 
     // calculate stats
@@ -467,40 +724,73 @@ void calculateSummaryStats( istream& VCFfile, ofstream& outputFile, int numToken
     // here is the order of remaining columns to calculate and add to ofstream outputFile:
     // medianDP        medianGQ        homoRefCount    hetCount        homoAltCount
     // plus one column for each population named ALT_SNP_FREQ_popName
-    int median;
-    // medianDP:
+    // (with --sample-threads, from the chunks' histograms when they hold every value)
+    int medianDP = MEDIAN_NOT_AVAILABLE, medianGQ = MEDIAN_NOT_AVAILABLE;
+    bool fromHistograms = sampleThreads && sampleThreads->decoded && !sampleThreads->outOfHistogram;
     if ( lookForDP && (DPnoCall < numSamples ) ) {
-        median = calculateMedian( DPvalues, numSamples, DPnoCall );
-        outputFile << "\t" << median;
-    } else {
-        outputFile << "\t" << MISSING_DATA_INDICATOR;
+        if ( fromHistograms )
+            medianDP = histogramMedian( sampleThreads->DPhistogram, DPnoCall + ( numSamples - DPnoCall ) / 2 );
+        else
+            medianDP = calculateMedian( DPvalues, numSamples, DPnoCall );
     }
-    // median GQ:
     if ( lookForGQ && (GQnoCall < numSamples) ) {
-        median = calculateMedian( GQvalues, numSamples, GQnoCall );
-        outputFile << "\t" << median;
-    } else {
-        outputFile << "\t" << MISSING_DATA_INDICATOR;
+        if ( fromHistograms )
+            medianGQ = histogramMedian( sampleThreads->GQhistogram, GQnoCall + ( numSamples - GQnoCall ) / 2 );
+        else
+            medianGQ = calculateMedian( GQvalues, numSamples, GQnoCall );
     }
-    // diploid genotype counts:
-    outputFile << "\t" << homoRefCount << "\t" << hetCount << "\t" << homoAltCount;
-    double freq;
-    for ( int i = 0; i < numPopulations; i++ ) {
-        if ( !validSampleCounts[i] ) {
-          // no div by zero
-            freq = std::numeric_limits<double>::quiet_NaN();
-        } else {
-            freq = static_cast<double>( altAlleleCounts[i] ) / static_cast<double>( validSampleCounts[i] );
-        }
-        outputFile << "\t" << freq << "\t" << validSampleCounts[i];
+    if ( cacheFile ) {
+        int32_t medians[2] = { medianDP, medianGQ };
+        cacheFile->write( reinterpret_cast<char*>( medians ), sizeof( medians ) );
     }
 
-    // outputFile << endl;  not needed here; this is done in parseActualData()
+    // lines that were decoded only for the cache end here:
+    if ( !keepThis )
+        return false;
+
+    // with --record-batch, genotypeCodes is the batch's next row, and the rows of the
+    // summary are written when the batch is full:
+    if ( batch )
+        addToGenotypeBatch( *batch, VCFfileLineCount, CHROM, POS, ID, REF, ALT, QUAL, medianDP, medianGQ, designations, numDesignations );
+    // otherwise the decoded genotypes are tallied once for each population designation:
+    for ( int d = 0; d < numDesignations && !batch; d++ ) {
+        int numPopulations = designations[d].numPopulations;
+        int altAlleleCounts[numPopulations], validSampleCounts[numPopulations];
+        int popCodeCounts[numPopulations * NUM_GT_CODES];
+        ofstream& outputFile = designations[d].outputFile;
+        if ( sampleThreads && sampleThreads->tally )
+            mergeSampleChunkTallies( *sampleThreads, d, numPopulations, altAlleleCounts, validSampleCounts, homoRefCount, hetCount, homoAltCount, HWE_TESTS ? popCodeCounts : NULL );
+        else
+            tallyGenotypes( genotypeCodes, numSamples, designations[d].populationReference.data(), numPopulations, altAlleleCounts, validSampleCounts, homoRefCount, hetCount, homoAltCount, HWE_TESTS ? popCodeCounts : NULL );
+        if ( WRITE_SUMMARY_FILES ) {
+            if ( SPLIT_BY_CHROM )
+                selectChromOutputFile( designations[d], CHROM, POS );
+            // print out meta fields:
+            outputFile << VCFfileLineCount << "\t" << CHROM << "\t" << POS << "\t" << ID << "\t" << REF << "\t" << ALT << "\t" << QUAL;
+            writeINFOcolumns( outputFile );
+            writeSummaryColumns( outputFile, medianDP, medianGQ, homoRefCount, hetCount, homoAltCount, altAlleleCounts, validSampleCounts, numPopulations );
+            if ( HWE_TESTS )
+                writeHWEcolumns( outputFile, popCodeCounts, numPopulations );
+            // add end of line (done with this line):
+            outputFile << endl;
+        }
+        if ( SFS_SIZE_ALL || !SFS_SIZES_BY_POP.empty() )
+            accumulateSFS( designations[d], altAlleleCounts, validSampleCounts );
+        if ( SNP_SUMMARY_CALLBACK )
+            reportSNPsummary( designations[d], d, VCFfileLineCount, CHROM, POS, ID, REF, ALT, QUAL, medianDP, medianGQ, homoRefCount, hetCount, homoAltCount, altAlleleCounts, validSampleCounts );
+    }
+    if ( LD ) {
+        updateLD( *LD, designations, numDesignations, CHROM, POS, genotypeCodes );
+    }
+    if ( plink ) {
+        writePlinkSNP( *plink, genotypeCodes, numSamples, CHROM, POS, ID, REF, ALT );
+    }
 
+    return true;
 }
 
 
-inline void checkFormatToken( char* token, int& GTtoken, int& DPtoken, int& GQtoken, int& PLtoken, int subfieldCount  )
+inline void checkFormatToken( const string& token, int& GTtoken, int& DPtoken, int& GQtoken, int& PLtoken, int subfieldCount  )
 {
     // record sub-field:
     if ( token[0] == 'G' && token[1] == 'T' )
@@ -514,24 +804,229 @@ inline void checkFormatToken( char* token, int& GTtoken, int& DPtoken, int& GQto
 }
 
 
-void convertTimeInterval( clock_t myTimeInterval, int& minutes, double& seconds)
+void checkSampleColumns( string* sampleIDs, int numSamples, string source )
 {
-    double totalSeconds = (static_cast<double>( myTimeInterval )) / (static_cast<double>(CLOCKS_PER_SEC));
-    long unsigned int totSecondsInt = static_cast<long unsigned int>( totalSeconds );
-
-    minutes = totSecondsInt / 60;
-	seconds = totalSeconds - (static_cast<double> (minutes * 60));
-
+    // with several VCFs, every one must have the first one's sample columns, in the
+    // same order, since the merged summary has a single set of population columns
+    for ( int i = 0; i < numSamples && !FIRST_VCF_SAMPLE_IDS.empty(); i++ ) {
+        if ( sampleIDs[i] != FIRST_VCF_SAMPLE_IDS[i] ) {
+            cout << "\nError in checkSampleColumns():\n\tsample " << i + 1 << " of " << source << " is '" << sampleIDs[i] << "', but in ";
+            cout << VCF_FILE_NAMES[0] << " it is '" << FIRST_VCF_SAMPLE_IDS[i] << "'.\n\t--> Every VCF of a merged run must have the same samples in the same order.\n\tAborting ... \n\n";
+            abortRun(-2);
+        }
+    }
 }
 
 
-void createVCFfilter( boost::iostreams::filtering_streambuf<boost::iostreams::input>& myVCFin, string vcfName, ifstream& vcfUnfiltered )
+bool checkGenotypeCache( istream& cacheFile, string vcfName, int numFormats, char formatDelim, int maxSubfieldsInFormat )
 {
-    // boost libraries for filtering_streambuf
-    using namespace boost::iostreams;
+    // checks the header of the genotype cache belonging to vcfName, which the caller
+    // has opened (or holds in memory under --serve), against the current state of
+    // the VCF; on success, cacheFile is left pointing at the sample list that
+    // follows the header fields
+    string cacheName = vcfName + GENOTYPE_CACHE_SUFFIX;
+    char magic[8];
+    unsigned long long fileSize, cachedFileSize;
+    long long fileModTime, cachedFileModTime;
+    char cachedFormatDelim;
+    int32_t cachedNumFormats, cachedMaxSubfields;
+
+    if ( !cacheFile.good() )
+        return false;   // no cache; nothing to report
+
+    cacheFile.read( magic, sizeof( magic ) );
+    cacheFile.read( reinterpret_cast<char*>( &cachedFileSize ), sizeof( cachedFileSize ) );
+    cacheFile.read( reinterpret_cast<char*>( &cachedFileModTime ), sizeof( cachedFileModTime ) );
+    cacheFile.read( &cachedFormatDelim, sizeof( cachedFormatDelim ) );
+    cacheFile.read( reinterpret_cast<char*>( &cachedNumFormats ), sizeof( cachedNumFormats ) );
+    cacheFile.read( reinterpret_cast<char*>( &cachedMaxSubfields ), sizeof( cachedMaxSubfields ) );
+    if ( !cacheFile.good() || memcmp( magic, GENOTYPE_CACHE_MAGIC, sizeof( magic ) ) != 0 ) {
+        cout << "\n*** WARNING!  Genotype cache " << cacheName << " is not readable by this version.\n";
+        cout << "Parsing the VCF instead.\n";
+        return false;
+    }
+    if ( !getSourceFileStats( vcfName, fileSize, fileModTime ) || fileSize != cachedFileSize || fileModTime != cachedFileModTime ) {
+        cout << "\n*** WARNING!  Genotype cache " << cacheName << " is out of date with " << vcfName << ".\n";
+        cout << "Parsing the VCF instead; rebuild the cache with --build-cache.\n";
+        return false;
+    }
+    if ( cachedFormatDelim != formatDelim ) {
+        cout << "\n*** WARNING!  Genotype cache " << cacheName << " was built with FORMAT delimiter '" << cachedFormatDelim << "'.\n";
+        cout << "Parsing the VCF instead.\n";
+        return false;
+    }
+    // -f and -S decide how the genotypes were decoded:
+    if ( cachedNumFormats != numFormats || cachedMaxSubfields != maxSubfieldsInFormat ) {
+        cout << "\n*** WARNING!  Genotype cache " << cacheName << " was built with -f " << cachedNumFormats << " -S " << cachedMaxSubfields << ".\n";
+        cout << "Parsing the VCF instead; rebuild the cache with --build-cache.\n";
+        return false;
+    }
 
-    // must open file:
-    vcfUnfiltered.open(vcfName, ios_base::in | ios_base::binary);
+    // the cache doesn't keep the FILTER and INFO columns:
+    for ( int stage = 0; stage < 2; stage++ ) {
+        vector< vector<FilterInstruction> >& filters = stage ? GENOTYPE_FILTERS : SITE_FILTERS;
+        for ( size_t i = 0; i < filters.size(); i++ ) {
+            for ( size_t j = 0; j < filters[i].size(); j++ ) {
+                int opcode = filters[i][j].opcode;
+                if ( opcode == FILTER_OP_FILTER || opcode == FILTER_OP_INFO || opcode == FILTER_OP_INFO_FLAG ) {
+                    cout << "\nNot using genotype cache " << cacheName << ", because --filter uses FILTER or INFO,\n";
+                    cout << "which the cache does not store.  Parsing the VCF instead.\n";
+                    return false;
+                }
+            }
+        }
+    }
+
+    if ( MIN_GT_DP > CACHE_BYTE_MISSING - 1 || MIN_GT_GQ > CACHE_BYTE_MISSING - 1 || ( MAX_GT_DP != INT_MAX && MAX_GT_DP >= CACHE_BYTE_MISSING - 1 ) ) {
+        cout << "\nNot using genotype cache " << cacheName << ", because it stores DP and GQ only up to 254,\n";
+        cout << "which is not enough for the --min-gt-dp, --max-gt-dp or --min-gt-gq limits.  Parsing the VCF instead.\n";
+        return false;
+    }
+    if ( SAMPLE_STATS ) {
+        cout << "\nNot using genotype cache " << cacheName << " for --sample-stats, because the cache stores\n";
+        cout << "DP and GQ only up to 254.  Parsing the VCF instead.\n";
+        return false;
+    }
+    if ( !INFO_OUTPUT_COLS.empty() ) {
+        cout << "\nNot using genotype cache " << cacheName << ", because --info-cols needs the INFO column,\n";
+        cout << "which the cache does not store.  Parsing the VCF instead.\n";
+        return false;
+    }
+
+    cout << "\nUsing genotype cache " << cacheName << " instead of parsing the VCF.\n";
+    return true;
+}
+
+
+void closeLineReader( VCFlineReader& reader )
+{
+    delete[] reader.block;
+    reader.block = NULL;
+}
+
+
+VCFlineReader::VCFlineReader() : block( NULL )
+{
+}
+
+
+VCFlineReader::~VCFlineReader()
+{
+    // closeLineReader() has normally freed the block; not when a library run unwinds
+    delete[] block;
+}
+
+
+void compileFilterExpression( string expression )
+{
+    // compiles one --filter expression into flat postfix programs, one per
+    // top-level && term. Terms that only use meta columns go to SITE_FILTERS and
+    // are checked before the sample columns are parsed; terms that use MAF or
+    // CALLRATE go to GENOTYPE_FILTERS and are checked after genotypes are decoded.
+    // Grammar, loosest binding first:
+    //   expr := term ( '||' term )*        term := unary ( '&&' unary )*
+    //   unary := '!' unary | '(' expr ')' | predicate
+    //   predicate := FIELD cmp VALUE | FIELD 'in' '{' VALUE ( ',' VALUE )* '}' | INFO.key
+    // where FIELD is QUAL, FILTER, CHROM, INFO.key, MAF, or CALLRATE
+    vector<string> tokens = tokenizeFilterExpression( expression );
+    size_t pos = 0;
+    vector< vector<FilterInstruction> > terms;
+
+    terms.push_back( parseFilterUnary( tokens, pos, expression ) );
+    while ( pos < tokens.size() && tokens[pos] == "&&" ) {
+        pos++;
+        terms.push_back( parseFilterUnary( tokens, pos, expression ) );
+    }
+    if ( pos < tokens.size() && tokens[pos] == "||" ) {
+        // an || at the top level means the whole expression is a single term:
+        vector<FilterInstruction> program = terms[0];
+        FilterInstruction combine;
+        combine.opcode = FILTER_OP_AND;
+        for ( size_t i = 1; i < terms.size(); i++ ) {
+            program.insert( program.end(), terms[i].begin(), terms[i].end() );
+            program.push_back( combine );
+        }
+        combine.opcode = FILTER_OP_OR;
+        while ( pos < tokens.size() && tokens[pos] == "||" ) {
+            pos++;
+            vector<FilterInstruction> rhs = parseFilterAnd( tokens, pos, expression );
+            program.insert( program.end(), rhs.begin(), rhs.end() );
+            program.push_back( combine );
+        }
+        terms.assign( 1, program );
+    }
+    if ( pos < tokens.size() ) {
+        filterExpressionError( expression, "unexpected '" + tokens[pos] + "'" );
+    }
+
+    for ( size_t i = 0; i < terms.size(); i++ ) {
+        bool needsGenotypes = false;
+        for ( size_t j = 0; j < terms[i].size(); j++ ) {
+            if ( terms[i][j].opcode == FILTER_OP_MAF || terms[i][j].opcode == FILTER_OP_CALLRATE )
+                needsGenotypes = true;
+        }
+        if ( needsGenotypes )
+            GENOTYPE_FILTERS.push_back( terms[i] );
+        else
+            SITE_FILTERS.push_back( terms[i] );
+    }
+}
+
+
+void convertTimeInterval( clock_t myTimeInterval, int& minutes, double& seconds)
+{
+    double totalSeconds = (static_cast<double>( myTimeInterval )) / (static_cast<double>(CLOCKS_PER_SEC));
+    long unsigned int totSecondsInt = static_cast<long unsigned int>( totalSeconds );
+
+    minutes = totSecondsInt / 60;
+	seconds = totalSeconds - (static_cast<double> (minutes * 60));
+
+}
+
+
+inline void copyVCFfield( char*& cursor, char* field )
+{
+    // copies the field that starts at cursor into field, truncated to
+    // MAX_BUFFER_SIZE - 1 characters like istream::get(), and leaves cursor on
+    // the tab (or '\0') that ends it
+    size_t length = 0;
+    while ( cursor[length] != VCF_DELIM && cursor[length] != '\0' )
+        length++;
+    size_t copied = ( length < MAX_BUFFER_SIZE ) ? length : MAX_BUFFER_SIZE - 1;
+    memcpy( field, cursor, copied );
+    field[copied] = '\0';
+    cursor += length;
+}
+
+
+unsigned long long countVCFheaderBytes( string vcfName )
+{
+    // number of uncompressed bytes in the VCF up to and including the #CHROM line,
+    // i.e. the offset of the first data line; checkpoints record absolute offsets
+    boost::iostreams::filtering_streambuf<boost::iostreams::input> headerVCFin;
+    ifstream headerUnfiltered;
+    string line;
+    unsigned long long headerBytes = 0;
+    createVCFfilter( headerVCFin, vcfName, headerUnfiltered );
+    istream headerVCF( &headerVCFin );
+    while ( getline( headerVCF, line ) ) {
+        headerBytes += line.length() + 1;
+        if ( line.compare( 0, 6, "#CHROM" ) == 0 )
+            return headerBytes;
+    }
+    cout << "\nError in countVCFheaderBytes():\n\tno #CHROM line in " << vcfName << "\n\tAborting ... \n\n";
+    abortRun(-2);
+}
+
+
+void createVCFfilter( boost::iostreams::filtering_streambuf<boost::iostreams::input>& myVCFin, string vcfName, ifstream& vcfUnfiltered )
+{
+    // boost libraries for filtering_streambuf
+    using namespace boost::iostreams;
+
+    // must open file (--read-ahead opens it itself, below):
+    if ( READ_AHEAD_DEPTH == 0 )
+        vcfUnfiltered.open(vcfName, ios_base::in | ios_base::binary);
 
 
     // find the file extension so we know what kind of filter, if any, to use:
@@ -550,14 +1045,343 @@ void createVCFfilter( boost::iostreams::filtering_streambuf<boost::iostreams::in
         myVCFin.push(gzip_decompressor());
     } else if ( filext == ".bz2" ) {
         myVCFin.push(bzip2_decompressor());
+    } else if ( filext == ".bcf" ) {
+        // a BCF is normally compressed with BGZF, which is gzip, but may be written without:
+        ifstream BCFfile( vcfName, ios_base::in | ios_base::binary );
+        unsigned char magic[2] = { 0, 0 };
+        BCFfile.read( reinterpret_cast<char*>( magic ), sizeof( magic ) );
+        if ( magic[0] == 31 && magic[1] == 139 )
+            myVCFin.push(gzip_decompressor());
     } else if ( filext != ".vcf" ) {
         cerr << "\nError!!  File extension '" << filext << "' not recognized!" << endl;
         cerr << "\n\tAborting ... \n\n";
-        exit(-1);
+        abortRun(-1);
     }
 
     // make the file the input
-    myVCFin.push( vcfUnfiltered );
+    if ( READ_AHEAD_DEPTH > 0 ) {
+        ReadAheadSource source = { openReadAhead( vcfName, 0 ) };
+        myVCFin.push( source );
+    } else {
+        myVCFin.push( vcfUnfiltered );
+    }
+}
+
+
+void decodeBCFsamples( BCFreader& reader, bool lookForDP, bool lookForGQ, int numSamples, char* genotypeCodes, int* DPvalues, int* GQvalues, int& DPnoCall, int& GQnoCall )
+{
+    // the BCF counterpart of decodeSampleColumns(), reading the typed arrays that
+    // readBCFrecord() found.  A GT allele is stored as (allele index + 1) << 1, plus 1
+    // if phased, and 0 for '.'; alleles other than REF and ALT count as not called,
+    // as in a VCF, and only the first two alleles of each sample are used
+    static const char codesByAlleles[3][3] = {  // 0 = REF, 1 = ALT, 2 = not called
+        { GT_CODE_HOMO_REF, GT_CODE_HET, GT_CODE_REF_ONLY },
+        { GT_CODE_HET, GT_CODE_HOMO_ALT, GT_CODE_ALT_ONLY },
+        { GT_CODE_REF_ONLY, GT_CODE_ALT_ONLY, GT_CODE_MISSING } };
+    BCFfield &GT = reader.GT, &DP = reader.DP, &GQ = reader.GQ;
+    size_t GTstride = GT.data ? GT.count * BCF_TYPE_SIZES[GT.type] : 0;
+    size_t DPstride = DP.data ? DP.count * BCF_TYPE_SIZES[DP.type] : 0;
+    size_t GQstride = GQ.data ? GQ.count * BCF_TYPE_SIZES[GQ.type] : 0;
+    int allele1, allele2;
+    int32_t value;
+    bool maskCall;
+    for ( int sampleCounter = 0; sampleCounter < numSamples; sampleCounter++ ) {
+        maskCall = false; // set if DP or GQ is outside the --min-gt-dp/--max-gt-dp/--min-gt-gq limits
+        allele1 = allele2 = 2;
+        if ( GT.data ) {
+            value = getBCFint( GT.data + sampleCounter * GTstride, GT.type );
+            allele1 = ( value >= 2 && value < 6 ) ? ( value >> 1 ) - 1 : 2;
+            if ( GT.count > 1 ) {
+                value = getBCFint( GT.data + sampleCounter * GTstride + BCF_TYPE_SIZES[GT.type], GT.type );
+                allele2 = ( value >= 2 && value < 6 ) ? ( value >> 1 ) - 1 : 2;
+            }
+        }
+        genotypeCodes[sampleCounter] = codesByAlleles[allele1][allele2];
+
+        if ( lookForDP ) {
+            value = DP.data ? getBCFint( DP.data + sampleCounter * DPstride, DP.type ) : BCF_INT_MISSING;
+            if ( value == BCF_INT_MISSING || value == BCF_INT_VECTOR_END ) {
+                DPvalues[sampleCounter] = -1;
+                DPnoCall++;
+            } else {
+                DPvalues[sampleCounter] = value;
+                maskCall = maskCall || value < MIN_GT_DP || value > MAX_GT_DP;
+            }
+        }
+        if ( lookForGQ ) {
+            value = GQ.data ? getBCFint( GQ.data + sampleCounter * GQstride, GQ.type ) : BCF_INT_MISSING;
+            if ( value == BCF_INT_MISSING || value == BCF_INT_VECTOR_END ) {
+                GQvalues[sampleCounter] = -1;
+                GQnoCall++;
+            } else {
+                GQvalues[sampleCounter] = value;
+                maskCall = maskCall || value < MIN_GT_GQ;
+            }
+        }
+
+        if ( maskCall )
+            genotypeCodes[sampleCounter] = GT_CODE_MISSING;
+    }
+}
+
+
+void decodeSampleChunk( SampleThreadPool& pool, int chunkIndex )
+{
+    // does one chunk of the current line in two steps.  Chunk k starts at the first
+    // tab at or after k / numChunks of the way through the sample columns; it counts
+    // the columns up to the next chunk's start, and once every chunk has counted, it
+    // knows its first sample, and decodes and tallies its columns
+    SampleChunk& chunk = pool.chunks[chunkIndex];
+    int numChunks = static_cast<int>( pool.chunks.size() );
+    size_t span = pool.lineEnd - pool.sampleData;
+    char *chunkEnd = pool.lineEnd;
+    for ( int k = chunkIndex; k <= chunkIndex + 1 && k < numChunks; k++ ) {
+        char *tab = pool.sampleData + span * k / numChunks;
+        tab = static_cast<char*>( memchr( tab, VCF_DELIM, pool.lineEnd - tab ) );
+        if ( k == chunkIndex )
+            chunk.start = tab ? tab : pool.lineEnd;
+        else
+            chunkEnd = tab ? tab : pool.lineEnd;
+    }
+    int numColumns = 0;
+    for ( const char *c = chunk.start; c < chunkEnd; c++ )
+        numColumns += ( *c == VCF_DELIM );
+    chunk.numSamples = numColumns;
+    {
+        unique_lock<mutex> guard( pool.lock );
+        if ( --pool.chunksCounting == 0 )
+            pool.columnsCounted.notify_all();
+        else
+            pool.columnsCounted.wait( guard, [&pool] { return pool.chunksCounting == 0; } );
+    }
+    int totalColumns = 0;
+    chunk.firstSample = 0;
+    for ( int k = 0; k < numChunks; k++ ) {
+        if ( k < chunkIndex )
+            chunk.firstSample += pool.chunks[k].numSamples;
+        totalColumns += pool.chunks[k].numSamples;
+    }
+    // a line with too few or too many columns is left to decodeSampleChunks():
+    chunk.DPnoCall = chunk.GQnoCall = 0;
+    if ( totalColumns != pool.numSamples || chunk.numSamples == 0 )
+        return;
+
+    int first = chunk.firstSample, n = chunk.numSamples;
+    try {
+        decodeSampleColumns( chunk.start, pool.numTokensInFormat, pool.lookForDP, pool.lookForGQ, pool.lookForPL, pool.formatDelim, pool.formatOpsOrder, n, pool.genotypeCodes + first, pool.DPvalues + first, pool.GQvalues + first, chunk.DPnoCall, chunk.GQnoCall, first + n == pool.numSamples );
+    } catch ( int status ) {
+        chunk.status = status;     // abortRun() in the library; the calling thread passes it on
+        return;
+    }
+
+    // histograms of DP and GQ, for medians that don't need the values sorted:
+    chunk.outOfHistogram = false;
+    for ( int field = 0; field < 2; field++ ) {
+        bool lookFor = field ? pool.lookForGQ : pool.lookForDP;
+        int *values = ( field ? pool.GQvalues : pool.DPvalues ) + first;
+        vector<int>& histogram = field ? chunk.GQhistogram : chunk.DPhistogram;
+        if ( !lookFor )
+            continue;
+        histogram.assign( SAMPLE_HISTOGRAM_SIZE, 0 );
+        for ( int i = 0; i < n; i++ ) {
+            if ( values[i] < -1 || values[i] > SAMPLE_HISTOGRAM_SIZE - 2 )
+                chunk.outOfHistogram = true;
+            else
+                histogram[ values[i] + 1 ]++;
+        }
+    }
+
+    if ( pool.tally ) {
+        for ( int d = 0; d < pool.numDesignations; d++ ) {
+            int numPopulations = pool.designations[d].numPopulations;
+            int *counts = &chunk.popCounts[d][0];
+            tallyGenotypes( pool.genotypeCodes + first, n, pool.designations[d].populationReference.data() + first, numPopulations, counts, counts + numPopulations, chunk.homoRefCount, chunk.hetCount, chunk.homoAltCount, HWE_TESTS ? counts + 2 * numPopulations : NULL );
+        }
+    }
+}
+
+
+void decodeSampleChunks( SampleThreadPool& pool, char* sampleData, int numTokensInFormat, bool lookForDP, bool lookForGQ, bool lookForPL, char formatDelim, int formatOpsOrder[], int numSamples, char* genotypeCodes, int* DPvalues, int* GQvalues, int& DPnoCall, int& GQnoCall, bool tally )
+{
+    // --sample-threads: decodeSampleColumns() for one line, with its sample columns
+    // split into chunks that the workers and the calling thread decode at the same
+    // time.  With tally, each chunk also does tallyGenotypes() on its samples (see
+    // mergeSampleChunkTallies()).  pool.lineEnd must already point at the line's '\0'
+    int numChunks = static_cast<int>( pool.chunks.size() );
+    {
+        lock_guard<mutex> guard( pool.lock );
+        pool.sampleData = sampleData;
+        pool.numTokensInFormat = numTokensInFormat;
+        pool.lookForDP = lookForDP;
+        pool.lookForGQ = lookForGQ;
+        pool.lookForPL = lookForPL;
+        pool.formatDelim = formatDelim;
+        pool.formatOpsOrder = formatOpsOrder;
+        pool.genotypeCodes = genotypeCodes;
+        pool.DPvalues = DPvalues;
+        pool.GQvalues = GQvalues;
+        pool.tally = tally;
+        pool.chunksCounting = numChunks;
+        pool.chunksLeft = numChunks - 1;
+        pool.round++;
+    }
+    pool.startWork.notify_all();
+    decodeSampleChunk( pool, numChunks - 1 );
+    {
+        unique_lock<mutex> guard( pool.lock );
+        pool.workDone.wait( guard, [&pool] { return pool.chunksLeft == 0; } );
+    }
+
+    int totalColumns = 0;
+    for ( int k = 0; k < numChunks; k++ ) {
+        if ( pool.chunks[k].status )
+            abortRun( pool.chunks[k].status );
+        totalColumns += pool.chunks[k].numSamples;
+    }
+    pool.decoded = ( totalColumns == numSamples );
+    pool.tally = tally && pool.decoded;
+    if ( !pool.decoded ) {
+        // as the line would be decoded without --sample-threads:
+        decodeSampleColumns( sampleData, numTokensInFormat, lookForDP, lookForGQ, lookForPL, formatDelim, formatOpsOrder, numSamples, genotypeCodes, DPvalues, GQvalues, DPnoCall, GQnoCall, true );
+        return;
+    }
+
+    // merge the chunks in order:
+    pool.outOfHistogram = false;
+    pool.DPhistogram.assign( SAMPLE_HISTOGRAM_SIZE, 0 );
+    pool.GQhistogram.assign( SAMPLE_HISTOGRAM_SIZE, 0 );
+    for ( int k = 0; k < numChunks; k++ ) {
+        SampleChunk& chunk = pool.chunks[k];
+        if ( chunk.numSamples == 0 )
+            continue;
+        DPnoCall += chunk.DPnoCall;
+        GQnoCall += chunk.GQnoCall;
+        pool.outOfHistogram = pool.outOfHistogram || chunk.outOfHistogram;
+        for ( int i = 0; i < SAMPLE_HISTOGRAM_SIZE && lookForDP; i++ )
+            pool.DPhistogram[i] += chunk.DPhistogram[i];
+        for ( int i = 0; i < SAMPLE_HISTOGRAM_SIZE && lookForGQ; i++ )
+            pool.GQhistogram[i] += chunk.GQhistogram[i];
+    }
+}
+
+
+void decodeSampleColumns( char* sampleData, int numTokensInFormat, bool lookForDP, bool lookForGQ, bool lookForPL, char formatDelim, int formatOpsOrder[], int numSamples, char* genotypeCodes, int* DPvalues, int* GQvalues, int& DPnoCall, int& GQnoCall, bool endsLine )
+{
+    // sampleData points at the tab after FORMAT; tokens are read in place from
+    // the line, which readVCFline() has terminated with '\0'.  Unless endsLine, the
+    // samples are a chunk of the line (see decodeSampleChunk()), and the last one
+    // ends at the next tab
+    // loop over all columns of data:
+    int sampleCounter = 0, operationCode;
+    size_t tokenLength;
+    char checkGTsep1 = '/', checkGTsep2 = '|'; // the only two expected separators
+    char allele1, allele2, code, stopChar;
+    char *cursor = sampleData, *token;
+    bool maskCall;
+    for ( sampleCounter = 0; sampleCounter < numSamples; sampleCounter++ ) {
+        maskCall = false; // set if DP or GQ is outside the --min-gt-dp/--max-gt-dp/--min-gt-gq limits
+
+        // parse the current sample:
+        for ( int tokeni = 0; tokeni < numTokensInFormat; tokeni++ ) {
+            if ( *cursor != '\0' )
+                cursor++; // always have to clear the delims
+            if ( tokeni < ( numTokensInFormat - 1 ) )
+                stopChar = formatDelim; // up to next ':'
+            else if ( sampleCounter < ( numSamples - 1 ) || !endsLine )
+                stopChar = VCF_DELIM; // up to next '\t'
+            else
+                stopChar = '\0'; // last possible one, up to the end of the line
+            token = cursor;
+            while ( *cursor != stopChar && *cursor != '\0' )
+                cursor++;
+            // get operation code:
+            operationCode = formatOpsOrder[tokeni];
+            tokenLength = cursor - token;
+            if ( operationCode == GT_OPS_CODE ) {
+                allele1 = token[0];
+                allele2 = ( tokenLength > 2 ) ? token[2] : '\0'; // for biallelic SNPS, it should go like this always!
+
+                // considering the diploid genotype, there are 9 options:
+                if ( allele1 == '0' ) {
+                    if ( allele2 == '0' )
+                        code = GT_CODE_HOMO_REF;
+                    else if ( allele2 == '1' )
+                        code = GT_CODE_HET;
+                    else
+                        code = GT_CODE_REF_ONLY; // only allele1 was valid/called
+                } else if ( allele1 == '1' ) {
+                    if ( allele2 == '0' )
+                        code = GT_CODE_HET;
+                    else if ( allele2 == '1' )
+                        code = GT_CODE_HOMO_ALT;
+                    else
+                        code = GT_CODE_ALT_ONLY; // allele 2 was not valid/called
+                } else {
+                    // allele 1 was not valid/called
+                    if ( allele2 == '0' )
+                        code = GT_CODE_REF_ONLY;
+                    else if ( allele2 == '1' )
+                        code = GT_CODE_ALT_ONLY;
+                    else
+                        code = GT_CODE_MISSING;
+                }
+                genotypeCodes[sampleCounter] = code;
+
+                if ( tokenLength < 2 || ( token[1] != checkGTsep1 && token[1] != checkGTsep2 ) ) {
+                    cerr << "\nError in decodeSampleColumns():\n\tGT token ";
+                    cerr << "does not have expected character (" << checkGTsep1 << " or " << checkGTsep2 << ") between alleles.\n\t";
+                    cerr << "I found: " << ( tokenLength < 2 ? '\0' : token[1] ) << ", and the whole token was:\n\t";
+
+                    fprintf(stderr, "[start]%.*s[end], length = %lu\n", static_cast<int>( tokenLength ), token, tokenLength);
+                    fprintf(stderr, "Sample counter = %i\n", sampleCounter);
+
+                    cerr << "Aborting ... \n\n";
+                    abortRun(-1);
+                }
+
+            } else if ( operationCode == DP_OPS_CODE && lookForDP ) {
+                // add the DP data to DP array
+                if ( token[0] == '.' && tokenLength == 1 ) {
+                    DPvalues[sampleCounter] = -1;
+                    DPnoCall++;
+                } else {
+                    DPvalues[sampleCounter] = static_cast<int>( strtol( token, NULL, 10 ) );
+                    maskCall = maskCall || DPvalues[sampleCounter] < MIN_GT_DP || DPvalues[sampleCounter] > MAX_GT_DP;
+                }
+            } else if ( operationCode == GQ_OPS_CODE && lookForGQ ) {
+                // add the GQ data to the GQ array
+                if ( token[0] == '.' && tokenLength == 1 ) {
+                    GQvalues[sampleCounter] = -1;
+                    GQnoCall++;
+                } else {
+                    GQvalues[sampleCounter] = static_cast<int>( strtol( token, NULL, 10 ) );
+                    maskCall = maskCall || GQvalues[sampleCounter] < MIN_GT_GQ;
+                }
+            } else if ( operationCode == PL_OPS_CODE && lookForPL ) {
+
+                parsePL( token );
+
+            }
+
+            // otherwise just skip it
+
+        }  // end of loop over tokens in sample
+
+        // a masked call is missing for the frequencies, counts, filters and LD, but its
+        // DP and GQ still go into medianDP and medianGQ:
+        if ( maskCall )
+            genotypeCodes[sampleCounter] = GT_CODE_MISSING;
+
+    }  // end of for() loop over numSamples; used to be while() loop over lineStream
+
+    // error checking:
+    if ( sampleCounter != numSamples ) {
+        cout << "\nError in decodeSampleColumns():\n\tline parsing did not give numSamples number of loops.\n\t";
+        cout << "sampleCounter = " << sampleCounter << ", but numSamples = " << numSamples;
+        cout << "\n\tThis suggests inconsistencies in VCF file construction\n\twith uneven numbers of samples per row";
+        cout << "\n\tAborting ... ";
+        abortRun(-5);
+    }
 }
 
 
@@ -570,26 +1394,26 @@ void determineFormatOpsOrder( int numTokensInFormat, int GTtoken, int DPtoken, i
         cout << numTokensInFormat << ")\n";
         cout << "\t--> Call program again with invocation provided by the wrapper\n\t";
         cout << "plus -S " << numTokensInFormat << "\n\tAborting ...\n";
-        exit(-4);
+        abortRun(-4);
     }
 
 #ifdef DEBUG
     if ( lookForGQ ) {
         if ( GTtoken == GQtoken ) {
             cout << "\nError in determineFormatOpsOrder()!!\n\tGTtoken(" << GTtoken << ") == GQtoken (" << GQtoken << ")\n";
-            exit(-4);
+            abortRun(-4);
         }
     }
     if ( lookForDP ) {
         if ( GTtoken == DPtoken ) {
             cout << "\nError in determineFormatOpsOrder()!!\n\tGTtoken(" << GTtoken << ") == DPtoken (" << DPtoken << ")\n";
-            exit(-4);
+            abortRun(-4);
         }
     }
     if ( lookForGQ && lookForDP ) {
         if ( GQtoken == DPtoken ) {
             cout << "\nError in determineFormatOpsOrder()!!\n\tGQtoken(" << GQtoken << ") == DPtoken (" << DPtoken << ")\n";
-            exit(-4);
+            abortRun(-4);
         }
     }
 #endif
@@ -628,7 +1452,7 @@ inline void errorCheckTokens( int GTtoken, int DPtoken, int GQtoken, int PLtoken
         cout << "indicate that by using the call provided by the wrapper script with the\n";
         cout << "addition of the -D DELIM command line option, where 'DELIM' is replaced\n";
         cout << "by the delimiter your VCF uses.\n\tAborting ...\n\n";
-        exit(-3);
+        abortRun(-3);
     }
     if ( DPtoken == -1 ) { // -1 is flag for not set
         cout << "\n*** WARNING!  DP subfield was not found in FORMAT.\n";
@@ -679,43 +1503,85 @@ inline void errorCheckTokens( int GTtoken, int DPtoken, int GQtoken, int PLtoken
 //}
 
 
-double extractDPvalue( char* INFObuffer, bool& lookForDPinINFO )
+bool evaluateFilterPredicate( FilterInstruction& instruction, char* CHROM, char* POS, char* QUAL, char* FILTER, double MAF, double callRate )
 {
-    char dumc;
-    int count = 0, buffCount, valCount;
-    bool DPfound = false;
-    char holdValueAsChar[80];
-    double DPval;
-    
-    do {
-        if ( INFObuffer[count] == 'D' ) {
-            // could be DP
-            if ( INFObuffer[(count+1)] == 'P' ) {
-                if ( INFObuffer[(count+2)] == ' ' || INFObuffer[(count+2)] == '=' ) {
-                    // found it;
-                    DPfound = true;
-                    // because spaces are allowed in VCF standard, it could be
-                    // DP = num or DP= num or DP =num or DP=num
-                    buffCount = count+2;
-                    valCount = 0;
-                    while ( INFObuffer[ buffCount ] == ' ' || INFObuffer[ buffCount ] == '=' ) {
-                        ++buffCount; // get buffCount to first character that is past the equals sign
-                    }
-                    while ( INFObuffer[ buffCount ] != ';' && INFObuffer[ buffCount ] != '\t' && INFObuffer[ buffCount ] != ',') {
-                        holdValueAsChar[ valCount++ ] = INFObuffer[ buffCount++ ];
-                    }
-                    holdValueAsChar[ valCount ] = '\0';  // terminate with null string
-                    if ( !valCount ) {
-                        cerr << "\nError in extractDPvalue():\n\tDP found in INFO but no value found following it!\n\tAborting ....\n\n";
-                        exit(-5);
-                    }
-                    DPval = stod( holdValueAsChar );
-                }
+    // INFO predicates read the current line's values from INFO_KEYS (see tokenizeINFO())
+    const char *value;
+    double number;
+    char *endOfNumber;
+
+    switch ( instruction.opcode ) {
+        case FILTER_OP_QUAL:
+            number = strtod( QUAL, &endOfNumber );
+            if ( endOfNumber == QUAL )
+                return false;   // QUAL is missing ('.')
+            return filterCompareNumber( instruction, number );
+        case FILTER_OP_FILTER:
+            return filterCompareText( instruction, string( FILTER ) );
+        case FILTER_OP_CHROM:
+            if ( instruction.lastCHROM != CHROM ) {
+                instruction.lastCHROM = CHROM;
+                instruction.lastResult = filterCompareText( instruction, instruction.lastCHROM );
             }
+            return instruction.lastResult;
+        case FILTER_OP_INFO:
+            value = INFO_KEYS.values[ instruction.INFOkey ];
+            if ( value == NULL )
+                return false;
+            if ( !instruction.numericValue )
+                return filterCompareText( instruction, string( value, INFO_KEYS.valueLengths[ instruction.INFOkey ] ) );
+            return filterCompareNumber( instruction, numericINFOvalue( INFO_KEYS, instruction.INFOkey ) );
+        case FILTER_OP_INFO_FLAG:
+            return INFO_KEYS.values[ instruction.INFOkey ] != NULL;
+        case FILTER_OP_MAF:
+            return filterCompareNumber( instruction, MAF );
+        case FILTER_OP_CALLRATE:
+            return filterCompareNumber( instruction, callRate );
+        case FILTER_OP_POS:
+            return filterCompareNumber( instruction, strtod( POS, NULL ) );
+    }
+    return false;
+}
+
+
+bool evaluateFilterProgram( vector<FilterInstruction>& program, char* CHROM, char* POS, char* QUAL, char* FILTER, double MAF, double callRate )
+{
+    bool stack[ program.size() ];
+    int top = 0;
+    for ( size_t i = 0; i < program.size(); i++ ) {
+        switch ( program[i].opcode ) {
+            case FILTER_OP_AND:
+                top--;
+                stack[top - 1] = stack[top - 1] && stack[top];
+                break;
+            case FILTER_OP_OR:
+                top--;
+                stack[top - 1] = stack[top - 1] || stack[top];
+                break;
+            case FILTER_OP_NOT:
+                stack[top - 1] = !stack[top - 1];
+                break;
+            default:
+                stack[top++] = evaluateFilterPredicate( program[i], CHROM, POS, QUAL, FILTER, MAF, callRate );
         }
-    } while ( (INFObuffer[++count] != '\0') && (count < MAX_BUFFER_SIZE) && !DPfound );
-    
-    if ( !DPfound ) {
+    }
+    return stack[0];
+}
+
+
+double extractDPvalue( INFOkeyTable& table, bool& lookForDPinINFO )
+{
+    // table must already hold the current line (see tokenizeINFO()); only an
+    // exact DP key counts, so keys such as MQDP are not mistaken for it
+    double DPval;
+
+    if ( table.values[ INFO_KEY_DP ] != NULL ) {
+        if ( !table.valueLengths[ INFO_KEY_DP ] ) {
+            cerr << "\nError in extractDPvalue():\n\tDP found in INFO but no value found following it!\n\tAborting ....\n\n";
+            abortRun(-5);
+        }
+        DPval = numericINFOvalue( table, INFO_KEY_DP );
+    } else {
         cout << "\nWarning!!  No DP found in INFO field...\n";
         lookForDPinINFO = false;
         DPval = std::numeric_limits<double>::quiet_NaN();
@@ -727,120 +1593,1043 @@ double extractDPvalue( char* INFObuffer, bool& lookForDPinINFO )
 }
 
 
-inline size_t getLength( char *myCharArray )
+long long findBGZFvirtualOffset( ifstream& compressedFile, unsigned long long& blockStart, unsigned long long& blockDataStart, unsigned long long target )
 {
-    size_t totalLength = 0;
-    
-    while ( myCharArray[totalLength] != '\0' ) {
-        totalLength++;
+    // walks the BGZF blocks of compressedFile, starting from the block at blockStart
+    // whose data begin at uncompressed offset blockDataStart, to the block that holds
+    // uncompressed byte target, and returns target's virtual offset (block offset << 16
+    // | offset in the block).  Only each block's header and size footer are read, so
+    // the walk from one checkpoint to the next is cheap.  Returns -1 if the file is
+    // not BGZF (e.g. plain gzip) or target is past its end
+    unsigned long long blockSize, dataSize;
+    while ( true ) {
+        if ( !readBGZFblockSizes( compressedFile, blockStart, blockSize, dataSize ) )
+            return -1;
+        if ( target < blockDataStart + dataSize )
+            return static_cast<long long>( ( blockStart << 16 ) | ( target - blockDataStart ) );
+        blockStart += blockSize;
+        blockDataStart += dataSize;
     }
-    
-    return totalLength;
 }
 
 
-void parseActualData(istream& VCFfile, int numFormats, char formatDelim, int maxSubfieldsInFormat, unsigned long int& VCFfileLineCount, ofstream& outputFile, int numSamples, int numPopulations, int* populationReference, string vcfName )
+unsigned long long findNextBGZFblock( ifstream& compressedFile, unsigned long long target, unsigned long long fileSize )
 {
-    char *CHROM, *POS, *ID, *REF, *ALT, *QUAL;
-    //double QUAL;
-    long int dumCol, SNPcount = 0;
-    char dummyChar;
-    bool keepThis, checkFormat = true, lookForDP, lookForGQ, lookForPL;
-    int numTokensInFormat, GTtoken = -1, DPtoken = -1, GQtoken = -1, PLtoken = -1;
-	string discardedLinesFileName = vcfName + "_discardedLineNums.txt";
-	ofstream discardedLinesFile( discardedLinesFileName, ostream::out );
-    // string oneLine; // old way using linestream
-    // the latter ints are for parsing GT = genotype, DP = depth,
-    // and GQ = quality sub-fields of the FORMAT column
-    int formatOpsOrder[maxSubfieldsInFormat]; // for keeping track of how to parse FORMAT efficiently
-    CHROM = new char[MAX_BUFFER_SIZE];
-    POS = new char[MAX_BUFFER_SIZE];
-    ID = new char[MAX_BUFFER_SIZE];
-    REF = new char[MAX_BUFFER_SIZE];
-    ALT = new char[MAX_BUFFER_SIZE];
-    QUAL = new char[MAX_BUFFER_SIZE];
-
-	discardedLinesFile << "VCFfileLinesNotUsed" << endl; // header row
-    // work line by line:
-    // stringstream lineStream( "", ios_base::in | ios_base::out ); old way
-    // used to be while( getline ... )
-    while ( VCFfile.get( dummyChar ) ) {
-        VCFfile.putback( dummyChar ); // replace the one that get() got
-        SNPcount++; // counter of how many SNP lines have been processed
-        VCFfileLineCount++; // counter of how many LINES of VCF file have been processed
+    // offset of the first BGZF block that starts at or after target, or fileSize if
+    // there is none.  Blocks hold at most 64 KiB, so one starts within that distance;
+    // a candidate counts only if it is followed by another block or the end of the file
+    const size_t searchLength = 1 << 17;
+    vector<unsigned char> bytes( searchLength );
+    unsigned long long blockSize, dataSize, nextSize;
+    compressedFile.clear();
+    compressedFile.seekg( static_cast<streamoff>( target ) );
+    compressedFile.read( reinterpret_cast<char*>( bytes.data() ), searchLength );
+    size_t found = static_cast<size_t>( compressedFile.gcount() );
+    for ( size_t i = 0; i + 4 <= found; i++ ) {
+        if ( bytes[i] != 31 || bytes[i + 1] != 139 || bytes[i + 2] != 8 || !( bytes[i + 3] & 4 ) )
+            continue;
+        if ( readBGZFblockSizes( compressedFile, target + i, blockSize, dataSize ) && ( target + i + blockSize == fileSize || readBGZFblockSizes( compressedFile, target + i + blockSize, nextSize, dataSize ) ) )
+            return target + i;
+    }
+    return fileSize;
+}
 
-        // turn each line into a string stream for easy parsing by whitespace:
-        // lineStream.clear();
-        // lineStream.str( oneLine );
 
-        // work with meta-col data:
-        keepThis = parseMetaColData( VCFfile, SNPcount, checkFormat, numTokensInFormat, GTtoken, DPtoken, GQtoken, PLtoken, lookForDP, lookForGQ, lookForPL, formatDelim, CHROM, POS, ID, REF, ALT, QUAL);
+int findSample( const SampleTable& samples, const char* ID, size_t length )
+{
+    // the hash slot holding ID, or else the empty slot where it would go; the table
+    // is kept at most half full, so the probe always ends
+    unsigned int slot = hashINFOkey( ID, length, 1 ) & samples.mask;
+    while ( samples.slots[slot] >= 0 ) {
+        const string& candidate = samples.IDs[ samples.slots[slot] ];
+        if ( candidate.length() == length && memcmp( candidate.data(), ID, length ) == 0 )
+            break;
+        slot = ( slot + 1 ) & samples.mask;
+    }
+    return static_cast<int>( slot );
+}
+
+
+void finishGenotypeBatch( GenotypeBatch& batch, PopulationDesignation* designations, int numDesignations )
+{
+    // writes what is left in the batch
+    flushGenotypeBatch( batch, designations, numDesignations );
+}
 
-        if ( checkFormat ) {
-            determineFormatOpsOrder( numTokensInFormat, GTtoken, DPtoken, GQtoken, PLtoken, lookForDP, lookForGQ, lookForPL, formatDelim, formatOpsOrder, maxSubfieldsInFormat );
+
+void finishLD( LDwindow& LD, PopulationDesignation* designations, int numDesignations )
+{
+    // writes the --ld-bin tables and closes the LD files
+    for ( int d = 0; d < numDesignations; d++ ) {
+        PopulationDesignation& designation = designations[d];
+        if ( LD_BIN_WIDTH ) {
+            int numPopulations = designation.numPopulations;
+            size_t numBins = designation.LDbinPairs.size() / numPopulations;
+            for ( size_t bin = 0; bin < numBins; bin++ ) {
+                designation.LDfile << bin * LD_BIN_WIDTH << "\t" << ( bin + 1 ) * LD_BIN_WIDTH - 1;
+                for ( int pop = 0; pop < numPopulations; pop++ ) {
+                    size_t i = bin * numPopulations + pop;
+                    designation.LDfile << "\t" << designation.LDbinPairs[i];
+                    if ( designation.LDbinPairs[i] )
+                        designation.LDfile << "\t" << designation.LDbinR2sums[i] / designation.LDbinPairs[i] << "\t" << designation.LDbinDprimeSums[i] / designation.LDbinPairs[i];
+                    else
+                        designation.LDfile << "\t" << MISSING_DATA_INDICATOR << "\t" << MISSING_DATA_INDICATOR;
+                }
+                designation.LDfile << endl;
+            }
         }
+        designation.LDfile.close();
+    }
+}
 
-        if ( keepThis ) {
-            // it is a biallelic SNP
-            // print out meta fields:
-            outputFile << VCFfileLineCount << "\t" << CHROM << "\t" << POS << "\t" << ID << "\t" << REF << "\t" << ALT << "\t" << QUAL;
 
-            // let's calculate and store data for one line, i.e., one SNP at a time:
-            calculateSummaryStats( VCFfile, outputFile, numTokensInFormat, GTtoken, DPtoken, GQtoken, PLtoken, lookForDP, lookForGQ, lookForPL, formatDelim, formatOpsOrder, numSamples, numPopulations, VCFfileLineCount, populationReference );
+void finishPlinkExport( PlinkExport& plink )
+{
+    // closes the .bed and .bim that setUpPlinkExport() opened
+    plink.bed.close();
+    plink.bim.close();
+    if ( plink.bed.fail() || plink.bim.fail() ) {
+        cout << "\nError in finishPlinkExport():\n\tcould not finish writing " << plink.prefix << ".bed and .bim\n\tAborting ... \n\n";
+        abortRun(-4);
+    }
+    cout << "\nPLINK files with " << plink.numSNPs << " SNPs written to " << plink.prefix << ".bed, .bim and .fam" << endl;
+}
 
-            // add end of line (done with this line):
-            outputFile << endl;
-		} else {
-			discardedLinesFile << VCFfileLineCount << endl;
-            
-		}
-        VCFfile.ignore(unsigned(-1), '\n'); // go to end of line
-        
 
-        if ( numFormats == 1 ) {
-            checkFormat = false; // not needed after first SNP
-        }
-//        if ( SNPcount == 2 )
-//            exit(0);
+void finishSampleThreads( SampleThreadPool& pool )
+{
+    // stops and joins the --sample-threads workers
+    if ( pool.workers.empty() )
+        return;
+    {
+        lock_guard<mutex> guard( pool.lock );
+        pool.stop = true;
     }
+    pool.startWork.notify_all();
+    for ( size_t i = 0; i < pool.workers.size(); i++ )
+        pool.workers[i].join();
+    pool.workers.clear();
+}
+
 
-	discardedLinesFile.close();
-    delete[] CHROM;
-    delete[] POS;
-    delete[] ID;
-    delete[] REF;
-    delete[] ALT;
-    delete[] QUAL;
+SampleThreadPool::~SampleThreadPool()
+{
+    finishSampleThreads( *this );
 }
 
 
-void parseCommandLineInput(int argc, char *argv[], ifstream& PopulationFile, bool& popFileHeader, int& numSamples, int& numPopulations, int& numFields, int& numFormats, char& formatDelim, int& maxSubfieldsInFormat, string& vcfName, string& popFileName, map<string, int>& mapOfPopulations )
+void flushGenotypeBatch( GenotypeBatch& batch, PopulationDesignation* designations, int numDesignations )
 {
-	const int expectedMinArgNum = 4;
-	string progname = argv[0];
-    string* uniquePopulationNames;
-	string message = "\nError!  Please supply two file names as command line arguments,\n\tin the following way (note flags -V and -P):\n\t" + progname + " -V NameOfVCFfile -P NameOfPopulationFile\n\n";
-    bool numFormatsSet = false, vcfNameSet = false, popFileNameSet = false;
-    if ( argc < expectedMinArgNum ) {
-		cerr << message;
-		exit(-1);
-	}
-    // default or automatic values:
-    popFileHeader = false;  // default is NO header
-    numFormats = 1;         // default is same FORMAT for every SNP
-    OVERALL_DP_MIN_THRESHOLD = OVERALL_DP_MIN_THRESHOLD_DEFAULT;
+    // writes the summary rows of the SNPs in the batch, in VCF order, exactly as
+    // calculateSummaryStats() would have one SNP at a time
+    vector<int> offsets( numDesignations + 1, 0 );  // of each designation's counts in popCodeCounts
+    for ( int d = 0; d < numDesignations; d++ )
+        offsets[d + 1] = offsets[d] + batch.numRecords * designations[d].numPopulations * NUM_GT_CODES;
+    batch.popCodeCounts.resize( offsets[numDesignations] );
+    for ( int d = 0; d < numDesignations; d++ )
+        reduceGenotypeBatch( batch, designations[d].populationReference.data(), designations[d].numPopulations, batch.popCodeCounts.data() + offsets[d] );
+
+    for ( int r = 0; r < batch.numRecords; r++ ) {
+        char *fields[6];
+        for ( int i = 0; i < 6; i++ )
+            fields[i] = &batch.metaFields[r * 6 + i][0];
+        for ( int d = 0; d < numDesignations; d++ ) {
+            int numPopulations = designations[d].numPopulations;
+            int altAlleleCounts[numPopulations], validSampleCounts[numPopulations];
+            int *popCodeCounts = batch.popCodeCounts.data() + offsets[d] + r * numPopulations * NUM_GT_CODES;
+            int homoRefCount = 0, hetCount = 0, homoAltCount = 0;
+            ofstream& outputFile = designations[d].outputFile;
+            // the same totals as tallyGenotypes(), from the counts of each code:
+            for ( int p = 0; p < numPopulations; p++ ) {
+                int *codeCounts = popCodeCounts + p * NUM_GT_CODES;
+                altAlleleCounts[p] = validSampleCounts[p] = 0;
+                for ( int code = 0; code < NUM_GT_CODES; code++ ) {
+                    altAlleleCounts[p] += ALT_ALLELES_BY_GT_CODE[code] * codeCounts[code];
+                    validSampleCounts[p] += VALID_ALLELES_BY_GT_CODE[code] * codeCounts[code];
+                }
+                homoRefCount += codeCounts[ static_cast<int>( GT_CODE_HOMO_REF ) ];
+                hetCount += codeCounts[ static_cast<int>( GT_CODE_HET ) ];
+                homoAltCount += codeCounts[ static_cast<int>( GT_CODE_HOMO_ALT ) ];
+            }
+            if ( WRITE_SUMMARY_FILES ) {
+                if ( SPLIT_BY_CHROM )
+                    selectChromOutputFile( designations[d], fields[0], fields[1] );
+                outputFile << batch.lineNumbers[r];
+                for ( int i = 0; i < 6; i++ )
+                    outputFile << "\t" << fields[i];
+                outputFile << batch.INFOcolumns[r];
+                writeSummaryColumns( outputFile, batch.medianDPs[r], batch.medianGQs[r], homoRefCount, hetCount, homoAltCount, altAlleleCounts, validSampleCounts, numPopulations );
+                if ( HWE_TESTS )
+                    writeHWEcolumns( outputFile, popCodeCounts, numPopulations );
+                outputFile << endl;
+            }
+            if ( SFS_SIZE_ALL || !SFS_SIZES_BY_POP.empty() )
+                accumulateSFS( designations[d], altAlleleCounts, validSampleCounts );
+            if ( SNP_SUMMARY_CALLBACK )
+                reportSNPsummary( designations[d], d, batch.lineNumbers[r], fields[0], fields[1], fields[2], fields[3], fields[4], fields[5], batch.medianDPs[r], batch.medianGQs[r], homoRefCount, hetCount, homoAltCount, altAlleleCounts, validSampleCounts );
+        }
+    }
+    batch.numRecords = 0;
+}
 
-	// parse command line options:
+
+inline bool filterCompareNumber( FilterInstruction& instruction, double number )
+{
+    if ( isnan( number ) )
+        return false;   // missing values never pass a comparison
+    switch ( instruction.comparison ) {
+        case FILTER_CMP_LT: return number < instruction.value;
+        case FILTER_CMP_LE: return number <= instruction.value;
+        case FILTER_CMP_GT: return number > instruction.value;
+        case FILTER_CMP_GE: return number >= instruction.value;
+        case FILTER_CMP_EQ: return number == instruction.value;
+        case FILTER_CMP_NE: return number != instruction.value;
+    }
+    return false;
+}
+
+
+inline bool filterCompareText( FilterInstruction& instruction, const string& text )
+{
+    switch ( instruction.comparison ) {
+        case FILTER_CMP_EQ: return text == instruction.text;
+        case FILTER_CMP_NE: return text != instruction.text;
+        case FILTER_CMP_IN: return instruction.textSet.count( text ) > 0;
+    }
+    return false;
+}
+
+
+void filterExpressionError( string expression, string message )
+{
+    cerr << "\nError in --filter expression:\n\t" << expression << "\n\t" << message << "\n\tAborting ...\n\n";
+    abortRun(-1);
+}
+
+
+const double* getProjectionWeights( int n, int m, int k )
+{
+    // hypergeometric probabilities of drawing 0..m ALT alleles when m of n alleles,
+    // k of them ALT, are sampled without replacement.  There is one table per (n, m);
+    // its row for k is filled the first time it is needed
+    vector< vector<double> >& table = SFS_PROJECTION_TABLES[ make_pair( n, m ) ];
+    if ( table.empty() )
+        table.resize( n + 1 );
+    vector<double>& row = table[k];
+    if ( row.empty() ) {
+        row.assign( m + 1, 0.0 );
+        double logTotal = lgamma( n + 1.0 ) - lgamma( m + 1.0 ) - lgamma( n - m + 1.0 );
+        int lowest = ( m - ( n - k ) > 0 ) ? m - ( n - k ) : 0;
+        int highest = ( k < m ) ? k : m;
+        for ( int j = lowest; j <= highest; j++ ) {
+            row[j] = exp( lgamma( k + 1.0 ) - lgamma( j + 1.0 ) - lgamma( k - j + 1.0 )
+                          + lgamma( n - k + 1.0 ) - lgamma( m - j + 1.0 ) - lgamma( n - k - m + j + 1.0 ) - logTotal );
+        }
+    }
+    return &row[0];
+}
+
+
+string getBCFheaderValue( const string& line, string key )
+{
+    // the value of key in a structured header line like ##INFO=<ID=DP,Number=1,...>,
+    // or "" if it has none
+    size_t pos = line.find( '<' ), equals, valueEnd;
+    while ( pos != string::npos && pos + 1 < line.length() ) {
+        pos++;
+        equals = line.find( '=', pos );
+        if ( equals == string::npos )
+            break;
+        if ( equals + 1 < line.length() && line[equals + 1] == '"' ) {
+            // a quoted value (Description) may contain ',', '=' and \"
+            valueEnd = equals + 2;
+            while ( valueEnd < line.length() && line[valueEnd] != '"' )
+                valueEnd += ( line[valueEnd] == '\\' ) ? 2 : 1;
+            valueEnd = min( valueEnd + 1, line.length() );
+        } else {
+            valueEnd = min( line.find_first_of( ",>", equals ), line.length() );
+        }
+        if ( line.compare( pos, equals - pos, key ) == 0 )
+            return line.substr( equals + 1, valueEnd - equals - 1 );
+        pos = ( valueEnd < line.length() && line[valueEnd] == ',' ) ? valueEnd : string::npos;
+    }
+    return "";
+}
+
+
+inline int32_t getBCFint( const unsigned char* value, int type )
+{
+    // one little-endian integer of a BCF typed value; the missing and end-of-vector
+    // values of every width come back as BCF_INT_MISSING and BCF_INT_VECTOR_END
+    if ( type == BCF_TYPE_INT8 ) {
+        int8_t value8 = static_cast<int8_t>( value[0] );
+        return value8 == INT8_MIN ? BCF_INT_MISSING : ( value8 == INT8_MIN + 1 ? BCF_INT_VECTOR_END : value8 );
+    } else if ( type == BCF_TYPE_INT16 ) {
+        int16_t value16;
+        memcpy( &value16, value, sizeof( value16 ) );
+        return value16 == INT16_MIN ? BCF_INT_MISSING : ( value16 == INT16_MIN + 1 ? BCF_INT_VECTOR_END : value16 );
+    }
+    int32_t value32;
+    memcpy( &value32, value, sizeof( value32 ) );
+    return value32;
+}
+
+
+inline size_t getLength( char *myCharArray )
+{
+    size_t totalLength = 0;
+    
+    while ( myCharArray[totalLength] != '\0' ) {
+        totalLength++;
+    }
+    
+    return totalLength;
+}
+
+
+bool getSourceFileStats( string fname, unsigned long long& fileSize, long long& fileModTime )
+{
+    // size and modification time are what a genotype cache is validated against
+    struct stat fileInfo;
+    if ( stat( fname.c_str(), &fileInfo ) != 0 )
+        return false;
+    fileSize = static_cast<unsigned long long>( fileInfo.st_size );
+    fileModTime = static_cast<long long>( fileInfo.st_mtime );
+    return true;
+}
+
+
+inline unsigned int hashINFOkey( const char* key, size_t length, unsigned int seed )
+{
+    // FNV-1a, with the seed mixed into the starting value
+    unsigned int hash = 2166136261u ^ ( seed * 16777619u );
+    for ( size_t i = 0; i < length; i++ ) {
+        hash ^= static_cast<unsigned char>( key[i] );
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+int histogramMedian( const vector<int>& histogram, int position )
+{
+    // the value at position in the sorted values of a SAMPLE_HISTOGRAM_SIZE histogram
+    // of -1, 0, 1, ..., as calculateMedian() would find it
+    int count = 0;
+    for ( int i = 0; i < SAMPLE_HISTOGRAM_SIZE; i++ ) {
+        count += histogram[i];
+        if ( count > position )
+            return i - 1;
+    }
+    return SAMPLE_HISTOGRAM_SIZE - 2;
+}
+
+
+ServedCache* loadServedCache( map<string, ServedCache>& caches, string vcfName, unsigned long int requestNumber )
+{
+    // --serve: the genotype cache of vcfName in memory, read from disk the first time
+    // it is asked for or when it has been rebuilt since, or NULL if there is none or
+    // it doesn't fit in SERVE_MEMORY_BUDGET (the request then reads it from disk).
+    // The least recently used caches are dropped to make room
+    string cacheName = vcfName + GENOTYPE_CACHE_SUFFIX;
+    unsigned long long fileSize;
+    long long fileModTime;
+    map<string, ServedCache>::iterator it = caches.find( vcfName );
+    if ( !getSourceFileStats( cacheName, fileSize, fileModTime ) || fileSize > SERVE_MEMORY_BUDGET ) {
+        if ( it != caches.end() )
+            caches.erase( it );
+        return NULL;
+    }
+    if ( it != caches.end() && it->second.fileSize == fileSize && it->second.fileModTime == fileModTime ) {
+        it->second.lastUsed = requestNumber;
+        return &it->second;
+    }
+    if ( it != caches.end() )
+        caches.erase( it );
+
+    unsigned long long bytesHeld = 0;
+    for ( it = caches.begin(); it != caches.end(); it++ )
+        bytesHeld += it->second.bytes.size();
+    while ( bytesHeld + fileSize > SERVE_MEMORY_BUDGET ) {
+        map<string, ServedCache>::iterator oldest = caches.begin();
+        for ( it = caches.begin(); it != caches.end(); it++ ) {
+            if ( it->second.lastUsed < oldest->second.lastUsed )
+                oldest = it;
+        }
+        bytesHeld -= oldest->second.bytes.size();
+        if ( VERBOSE )
+            cout << "Dropped the genotype cache of " << oldest->first << " from memory\n";
+        caches.erase( oldest );
+    }
+
+    ifstream cacheFile( cacheName, ios_base::in | ios_base::binary );
+    ServedCache& served = caches[ vcfName ];
+    served.bytes.resize( fileSize );
+    cacheFile.read( &served.bytes[0], fileSize );
+    if ( static_cast<unsigned long long>( cacheFile.gcount() ) != fileSize ) {
+        caches.erase( vcfName );
+        return NULL;
+    }
+    served.fileSize = fileSize;
+    served.fileModTime = fileModTime;
+    served.lastUsed = requestNumber;
+    if ( VERBOSE )
+        cout << "Holding the genotype cache of " << vcfName << " in memory (" << fileSize / 1048576.0 << " MB)\n";
+    return &served;
+}
+
+
+const FormatPlan& lookUpFormatPlan( FormatPlanCache& formatPlans, const char* FORMAT, char formatDelim, int maxSubfieldsInFormat )
+{
+    // returns the plan for FORMAT, making it the first time FORMAT turns up; the
+    // warnings of errorCheckTokens() are thus given once per distinct FORMAT
+    formatPlans.key.assign( FORMAT );
+    unordered_map<string, FormatPlan>::iterator found = formatPlans.plans.find( formatPlans.key );
+    if ( found != formatPlans.plans.end() )
+        return found->second;
+
+    FormatPlan& plan = formatPlans.plans[ formatPlans.key ];
+    string token;
+    int subfieldCount = 0;
+    size_t pos = 0;
+    char nextChar = FORMAT[pos];
+    // every FORMAT starts without any of the subfields, so none carries over from another one:
+    plan.GTtoken = plan.DPtoken = plan.GQtoken = plan.PLtoken = -1;
+#ifdef DEBUG
+    cout << "** Parsing FORMAT **\n\tsubfieldcount\tpos\ttoken\n" << FORMAT << endl;
+#endif
+    // string splitting, with thanks to:
+    // https://stackoverflow.com/questions/14265581/parse-split-a-string-in-c-using-string-delimiter-standard-c
+    while ( nextChar != '\0' ) {
+        // get the next subfield:
+        subfieldCount++; // number of subfields processed
+        token.clear();
+        do {
+            token += nextChar; // build it char by char, however long the subfield name is
+            nextChar = FORMAT[++pos]; // get next char
+        } while ( nextChar != formatDelim && nextChar != '\0' );
+        // process subfield:
+        checkFormatToken( token, plan.GTtoken, plan.DPtoken, plan.GQtoken, plan.PLtoken, subfieldCount );
+
+        if ( nextChar != '\0' )
+            nextChar = FORMAT[++pos]; // get the next character past the delimiter
+    }
+    if ( !pos ) {
+        cerr << "\nError in lookUpFormatPlan():\n\tpos = 0 meaning FORMAT has length zero!\n\tFORMAT = " << FORMAT << endl;
+        abortRun(-1);
+    }
+    plan.numTokensInFormat = subfieldCount;
+    errorCheckTokens( plan.GTtoken, plan.DPtoken, plan.GQtoken, plan.PLtoken, plan.lookForDP, plan.lookForGQ, plan.lookForPL );
+    plan.formatOpsOrder.resize( subfieldCount );
+    determineFormatOpsOrder( plan.numTokensInFormat, plan.GTtoken, plan.DPtoken, plan.GQtoken, plan.PLtoken, plan.lookForDP, plan.lookForGQ, plan.lookForPL, formatDelim, plan.formatOpsOrder.data(), maxSubfieldsInFormat );
+#ifdef DEBUG
+    cout << "\t" << plan.numTokensInFormat << "\t\tlast\t" << FORMAT << endl;
+    cout << "GTtoken = " << plan.GTtoken << "; DPtoken = " << plan.DPtoken << "; GQtoken = " << plan.GQtoken << "; PLtoken = " << plan.PLtoken << "; lookForPL = " << plan.lookForPL << endl;
+#endif
+    return plan;
+}
+
+
+double lookUpHWEpvalue( int homoRefCount, int hetCount, int homoAltCount )
+{
+    // the same genotype counts turn up at many sites, so p-values are computed
+    // once: small samples come from the table filled by setUpHWEtable(), and
+    // larger ones are remembered the first time they are seen
+    int genotypes = homoRefCount + hetCount + homoAltCount;
+    if ( genotypes <= HWE_TABLE_MAX_SAMPLES ) {
+        return HWE_SMALL_TABLE[ ( homoRefCount * ( HWE_TABLE_MAX_SAMPLES + 1 ) + hetCount ) * ( HWE_TABLE_MAX_SAMPLES + 1 ) + homoAltCount ];
+    }
+    unsigned long long int key = ( static_cast<unsigned long long int>( homoRefCount ) << 42 ) | ( static_cast<unsigned long long int>( hetCount ) << 21 ) | static_cast<unsigned long long int>( homoAltCount );
+    unordered_map<unsigned long long int, double>::iterator it = HWE_PVALUE_MEMO.find( key );
+    if ( it != HWE_PVALUE_MEMO.end() )
+        return it->second;
+    double pValue = calculateHWEpvalue( homoRefCount, hetCount, homoAltCount );
+    HWE_PVALUE_MEMO[ key ] = pValue;
+    return pValue;
+}
+
+
+void mapSamplesToPopulations( string* sampleIDs, int numSamples, PopulationDesignation& designation, string source )
+{
+    // fills designation.populationReference, which maps each sample column to a population
+    const SampleTable& samples = designation.samples;
+    for ( int count = 0; count < numSamples; count++ ) {
+        int sample = samples.slots[ findSample( samples, sampleIDs[count].data(), sampleIDs[count].length() ) ];
+        // check to make sure sampleID is in the population file:
+        if ( sample < 0 ) {
+            cout << "\nError!  Sample header '" << sampleIDs[count] << "' from " << source << " not found in population file " << designation.popFileName << "!" << endl;
+            cout << "--> Please check that your population file designates\nsamples EXACTLY as they appear in the VCF." << endl;
+            cout << "\tAborting ... " << endl;
+            abortRun(-2);
+        }
+        // store popIndex in array that maps each column to a population:
+        designation.populationReference[ count ] = samples.popIndexes[ sample ];
+    }
+}
+
+
+MemoryBuffer::MemoryBuffer( const char* data, size_t length )
+{
+    // a streambuf only reads from its get area, so the bytes are never written
+    char *start = const_cast<char*>( data );
+    setg( start, start, start + length );
+}
+
+
+void mergeSampleChunkTallies( SampleThreadPool& pool, int designationIndex, int numPopulations, int altAlleleCounts[], int validSampleCounts[], int& homoRefCount, int& hetCount, int& homoAltCount, int* popCodeCounts )
+{
+    // the tallyGenotypes() results of the whole line, from those of its chunks
+    for ( int i = 0; i < numPopulations; i++ )
+        altAlleleCounts[i] = validSampleCounts[i] = 0;
+    if ( popCodeCounts ) {
+        for ( int i = 0; i < numPopulations * NUM_GT_CODES; i++ )
+            popCodeCounts[i] = 0;
+    }
+    homoRefCount = hetCount = homoAltCount = 0;
+    for ( size_t k = 0; k < pool.chunks.size(); k++ ) {
+        SampleChunk& chunk = pool.chunks[k];
+        if ( chunk.numSamples == 0 )
+            continue;
+        const int *counts = &chunk.popCounts[designationIndex][0];
+        for ( int i = 0; i < numPopulations; i++ ) {
+            altAlleleCounts[i] += counts[i];
+            validSampleCounts[i] += counts[ numPopulations + i ];
+        }
+        for ( int i = 0; i < numPopulations * NUM_GT_CODES && popCodeCounts; i++ )
+            popCodeCounts[i] += counts[ 2 * numPopulations + i ];
+        homoRefCount += chunk.homoRefCount;
+        hetCount += chunk.hetCount;
+        homoAltCount += chunk.homoAltCount;
+    }
+}
+
+
+double numericINFOvalue( INFOkeyTable& table, int key )
+{
+    // the value of key on the current line as a number, or nan if it is absent
+    // or not numeric (e.g. '.'); for lists such as AF=0.1,0.2 it is the first entry
+    const char *value = table.values[ key ];
+    char *endOfNumber;
+    if ( value == NULL || !table.valueLengths[ key ] )
+        return std::numeric_limits<double>::quiet_NaN();
+    double number = strtod( value, &endOfNumber );
+    if ( endOfNumber == value )
+        return std::numeric_limits<double>::quiet_NaN();
+    return number;
+}
+
+
+void openGenotypeCacheForWriting( ofstream& cacheFile, string vcfName, int numFormats, char formatDelim, int maxSubfieldsInFormat, int numSamples, string* sampleIDs, unsigned long int VCFfileLineCount )
+{
+    // the cache is written under a temporary name and only renamed into place
+    // by parseActualData() once every line has been written, so an interrupted
+    // run can never leave behind a cache that looks valid
+    string cacheName = vcfName + GENOTYPE_CACHE_SUFFIX + ".partial";
+    unsigned long long fileSize;
+    long long fileModTime;
+    uint32_t nameLength, numSamplesInCache = static_cast<uint32_t>( numSamples );
+    int32_t numFormatsInCache = numFormats, maxSubfieldsInCache = maxSubfieldsInFormat;
+    uint64_t headerLineNumber = static_cast<uint64_t>( VCFfileLineCount );
+
+    if ( !getSourceFileStats( vcfName, fileSize, fileModTime ) ) {
+        cout << "\nError in openGenotypeCacheForWriting():\n\tcould not stat " << vcfName << "\n\tAborting ... \n\n";
+        abortRun(-4);
+    }
+    cacheFile.open( cacheName, ios_base::out | ios_base::binary | ios_base::trunc );
+    if ( cacheFile.fail() ) {
+        cout << "\nError in openGenotypeCacheForWriting():\n\tcould not open " << cacheName << "\n\t--> Please make sure you have write access to the data file directory.\n\tAborting ... \n\n";
+        abortRun(-4);
+    }
+
+    // header: magic, source file size and mtime, FORMAT delimiter, -f and -S,
+    // line number of the #CHROM row, and the sample IDs in VCF column order
+    cacheFile.write( GENOTYPE_CACHE_MAGIC, sizeof( GENOTYPE_CACHE_MAGIC ) );
+    cacheFile.write( reinterpret_cast<char*>( &fileSize ), sizeof( fileSize ) );
+    cacheFile.write( reinterpret_cast<char*>( &fileModTime ), sizeof( fileModTime ) );
+    cacheFile.write( &formatDelim, sizeof( formatDelim ) );
+    cacheFile.write( reinterpret_cast<char*>( &numFormatsInCache ), sizeof( numFormatsInCache ) );
+    cacheFile.write( reinterpret_cast<char*>( &maxSubfieldsInCache ), sizeof( maxSubfieldsInCache ) );
+    cacheFile.write( reinterpret_cast<char*>( &headerLineNumber ), sizeof( headerLineNumber ) );
+    cacheFile.write( reinterpret_cast<char*>( &numSamplesInCache ), sizeof( numSamplesInCache ) );
+    for ( int i = 0; i < numSamples; i++ ) {
+        nameLength = static_cast<uint32_t>( sampleIDs[i].length() );
+        cacheFile.write( reinterpret_cast<char*>( &nameLength ), sizeof( nameLength ) );
+        cacheFile.write( sampleIDs[i].data(), nameLength );
+    }
+}
+
+
+void openLineReader( VCFlineReader& reader, istream& source, unsigned long long offset, size_t blockSize )
+{
+    // source must already be past the header lines; offset is where it stands in
+    // the uncompressed VCF, so that checkpoints can record line positions.  blockSize
+    // is how much is read at a time (it grows for a longer line)
+    reader.source = &source;
+    reader.blockOffset = offset;
+    reader.blockSize = blockSize;
+    reader.block = new char[reader.blockSize];
+    reader.start = reader.scanned = reader.end = 0;
+    reader.sourceDone = false;
+}
+
+
+shared_ptr<ReadAheadState> openReadAhead( string vcfName, unsigned long long offset )
+{
+    // opens vcfName for --read-ahead and starts reading it from offset on
+    shared_ptr<ReadAheadState> state = make_shared<ReadAheadState>();
+    struct stat fileInfo;
+    state->fd = open( vcfName.c_str(), O_RDONLY );
+    if ( state->fd < 0 || fstat( state->fd, &fileInfo ) != 0 ) {
+        cout << "\nError in openReadAhead():\n\tcould not open " << vcfName << ": " << strerror( errno ) << "\n\tAborting ... \n\n";
+        abortRun(-4);
+    }
+    state->fileSize = static_cast<unsigned long long>( fileInfo.st_size );
+    state->nextOffset = offset;
+    state->depth = READ_AHEAD_DEPTH;
+    state->buffers.resize( state->depth, vector<char>( READ_AHEAD_BUFFER_SIZE ) );
+    state->bufferLengths.resize( state->depth );
+    state->bufferFilled.resize( state->depth );
+    state->bufferOffsets.resize( state->depth );
+    state->bufferStates.assign( state->depth, READ_AHEAD_FREE );
+    state->startTimes.resize( state->depth );
+    state->current = 0;
+    state->handedOut = 0;
+    state->readError = 0;
+
+    if ( setUpIOuring( state.get() ) ) {
+        for ( int b = 0; b < state->depth; b++ )
+            submitReadAhead( state.get(), b );
+    } else {
+        state->prefetchThread = thread( prefetchWithPread, state.get() );
+    }
+    if ( VERBOSE ) {
+        cout << "\nReading " << vcfName << " with up to " << state->depth << " reads of " << ( READ_AHEAD_BUFFER_SIZE >> 20 ) << " MiB ahead, using ";
+        if ( state->ringFd >= 0 )
+            cout << "io_uring" << ( state->fixedBuffers ? " with registered buffers\n" : "\n" );
+        else
+            cout << "pread() in a prefetch thread\n";
+    }
+    return state;
+}
+
+
+unsigned long long openVCFatCheckpoint( boost::iostreams::filtering_streambuf<boost::iostreams::input>& myVCFin, string vcfName, ifstream& vcfUnfiltered, Checkpoint& checkpoint )
+{
+    // sets up myVCFin like createVCFfilter() does, but as close to the checkpoint's
+    // next line as the file allows, and returns the number of bytes the caller still
+    // has to skip: none for an uncompressed VCF, which is seeked directly, the offset
+    // within the block for BGZF, and the whole offset for other compressed files,
+    // which can only be decompressed from the start
+    using namespace boost::iostreams;
+    string filext = vcfName.substr( vcfName.find_last_of( "." ) );
+    if ( filext == ".vcf" || ( filext == ".gz" && checkpoint.virtualOffset >= 0 ) ) {
+        unsigned long long fileOffset = ( filext == ".vcf" ) ? checkpoint.inputOffset : static_cast<unsigned long long>( checkpoint.virtualOffset >> 16 );
+        if ( filext == ".gz" )
+            myVCFin.push( gzip_decompressor() );
+        if ( READ_AHEAD_DEPTH > 0 ) {
+            ReadAheadSource source = { openReadAhead( vcfName, fileOffset ) };
+            myVCFin.push( source );
+        } else {
+            vcfUnfiltered.open( vcfName, ios_base::in | ios_base::binary );
+            vcfUnfiltered.seekg( static_cast<streamoff>( fileOffset ) );
+            if ( !vcfUnfiltered.good() ) {
+                cout << "\nError in openVCFatCheckpoint():\n\tcould not seek to the checkpoint in " << vcfName << "\n\tAborting ... \n\n";
+                abortRun(-4);
+            }
+            myVCFin.push( vcfUnfiltered );
+        }
+        return filext == ".vcf" ? 0 : static_cast<unsigned long long>( checkpoint.virtualOffset & 0xFFFF );
+    }
+    createVCFfilter( myVCFin, vcfName, vcfUnfiltered );
+    return checkpoint.inputOffset;
+}
+
+
+CPU_DISPATCH void packLDgenotypes( char* genotypeCodes, int numSamples, uint64_t* planes, int numWords )
+{
+    // fills the three bit-planes of one SNP (see LDwindow); half calls count as not called
+    uint64_t *called = planes, *alt = planes + numWords, *homoAlt = planes + 2 * numWords;
+    for ( int w = 0; w < 3 * numWords; w++ )
+        planes[w] = 0;
+    for ( int i = 0; i < numSamples; i++ ) {
+        uint64_t bit = static_cast<uint64_t>( 1 ) << ( i & 63 );
+        char code = genotypeCodes[i];
+        if ( code == GT_CODE_HOMO_REF ) {
+            called[ i >> 6 ] |= bit;
+        } else if ( code == GT_CODE_HET ) {
+            called[ i >> 6 ] |= bit;
+            alt[ i >> 6 ] |= bit;
+        } else if ( code == GT_CODE_HOMO_ALT ) {
+            called[ i >> 6 ] |= bit;
+            alt[ i >> 6 ] |= bit;
+            homoAlt[ i >> 6 ] |= bit;
+        }
+    }
+}
+
+
+void parseActualData(istream& VCFfile, int numFormats, char formatDelim, int maxSubfieldsInFormat, unsigned long int& VCFfileLineCount, int numSamples, PopulationDesignation* designations, int numDesignations, string* sampleIDs, string vcfName, Checkpoint* resumeFrom, BCFreader* BCF )
+{
+    // resumeFrom is NULL, except with --resume, when VCFfile starts at its next line;
+    // BCF is NULL, except for a .bcf, whose records it reads instead of VCF lines
+    // the buffers are arrays and vectors, so that they are also freed when abortRun()
+    // throws in the library build
+    char CHROM[MAX_BUFFER_SIZE], POS[MAX_BUFFER_SIZE], ID[MAX_BUFFER_SIZE], REF[MAX_BUFFER_SIZE], ALT[MAX_BUFFER_SIZE], QUAL[MAX_BUFFER_SIZE], FILTER[MAX_BUFFER_SIZE];
+    //double QUAL;
+    long int dumCol, SNPcount = 0;
+    VCFlineReader lineReader;
+    char *line, *cursor;
+    size_t lineLength;
+    bool keepThis, checkFormat = true, lookForDP, lookForGQ, lookForPL, isBiallelicSNP;
+    bool lookForDPinINFO = true; // stays false once a line without INFO DP has been seen
+    double DPval;
+    int numTokensInFormat, GTtoken = -1, DPtoken = -1, GQtoken = -1, PLtoken = -1;
+	string discardedLinesFileName = ( WORKER_OUTPUT_BASE.empty() ? vcfName : WORKER_OUTPUT_BASE ) + "_discardedLineNums.txt";
+	ofstream discardedLinesFile;
+    Checkpoint checkpoint;
+    ifstream BGZFfile;  // read only for the block headers; see findBGZFvirtualOffset()
+    unsigned long long BGZFblockStart = 0, BGZFblockDataStart = 0;
+    ofstream cacheFile;
+    ofstream *cacheFilePtr = NULL; // stays NULL unless --build-cache was given
+    SampleStats sampleStats;
+    SampleStats *sampleStatsPtr = NULL; // stays NULL unless --sample-stats was given
+    LDwindow LD;
+    LDwindow *LDptr = NULL; // stays NULL unless --ld-snps or --ld-bp was given
+    PlinkExport plink;
+    PlinkExport *plinkPtr = NULL; // stays NULL unless --export-plink was given
+    GenotypeBatch batch;
+    GenotypeBatch *batchPtr = NULL; // stays NULL unless --record-batch was given
+    SampleThreadPool sampleThreads;
+    SampleThreadPool *sampleThreadsPtr = NULL;  // stays NULL unless --sample-threads splits the lines
+    // string oneLine; // old way using linestream
+    // the latter ints are for parsing GT = genotype, DP = depth,
+    // and GQ = quality sub-fields of the FORMAT column
+    int formatOpsOrder[maxSubfieldsInFormat]; // for keeping track of how to parse FORMAT efficiently
+    FormatPlanCache formatPlans;    // one plan per distinct FORMAT; see lookUpFormatPlan()
+    // per-sample work arrays reused for every SNP:
+    vector<char> codesOfLine( numSamples );
+    vector<int> DPofLine( numSamples ), GQofLine( numSamples );
+    char *genotypeCodes = codesOfLine.data();
+    int *DPvalues = DPofLine.data(), *GQvalues = GQofLine.data();
+
+    if ( BUILD_CACHE ) {
+        openGenotypeCacheForWriting( cacheFile, vcfName, numFormats, formatDelim, maxSubfieldsInFormat, numSamples, sampleIDs, VCFfileLineCount );
+        cacheFilePtr = &cacheFile;
+    }
+    if ( SAMPLE_STATS ) {
+        setUpSampleStats( sampleStats, numSamples );
+        sampleStatsPtr = &sampleStats;
+    }
+    if ( LD_WINDOW_SNPS || LD_WINDOW_BP ) {
+        setUpLD( LD, numSamples, designations, numDesignations );
+        LDptr = &LD;
+    }
+    if ( !PLINK_PREFIX.empty() ) {
+        setUpPlinkExport( plink, numSamples, sampleIDs, designations[0] );
+        plinkPtr = &plink;
+    }
+    if ( GENOTYPE_BATCH_RECORDS ) {
+        setUpGenotypeBatch( batch, numSamples );
+        batchPtr = &batch;
+    }
+    if ( SAMPLE_THREADS > 1 && !BCF ) {
+        setUpSampleThreads( sampleThreads, numSamples, designations, numDesignations );
+        if ( !sampleThreads.workers.empty() )
+            sampleThreadsPtr = &sampleThreads;
+    }
+
+    if ( resumeFrom ) {
+        // readCheckpoint() has truncated the outputs to match:
+        checkpoint = *resumeFrom;
+        VCFfileLineCount = checkpoint.VCFfileLineCount;
+        SNPcount = checkpoint.SNPcount;
+        checkFormat = checkpoint.checkFormat;
+        lookForDP = checkpoint.lookForDP;
+        lookForGQ = checkpoint.lookForGQ;
+        lookForPL = checkpoint.lookForPL;
+        lookForDPinINFO = checkpoint.lookForDPinINFO;
+        numTokensInFormat = checkpoint.numTokensInFormat;
+        GTtoken = checkpoint.GTtoken;
+        DPtoken = checkpoint.DPtoken;
+        GQtoken = checkpoint.GQtoken;
+        PLtoken = checkpoint.PLtoken;
+        for ( size_t i = 0; i < checkpoint.formatOpsOrder.size() && static_cast<int>( i ) < maxSubfieldsInFormat; i++ )
+            formatOpsOrder[i] = checkpoint.formatOpsOrder[i];
+        if ( checkpoint.virtualOffset >= 0 ) {
+            BGZFblockStart = static_cast<unsigned long long>( checkpoint.virtualOffset ) >> 16;
+            BGZFblockDataStart = checkpoint.inputOffset - ( checkpoint.virtualOffset & 0xFFFF );
+        }
+        discardedLinesFile.open( discardedLinesFileName, ostream::app );
+    } else {
+        if ( CHECKPOINT_INTERVAL ) {
+            checkpoint.dataStart = checkpoint.inputOffset = countVCFheaderBytes( vcfName );
+        }
+        discardedLinesFile.open( discardedLinesFileName, ostream::out );
+        discardedLinesFile << "VCFfileLinesNotUsed" << endl; // header row
+    }
+    if ( CHECKPOINT_INTERVAL && vcfName.substr( vcfName.find_last_of( "." ) ) == ".gz" ) {
+        BGZFfile.open( vcfName, ios_base::in | ios_base::binary );
+    }
+
+    // work line by line:
+    // stringstream lineStream( "", ios_base::in | ios_base::out ); old way
+    // used to be while( getline ... ), then get()/putback() on the stream
+    if ( !BCF )
+        openLineReader( lineReader, VCFfile, resumeFrom || CHECKPOINT_INTERVAL ? checkpoint.inputOffset : 0, LINE_READER_BLOCK_SIZE );
+    while ( BCF ? readBCFrecord( *BCF, line, formatDelim, numSamples ) : readVCFline( lineReader, line, lineLength ) ) {
+        cursor = line;
+        SNPcount++; // counter of how many SNP lines have been processed
+        VCFfileLineCount++; // counter of how many LINES of VCF file have been processed
+
+        // turn each line into a string stream for easy parsing by whitespace:
+        // lineStream.clear();
+        // lineStream.str( oneLine );
+
+        // work with meta-col data:
+        keepThis = parseMetaColData( cursor, SNPcount, checkFormat, formatPlans, maxSubfieldsInFormat, formatOpsOrder, numTokensInFormat, GTtoken, DPtoken, GQtoken, PLtoken, lookForDP, lookForGQ, lookForPL, lookForDPinINFO, formatDelim, CHROM, POS, ID, REF, ALT, QUAL, FILTER, DPval, isBiallelicSNP );
+
+        if ( BUILD_CACHE ) {
+            // every line gets a cache record so that later runs can apply their own
+            // DP threshold; genotypes are only stored for biallelic SNPs
+            writeCacheSiteData( cacheFile, isBiallelicSNP, lookForDP, lookForGQ, DPval, CHROM, POS, ID, REF, ALT, QUAL );
+        }
+
+        if ( keepThis || (BUILD_CACHE && isBiallelicSNP) ) {
+            // it is a biallelic SNP; lines that failed the DP threshold or a site
+            // filter are only decoded when the cache needs them
+            // let's calculate and store data for one line, i.e., one SNP at a time:
+            if ( sampleThreadsPtr )
+                sampleThreads.lineEnd = line + lineLength;
+            keepThis = calculateSummaryStats( BCF ? NULL : cursor, keepThis, numTokensInFormat, lookForDP, lookForGQ, lookForPL, formatDelim, formatOpsOrder, numSamples, designations, numDesignations, VCFfileLineCount, CHROM, POS, ID, REF, ALT, QUAL, FILTER, batchPtr ? batch.genotypeCodes.data() + static_cast<size_t>( batch.numRecords ) * numSamples : genotypeCodes, DPvalues, GQvalues, cacheFilePtr, sampleStatsPtr, LDptr, plinkPtr, batchPtr, sampleThreadsPtr, BCF );
+        }
+        if ( !keepThis ) {
+			discardedLinesFile << VCFfileLineCount << endl;
+		}
+
+
+        if ( numFormats == 1 ) {
+            checkFormat = false; // not needed after first SNP
+        }
+
+        if ( CHECKPOINT_INTERVAL && static_cast<unsigned long int>( SNPcount ) % CHECKPOINT_INTERVAL == 0 ) {
+            checkpoint.inputOffset = lineReader.blockOffset + lineReader.start;
+            checkpoint.virtualOffset = BGZFfile.is_open() ? findBGZFvirtualOffset( BGZFfile, BGZFblockStart, BGZFblockDataStart, checkpoint.inputOffset ) : -1;
+            checkpoint.VCFfileLineCount = VCFfileLineCount;
+            checkpoint.SNPcount = SNPcount;
+            checkpoint.checkFormat = checkFormat;
+            checkpoint.lookForDP = lookForDP;
+            checkpoint.lookForGQ = lookForGQ;
+            checkpoint.lookForPL = lookForPL;
+            checkpoint.lookForDPinINFO = lookForDPinINFO;
+            checkpoint.numTokensInFormat = numTokensInFormat;
+            checkpoint.GTtoken = GTtoken;
+            checkpoint.DPtoken = DPtoken;
+            checkpoint.GQtoken = GQtoken;
+            checkpoint.PLtoken = PLtoken;
+            checkpoint.formatOpsOrder.assign( formatOpsOrder, formatOpsOrder + numTokensInFormat ); // only these are filled in
+            if ( batchPtr )
+                flushGenotypeBatch( batch, designations, numDesignations );    // the checkpoint covers every line read
+            writeCheckpoint( checkpoint, vcfName, designations, numDesignations, discardedLinesFile );
+        }
+//        if ( SNPcount == 2 )
+//            exit(0);
+    }
+
+    if ( !BCF )
+        closeLineReader( lineReader );
+    if ( batchPtr )
+        finishGenotypeBatch( batch, designations, numDesignations );
+    discardedLinesFile.close();
+    if ( CHECKPOINT_INTERVAL || resumeFrom ) {
+        // the run is complete, so there is nothing left to resume:
+        remove( ( vcfName + CHECKPOINT_SUFFIX ).c_str() );
+    }
+    if ( BUILD_CACHE ) {
+        cacheFile.close();
+        string cacheName = vcfName + GENOTYPE_CACHE_SUFFIX;
+        if ( cacheFile.fail() || rename( (cacheName + ".partial").c_str(), cacheName.c_str() ) != 0 ) {
+            cout << "\nError in parseActualData():\n\tcould not finish writing genotype cache " << cacheName << "\n\tAborting ... \n\n";
+            abortRun(-4);
+        }
+        cout << "\nGenotype cache written to " << cacheName << endl;
+    }
+    if ( SAMPLE_STATS ) {
+        writeSampleSummary( sampleStats, sampleIDs, vcfName + "_SampleSummary.tsv" );
+    }
+    if ( LDptr ) {
+        finishLD( LD, designations, numDesignations );
+    }
+    if ( plinkPtr ) {
+        finishPlinkExport( plink );
+    }
+}
+
+
+void parseCommandLineInput(int argc, char *argv[], bool& popFileHeader, int& numSamples, int& numFields, int& numFormats, char& formatDelim, int& maxSubfieldsInFormat, string& vcfName, vector<PopulationDesignation>& designations, int& numDesignations )
+{
+	const int expectedMinArgNum = 4;
+	string progname = argv[0];
+    string* uniquePopulationNames;
+    bool serving = false;   // --serve needs neither -V nor -P
+    for ( int i = 1; i < argc; i++ ) {
+        if ( strcmp( argv[i], "--serve" ) == 0 || strncmp( argv[i], "--serve=", 8 ) == 0 )
+            serving = true;
+        if ( strcmp( argv[i], "--print-cpu-path" ) == 0 ) {
+            printCPUpath();
+            abortRun( 0 );  // nothing else is run
+        }
+    }
+	string message = "\nError!  Please supply two file names as command line arguments,\n\tin the following way (note flags -V and -P):\n\t" + progname + " -V NameOfVCFfile -P NameOfPopulationFile\n\n";
+    bool numFormatsSet = false, vcfNameSet = false;
+    vector<string> popFileNames; // -P may be given more than once
+    vector<string> vcfNames;     // and so may -V
+    string vcfListName;
+    if ( argc < expectedMinArgNum && !serving ) {
+		cerr << message;
+		abortRun(-1);
+	}
+    // default or automatic values (all of them, since the library can run more than once):
+    popFileHeader = false;  // default is NO header
+    numFormats = 1;         // default is same FORMAT for every SNP
+    OVERALL_DP_MIN_THRESHOLD = OVERALL_DP_MIN_THRESHOLD_DEFAULT;
+    VERBOSE = BUILD_CACHE = IGNORE_CACHE = SAMPLE_STATS = HWE_TESTS = SPLIT_BY_CHROM = RESUME = false;
+    SITE_FILTERS.clear();
+    GENOTYPE_FILTERS.clear();
+    INFO_KEYS = INFOkeyTable();
+    INFO_OUTPUT_COLS.clear();
+    LD_WINDOW_SNPS = 0;
+    LD_WINDOW_BP = LD_BIN_WIDTH = 0;
+    SFS_SIZE_ALL = 0;
+    SFS_SIZES_BY_POP.clear();
+    CHECKPOINT_INTERVAL = 0;
+    READ_AHEAD_DEPTH = 0;
+    READ_THROTTLE_MS = 0;
+    PREVIEW_POINTS = 0;
+    PLINK_PREFIX.clear();
+    GENOTYPE_BATCH_RECORDS = 0;
+    SAMPLE_THREADS = 0;
+    SERVE_SOCKET.clear();
+    SERVE_MEMORY_BUDGET = 1024ULL << 20;
+    BUILD_INDEX = false;
+    RECORD_INDEX_INTERVAL = 65536;
+    MIN_GT_DP = MIN_GT_GQ = 0;
+    MAX_GT_DP = INT_MAX;
+    VCF_FILE_NAMES.clear();
+    FIRST_VCF_SAMPLE_IDS.clear();
+    WORKER_OUTPUT_BASE.clear();
+    NUM_JOBS = 0;
+    COMMAND_LINE.clear();
+    optind = 0; // makes getopt_long() start over
+    INFO_KEY_DP = addINFOkey( "DP" ); // --filter and --info-cols add their keys after it
+
+	// parse command line options; long-only options get codes outside the char range:
 	int flag;
-    while ((flag = getopt(argc, argv, "V:P:Hf:D:S:vd:")) != -1) {
+    enum { BUILD_CACHE_OPT = 1000, NO_CACHE_OPT, FILTER_OPT, INFO_COLS_OPT, SAMPLE_STATS_OPT, HWE_OPT, LD_SNPS_OPT, LD_BP_OPT, LD_BIN_OPT, SFS_OPT, SPLIT_BY_CHROM_OPT, CHECKPOINT_OPT, RESUME_OPT, READ_AHEAD_OPT, READ_THROTTLE_OPT, PREVIEW_OPT, MIN_GT_DP_OPT, MAX_GT_DP_OPT, MIN_GT_GQ_OPT, VCF_LIST_OPT, JOBS_OPT, BUILD_INDEX_OPT, INDEX_INTERVAL_OPT, EXPORT_PLINK_OPT, RECORD_BATCH_OPT, SAMPLE_THREADS_OPT, SERVE_OPT, SERVE_MEMORY_OPT };
+    static struct option longOptions[] = {
+        { "build-cache", no_argument, NULL, BUILD_CACHE_OPT },
+        { "no-cache", no_argument, NULL, NO_CACHE_OPT },
+        { "filter", required_argument, NULL, FILTER_OPT },
+        { "info-cols", required_argument, NULL, INFO_COLS_OPT },
+        { "sample-stats", no_argument, NULL, SAMPLE_STATS_OPT },
+        { "hwe", no_argument, NULL, HWE_OPT },
+        { "ld-snps", required_argument, NULL, LD_SNPS_OPT },
+        { "ld-bp", required_argument, NULL, LD_BP_OPT },
+        { "ld-bin", required_argument, NULL, LD_BIN_OPT },
+        { "sfs", required_argument, NULL, SFS_OPT },
+        { "split-by-chrom", no_argument, NULL, SPLIT_BY_CHROM_OPT },
+        { "checkpoint", required_argument, NULL, CHECKPOINT_OPT },
+        { "resume", no_argument, NULL, RESUME_OPT },
+        { "read-ahead", required_argument, NULL, READ_AHEAD_OPT },
+        { "read-throttle", required_argument, NULL, READ_THROTTLE_OPT },
+        { "preview", required_argument, NULL, PREVIEW_OPT },
+        { "min-gt-dp", required_argument, NULL, MIN_GT_DP_OPT },
+        { "max-gt-dp", required_argument, NULL, MAX_GT_DP_OPT },
+        { "min-gt-gq", required_argument, NULL, MIN_GT_GQ_OPT },
+        { "vcf-list", required_argument, NULL, VCF_LIST_OPT },
+        { "jobs", required_argument, NULL, JOBS_OPT },
+        { "build-index", no_argument, NULL, BUILD_INDEX_OPT },
+        { "index-interval", required_argument, NULL, INDEX_INTERVAL_OPT },
+        { "export-plink", required_argument, NULL, EXPORT_PLINK_OPT },
+        { "record-batch", required_argument, NULL, RECORD_BATCH_OPT },
+        { "sample-threads", required_argument, NULL, SAMPLE_THREADS_OPT },
+        { "serve", required_argument, NULL, SERVE_OPT },
+        { "serve-memory", required_argument, NULL, SERVE_MEMORY_OPT },
+        { NULL, 0, NULL, 0 }
+    };
+    // a checkpoint only applies to the same command; getopt_long() may reorder argv, so record it first:
+    for ( int i = 1; i < argc; i++ ) {
+        if ( strcmp( argv[i], "--resume" ) != 0 )
+            COMMAND_LINE += ( COMMAND_LINE.empty() ? "" : " " ) + string( argv[i] );
+    }
+    while ((flag = getopt_long(argc, argv, "V:P:Hf:D:S:vd:", longOptions, NULL)) != -1) {
 		switch (flag) {
 			case 'V':
-				vcfName = optarg;
+				vcfNames.push_back( optarg );
                 vcfNameSet = true;
 				break;
+            case VCF_LIST_OPT: {
+                // one VCF per line; blank lines and lines starting with '#' are skipped
+                ifstream vcfList( optarg );
+                string listLine;
+                if ( !vcfList.is_open() ) {
+                    cout << "\nError in parseCommandLineInput():\n\tVCF list '" << optarg << "' not found!\n\t--> Check spelling and path.\n\tExiting ... \n\n";
+                    abortRun( -1 );
+                }
+                while ( getline( vcfList, listLine ) ) {
+                    listLine.erase( listLine.find_last_not_of( " \t\r" ) + 1 );
+                    if ( !listLine.empty() && listLine[0] != '#' )
+                        vcfNames.push_back( listLine );
+                }
+                vcfListName = optarg;
+                vcfNameSet = true;
+                break;
+            }
+            case RECORD_BATCH_OPT:
+                GENOTYPE_BATCH_RECORDS = atoi( optarg );
+                if ( GENOTYPE_BATCH_RECORDS < 1 ) {
+                    cout << "\nError in parseCommandLineInput():\n\t--record-batch needs a number of SNPs of at least 1, not " << optarg << "\n\tExiting ... \n\n";
+                    abortRun( -1 );
+                }
+                break;
+            case SAMPLE_THREADS_OPT:
+                SAMPLE_THREADS = atoi( optarg );
+                if ( SAMPLE_THREADS < 1 ) {
+                    cout << "\nError in parseCommandLineInput():\n\t--sample-threads needs a number of threads of at least 1, not " << optarg << "\n\tExiting ... \n\n";
+                    abortRun( -1 );
+                }
+                break;
+            case SERVE_OPT:
+                SERVE_SOCKET = optarg;
+                break;
+            case SERVE_MEMORY_OPT:
+                if ( atoi( optarg ) < 0 ) {
+                    cout << "\nError in parseCommandLineInput():\n\t--serve-memory needs a number of MB of at least 0, not " << optarg << "\n\tExiting ... \n\n";
+                    abortRun( -1 );
+                }
+                SERVE_MEMORY_BUDGET = static_cast<unsigned long long>( atoi( optarg ) ) << 20;
+                break;
+            case EXPORT_PLINK_OPT:
+                PLINK_PREFIX = optarg;
+                break;
+            case BUILD_INDEX_OPT:
+                BUILD_INDEX = true;
+                break;
+            case INDEX_INTERVAL_OPT:
+                if ( atol( optarg ) < 1 ) {
+                    cout << "\nError in parseCommandLineInput():\n\t--index-interval needs a number of lines of at least 1, not " << optarg << "\n\tExiting ... \n\n";
+                    abortRun( -1 );
+                }
+                RECORD_INDEX_INTERVAL = static_cast<unsigned long int>( atol( optarg ) );
+                break;
+            case JOBS_OPT:
+                NUM_JOBS = atoi( optarg );
+                if ( NUM_JOBS < 1 ) {
+                    cout << "\nError in parseCommandLineInput():\n\t--jobs needs a number of VCFs of at least 1, not " << optarg << "\n\tExiting ... \n\n";
+                    abortRun( -1 );
+                }
+                break;
 			case 'P':
-				popFileName = optarg;
-                popFileNameSet = true;
+				popFileNames.push_back( optarg );
 				break;
 			case 'H':
 				popFileHeader = true;
@@ -861,387 +2650,3086 @@ void parseCommandLineInput(int argc, char *argv[], ifstream& PopulationFile, boo
             case 'd':
                 OVERALL_DP_MIN_THRESHOLD = stod(optarg);
                 break;
-            default: /* '?' */
-				exit(-1);
-		}
-	}
-
-    if ( !popFileNameSet || !vcfNameSet ) {
-        cerr << message;
-        exit(-1);
-    }
-    
-    cout << "\nOVERALL_DP_MIN_THRESHOLD is " << OVERALL_DP_MIN_THRESHOLD << endl;
-
-    parsePopulationDesigFile( popFileName, numSamples, numPopulations, mapOfPopulations, popFileHeader );
-
-    numFields = NUM_META_COLS + numSamples;
-
+            case BUILD_CACHE_OPT:
+                BUILD_CACHE = true;
+                break;
+            case NO_CACHE_OPT:
+                IGNORE_CACHE = true;
+                break;
+            case FILTER_OPT:
+                compileFilterExpression( optarg ); // several --filter options must all hold
+                break;
+            case SAMPLE_STATS_OPT:
+                SAMPLE_STATS = true;
+                break;
+            case HWE_OPT:
+                HWE_TESTS = true;
+                break;
+            case SPLIT_BY_CHROM_OPT:
+                SPLIT_BY_CHROM = true;
+                break;
+            case CHECKPOINT_OPT:
+                if ( atol( optarg ) < 1 ) {
+                    cout << "\nError in parseCommandLineInput():\n\t--checkpoint needs a number of lines of at least 1, not " << optarg << "\n\tExiting ... \n\n";
+                    abortRun( -1 );
+                }
+                CHECKPOINT_INTERVAL = static_cast<unsigned long int>( atol( optarg ) );
+                break;
+            case RESUME_OPT:
+                RESUME = true;
+                break;
+            case READ_AHEAD_OPT:
+                READ_AHEAD_DEPTH = atoi( optarg );
+                if ( READ_AHEAD_DEPTH < 1 || READ_AHEAD_DEPTH > READ_AHEAD_MAX_DEPTH ) {
+                    cout << "\nError in parseCommandLineInput():\n\t--read-ahead needs a number of reads from 1 to " << READ_AHEAD_MAX_DEPTH << ", not " << optarg << "\n\tExiting ... \n\n";
+                    abortRun( -1 );
+                }
+                break;
+            case MIN_GT_DP_OPT:
+                MIN_GT_DP = atoi( optarg );
+                break;
+            case MAX_GT_DP_OPT:
+                MAX_GT_DP = atoi( optarg );
+                break;
+            case MIN_GT_GQ_OPT:
+                MIN_GT_GQ = atoi( optarg );
+                break;
+            case PREVIEW_OPT:
+                PREVIEW_POINTS = atoi( optarg );
+                if ( PREVIEW_POINTS < 1 ) {
+                    cout << "\nError in parseCommandLineInput():\n\t--preview needs a number of places of at least 1, not " << optarg << "\n\tExiting ... \n\n";
+                    abortRun( -1 );
+                }
+                break;
+            case READ_THROTTLE_OPT:
+                READ_THROTTLE_MS = atol( optarg );
+                if ( READ_THROTTLE_MS < 1 ) {
+                    cout << "\nError in parseCommandLineInput():\n\t--read-throttle needs a number of milliseconds of at least 1, not " << optarg << "\n\tExiting ... \n\n";
+                    abortRun( -1 );
+                }
+                break;
+            case LD_SNPS_OPT:
+                LD_WINDOW_SNPS = stoi(optarg);
+                break;
+            case LD_BP_OPT:
+                LD_WINDOW_BP = stol(optarg);
+                break;
+            case LD_BIN_OPT:
+                LD_BIN_WIDTH = stol(optarg);
+                break;
+            case SFS_OPT: {
+                // either one projection size for all populations, or pop=size,pop=size,...
+                string spec = optarg, entry;
+                size_t start = 0, comma, equals;
+                if ( spec.find( '=' ) == string::npos ) {
+                    SFS_SIZE_ALL = atoi( spec.c_str() );
+                    if ( SFS_SIZE_ALL < 1 ) {
+                        cout << "\nError in parseCommandLineInput():\n\t--sfs needs a projection size of at least 1, not " << spec << "\n\tExiting ... \n\n";
+                        abortRun( -1 );
+                    }
+                    break;
+                }
+                do {
+                    comma = spec.find( ',', start );
+                    entry = spec.substr( start, comma == string::npos ? string::npos : comma - start );
+                    equals = entry.find( '=' );
+                    if ( equals == string::npos || equals == 0 || atoi( entry.c_str() + equals + 1 ) < 1 ) {
+                        cout << "\nError in parseCommandLineInput():\n\tcould not read '" << entry << "' in --sfs " << spec << " (expected pop=size)\n\tExiting ... \n\n";
+                        abortRun( -1 );
+                    }
+                    SFS_SIZES_BY_POP[ entry.substr( 0, equals ) ] = atoi( entry.c_str() + equals + 1 );
+                    start = comma + 1;
+                } while ( comma != string::npos );
+                break;
+            }
+            case INFO_COLS_OPT: {
+                // comma-separated INFO keys, e.g. AF,MQ,DP
+                string keyList = optarg, key;
+                size_t start = 0, comma;
+                do {
+                    comma = keyList.find( ',', start );
+                    key = keyList.substr( start, comma == string::npos ? string::npos : comma - start );
+                    if ( key.empty() ) {
+                        cout << "\nError in parseCommandLineInput():\n\tempty key in --info-cols " << keyList << "\n\tAborting ... \n\n";
+                        abortRun(-1);
+                    }
+                    INFO_OUTPUT_COLS.push_back( addINFOkey( key ) );
+                    start = comma + 1;
+                } while ( comma != string::npos );
+                break;
+            }
+            default: /* '?' */
+				abortRun(-1);
+		}
+	}
+
+    if ( !SERVE_SOCKET.empty() ) {
+        // the server only needs its socket; every request brings its own -V and -P:
+#ifdef VSS_LIBRARY
+        cout << "\nError in parseCommandLineInput():\n\t--serve is only for the command-line program.\n\tExiting ... \n\n";
+        abortRun( -1 );
+#endif
+        if ( SERVE_REPLY_FD >= 0 ) {
+            cout << "\nError in parseCommandLineInput():\n\ta request can't start another server.\n\tExiting ... \n\n";
+            abortRun( -1 );
+        }
+        serveRequests( SERVE_SOCKET );
+        abortRun( 0 );  // nothing else is run
+    }
+    if ( BUILD_INDEX ) {
+        // only the index is built, so no population file is needed:
+        string filext = vcfNames.size() == 1 ? vcfNames[0].substr( vcfNames[0].find_last_of( "." ) ) : "";
+        if ( vcfNames.size() != 1 || filext == ".gz" || filext == ".bz2" || filext == ".bcf" ) {
+            cout << "\nError in parseCommandLineInput():\n\t--build-index needs a single uncompressed VCF; a bgzip-compressed\n\tVCF can be entered at any block without an index.\n\tExiting ... \n\n";
+            abortRun( -1 );
+        }
+        buildRecordIndex( vcfNames[0] );
+        abortRun( 0 );  // nothing else is run
+    }
+    if ( popFileNames.empty() || !vcfNameSet || vcfNames.empty() ) {
+        cerr << message;
+        abortRun(-1);
+    }
+    if ( vcfNames.size() == 1 ) {
+        vcfName = vcfNames[0];
+    } else {
+        // the merged outputs are named after the VCF list, or else after the first VCF:
+        VCF_FILE_NAMES = vcfNames;
+        vcfName = vcfListName.empty() ? vcfNames[0] + "_Merged" : vcfListName;
+        if ( NUM_JOBS == 0 )
+            NUM_JOBS = max( 1, static_cast<int>( thread::hardware_concurrency() ) );
+        NUM_JOBS = min( NUM_JOBS, static_cast<int>( vcfNames.size() ) );
+    }
+    
+    cout << "\nOVERALL_DP_MIN_THRESHOLD is " << OVERALL_DP_MIN_THRESHOLD << endl;
+
+    // every population designation file gets its own population map and output file;
+    // with a single -P the output file name is the same as it has always been
+    numDesignations = static_cast<int>( popFileNames.size() );
+    designations.resize( numDesignations );
+    int numSamplesInFile;
+    for ( int d = 0; d < numDesignations; d++ ) {
+        PopulationDesignation& designation = designations[d];
+        designation.popFileName = popFileNames[d];
+        designation.currentChromFile = -1;
+        parsePopulationDesigFile( designation.popFileName, numSamplesInFile, designation.numPopulations, designation.mapOfPopulations, designation.samples, popFileHeader );
+        if ( d == 0 ) {
+            numSamples = numSamplesInFile;
+        } else if ( numSamplesInFile != numSamples ) {
+            cout << "\nError in parseCommandLineInput():\n\tPopulation file '" << designation.popFileName << "' designates " << numSamplesInFile << " samples, but '";
+            cout << popFileNames[0] << "' designates " << numSamples << ".\n\t--> Every population file must list every sample in the VCF.\n\tExiting ... \n\n";
+            abortRun( -1 );
+        }
+
+        if ( numDesignations == 1 ) {
+            designation.outputFileName = vcfName + ( PREVIEW_POINTS ? "_Preview" : "" ) + "_Unfiltered_Summary" + ".tsv";
+        } else {
+            // name each output after its population file, minus directory and extension:
+            string popFileBase = designation.popFileName.substr( designation.popFileName.find_last_of( '/' ) + 1 );
+            popFileBase = popFileBase.substr( 0, popFileBase.find_last_of( '.' ) );
+            designation.outputFileName = vcfName + "_" + popFileBase + ( PREVIEW_POINTS ? "_Preview" : "" ) + "_Unfiltered_Summary" + ".tsv";
+            for ( int e = 0; e < d; e++ ) {
+                if ( designations[e].outputFileName == designation.outputFileName ) {
+                    cout << "\nError in parseCommandLineInput():\n\tPopulation files '" << designations[e].popFileName << "' and '" << designation.popFileName;
+                    cout << "' would both write to " << designation.outputFileName << "\n\t--> Please give them distinct file names.\n\tExiting ... \n\n";
+                    abortRun( -1 );
+                }
+            }
+        }
+
+        // error checking on user input; some arguments are mandatory!
+        if ( designation.numPopulations < 2 ) {
+            cout << "\nError!  numPopulations = " << designation.numPopulations << " in " << designation.popFileName << ", but it has to be >= 2 for this program.\nExiting ...\n\n";
+            abortRun( -1 );
+        }
+    }
+
+    numFields = NUM_META_COLS + numSamples;
+
+    // every population named in --sfs must be in at least one population file:
+    for ( map<string, int>::const_iterator it = SFS_SIZES_BY_POP.begin(); it != SFS_SIZES_BY_POP.end(); it++ ) {
+        bool found = false;
+        for ( int d = 0; d < numDesignations; d++ )
+            found = found || designations[d].mapOfPopulations.count( it->first );
+        if ( !found ) {
+            cout << "\nError in parseCommandLineInput():\n\tpopulation '" << it->first << "' in --sfs is not in any population file.\n\tExiting ... \n\n";
+            abortRun( -1 );
+        }
+    }
+    buildINFOkeyTable( INFO_KEYS );
+    if ( LD_WINDOW_SNPS < 0 || LD_WINDOW_BP < 0 || LD_BIN_WIDTH < 0 || ( LD_BIN_WIDTH && !LD_WINDOW_SNPS && !LD_WINDOW_BP ) ) {
+        cout << "\nError in parseCommandLineInput():\n\t--ld-snps, --ld-bp and --ld-bin must be positive, and --ld-bin\n\tneeds --ld-snps or --ld-bp to set the window.\n\tExiting ... \n\n";
+        abortRun( -1 );
+    }
+    if ( HWE_TESTS )
+        setUpHWEtable();
+    if ( MIN_GT_DP < 0 || MIN_GT_GQ < 0 || MAX_GT_DP < MIN_GT_DP ) {
+        cout << "\nError in parseCommandLineInput():\n\t--min-gt-dp and --min-gt-gq can't be negative, and --max-gt-dp can't be\n\tbelow --min-gt-dp.\n\tExiting ... \n\n";
+        abortRun( -1 );
+    }
+    if ( BUILD_CACHE && ( MIN_GT_DP > 0 || MAX_GT_DP != INT_MAX || MIN_GT_GQ > 0 ) ) {
+        // the cache keeps every call, so that later runs can choose their own limits
+        cout << "\nError in parseCommandLineInput():\n\t--build-cache can't be combined with --min-gt-dp, --max-gt-dp or --min-gt-gq;\n\tbuild the cache without them, and use them in the runs that read it.\n\tExiting ... \n\n";
+        abortRun( -1 );
+    }
+    if ( VCF_FILE_NAMES.empty() && vcfName.substr( vcfName.find_last_of( "." ) ) == ".bcf" && ( CHECKPOINT_INTERVAL || RESUME || PREVIEW_POINTS ) ) {
+        cout << "\nError in parseCommandLineInput():\n\t--checkpoint, --resume and --preview need a VCF; they can't read a .bcf.\n\tExiting ... \n\n";
+        abortRun( -1 );
+    }
+    if ( PREVIEW_POINTS && ( BUILD_CACHE || CHECKPOINT_INTERVAL || RESUME || LD_WINDOW_SNPS || LD_WINDOW_BP ) ) {
+        cout << "\nError in parseCommandLineInput():\n\t--preview can't be combined with --build-cache, --checkpoint, --resume,\n\t--ld-snps or --ld-bp.\n\tExiting ... \n\n";
+        abortRun( -1 );
+    }
+    if ( PREVIEW_POINTS ) {
+        // only an uncompressed or a BGZF file can be entered in the middle:
+        string filext = vcfName.substr( vcfName.find_last_of( "." ) );
+        ifstream compressedFile( vcfName, ios_base::in | ios_base::binary );
+        unsigned long long blockSize, dataSize;
+        if ( filext == ".bz2" || ( filext == ".gz" && !readBGZFblockSizes( compressedFile, 0, blockSize, dataSize ) ) ) {
+            cout << "\nError in parseCommandLineInput():\n\t--preview needs an uncompressed VCF, or one compressed with bgzip;\n\t" << vcfName << " can only be read from the start.\n\tExiting ... \n\n";
+            abortRun( -1 );
+        }
+    }
+    if ( READ_THROTTLE_MS && !READ_AHEAD_DEPTH ) {
+        cout << "\nError in parseCommandLineInput():\n\t--read-throttle only applies to --read-ahead.\n\tExiting ... \n\n";
+        abortRun( -1 );
+    }
+    // a checkpoint holds the outputs written line by line, but not totals kept in memory:
+    if ( ( CHECKPOINT_INTERVAL || RESUME ) && !WRITE_SUMMARY_FILES ) {
+        cout << "\nError in parseCommandLineInput():\n\t--checkpoint and --resume need the summary files to be written.\n\tExiting ... \n\n";
+        abortRun( -1 );
+    }
+    if ( ( CHECKPOINT_INTERVAL || RESUME ) && ( BUILD_CACHE || SAMPLE_STATS || LD_WINDOW_SNPS || LD_WINDOW_BP || SFS_SIZE_ALL || !SFS_SIZES_BY_POP.empty() ) ) {
+        cout << "\nError in parseCommandLineInput():\n\t--checkpoint and --resume can't be combined with --build-cache, --sample-stats,\n\t--ld-snps, --ld-bp or --sfs.\n\tExiting ... \n\n";
+        abortRun( -1 );
+    }
+    // the .bed can't be truncated to a checkpoint, and holds the SNPs of one VCF:
+    if ( !PLINK_PREFIX.empty() && ( CHECKPOINT_INTERVAL || RESUME || PREVIEW_POINTS || !VCF_FILE_NAMES.empty() ) ) {
+        cout << "\nError in parseCommandLineInput():\n\t--export-plink can't be combined with --checkpoint, --resume, --preview\n\tor several VCFs.\n\tExiting ... \n\n";
+        abortRun( -1 );
+    }
+    // several VCFs only merge the outputs written line by line:
+    if ( !VCF_FILE_NAMES.empty() && ( BUILD_CACHE || SAMPLE_STATS || LD_WINDOW_SNPS || LD_WINDOW_BP || SFS_SIZE_ALL || !SFS_SIZES_BY_POP.empty() || SPLIT_BY_CHROM || CHECKPOINT_INTERVAL || RESUME || PREVIEW_POINTS ) ) {
+        cout << "\nError in parseCommandLineInput():\n\tseveral VCFs can't be combined with --build-cache, --sample-stats, --ld-snps,\n\t--ld-bp, --sfs, --split-by-chrom, --checkpoint, --resume or --preview.\n\tExiting ... \n\n";
+        abortRun( -1 );
+    }
+    if ( !VCF_FILE_NAMES.empty() && ( SNP_SUMMARY_CALLBACK || !WRITE_SUMMARY_FILES ) ) {
+        cout << "\nError in parseCommandLineInput():\n\tthe library summarizes one VCF per run.\n\tExiting ... \n\n";
+        abortRun( -1 );
+    }
+    // the reply to a request carries one summary file per -P file:
+    if ( SERVE_REPLY_FD >= 0 && ( SPLIT_BY_CHROM || PREVIEW_POINTS ) ) {
+        cout << "\nError in parseCommandLineInput():\n\ta request to a server (--serve) can't use --split-by-chrom or --preview.\n\tExiting ... \n\n";
+        abortRun( -1 );
+    }
+    if ( NUM_JOBS && VCF_FILE_NAMES.empty() ) {
+        cout << "\nError in parseCommandLineInput():\n\t--jobs only applies to several VCFs.\n\tExiting ... \n\n";
+        abortRun( -1 );
+    }
+
+
+
+	// open file streams and check for errors:
+//    if ( !VCFfile.good() ) {
+//        cout << "\nError in parseCommandLineInput():\n\tVCF file name '" << vcfName << " 'not found!\n\t--> Check spelling and path.\n\tExiting ... \n\n";
+//        exit( -1 );
+//    }
+
+    string testString;
+#ifdef DEBUG
+        cout << "\nMax length of string on this system = " << testString.max_size() << "\n\n";
+#endif
+	if ( !numFormatsSet ) {
+        cout << "\nWarning!! numFormats (-f) not set on command line.\nAssuming numFormats = " << numFormats << endl;
+    }
+}
+
+
+vector<FilterInstruction> parseFilterAnd( vector<string>& tokens, size_t& pos, string& expression )
+{
+    vector<FilterInstruction> program = parseFilterUnary( tokens, pos, expression );
+    FilterInstruction combine;
+    combine.opcode = FILTER_OP_AND;
+    while ( pos < tokens.size() && tokens[pos] == "&&" ) {
+        pos++;
+        vector<FilterInstruction> rhs = parseFilterUnary( tokens, pos, expression );
+        program.insert( program.end(), rhs.begin(), rhs.end() );
+        program.push_back( combine );
+    }
+    return program;
+}
+
+
+vector<FilterInstruction> parseFilterOr( vector<string>& tokens, size_t& pos, string& expression )
+{
+    vector<FilterInstruction> program = parseFilterAnd( tokens, pos, expression );
+    FilterInstruction combine;
+    combine.opcode = FILTER_OP_OR;
+    while ( pos < tokens.size() && tokens[pos] == "||" ) {
+        pos++;
+        vector<FilterInstruction> rhs = parseFilterAnd( tokens, pos, expression );
+        program.insert( program.end(), rhs.begin(), rhs.end() );
+        program.push_back( combine );
+    }
+    return program;
+}
+
+
+vector<FilterInstruction> parseFilterPredicate( vector<string>& tokens, size_t& pos, string& expression )
+{
+    FilterInstruction predicate;
+    string field = tokens[pos++];
+    bool textField = false;
+
+    if ( field == "QUAL" ) {
+        predicate.opcode = FILTER_OP_QUAL;
+    } else if ( field == "FILTER" ) {
+        predicate.opcode = FILTER_OP_FILTER;
+        textField = true;
+    } else if ( field == "CHROM" ) {
+        predicate.opcode = FILTER_OP_CHROM;
+        textField = true;
+    } else if ( field == "POS" ) {
+        predicate.opcode = FILTER_OP_POS;
+    } else if ( field == "MAF" ) {
+        predicate.opcode = FILTER_OP_MAF;
+    } else if ( field == "CALLRATE" ) {
+        predicate.opcode = FILTER_OP_CALLRATE;
+    } else if ( field.compare( 0, 5, "INFO." ) == 0 && field.length() > 5 ) {
+        predicate.opcode = FILTER_OP_INFO;
+        predicate.INFOkey = addINFOkey( field.substr( 5 ) );
+    } else {
+        filterExpressionError( expression, "unknown field '" + field + "' (expected QUAL, FILTER, CHROM, POS, INFO.key, MAF, or CALLRATE)" );
+    }
+    predicate.lastResult = false;
+    predicate.numericValue = !textField;
+
+    string op = ( pos < tokens.size() ) ? tokens[pos] : "";
+    if ( op == "in" ) {
+        if ( !textField && predicate.opcode != FILTER_OP_INFO )
+            filterExpressionError( expression, "'in' can only be used with FILTER, CHROM, or INFO.key" );
+        predicate.comparison = FILTER_CMP_IN;
+        predicate.numericValue = false;
+        pos++;
+        if ( pos >= tokens.size() || tokens[pos] != "{" )
+            filterExpressionError( expression, "expected '{' after 'in'" );
+        do {
+            pos++;
+            if ( pos >= tokens.size() || tokens[pos] == "}" || tokens[pos] == "," )
+                filterExpressionError( expression, "expected a value in the set after " + field + " in" );
+            predicate.textSet.insert( tokens[pos++] );
+        } while ( pos < tokens.size() && tokens[pos] == "," );
+        if ( pos >= tokens.size() || tokens[pos] != "}" )
+            filterExpressionError( expression, "expected '}' to close the set after " + field + " in" );
+        pos++;
+        return vector<FilterInstruction>( 1, predicate );
+    }
+
+    if ( op == "<" ) predicate.comparison = FILTER_CMP_LT;
+    else if ( op == "<=" ) predicate.comparison = FILTER_CMP_LE;
+    else if ( op == ">" ) predicate.comparison = FILTER_CMP_GT;
+    else if ( op == ">=" ) predicate.comparison = FILTER_CMP_GE;
+    else if ( op == "==" || op == "=" ) predicate.comparison = FILTER_CMP_EQ;
+    else if ( op == "!=" ) predicate.comparison = FILTER_CMP_NE;
+    else if ( predicate.opcode == FILTER_OP_INFO ) {
+        // INFO.key on its own tests for the presence of a key (e.g. a flag)
+        predicate.opcode = FILTER_OP_INFO_FLAG;
+        return vector<FilterInstruction>( 1, predicate );
+    } else {
+        filterExpressionError( expression, "expected a comparison after " + field );
+    }
+    pos++;
+
+    if ( pos >= tokens.size() )
+        filterExpressionError( expression, "expected a value after " + field + " " + op );
+    predicate.text = tokens[pos];
+    char *endOfNumber;
+    predicate.value = strtod( tokens[pos].c_str(), &endOfNumber );
+    bool isNumber = !tokens[pos].empty() && *endOfNumber == '\0';
+    if ( predicate.opcode == FILTER_OP_INFO ) {
+        // INFO values are compared as numbers when the right-hand side is one
+        predicate.numericValue = isNumber;
+    }
+    if ( !textField && predicate.opcode != FILTER_OP_INFO && !isNumber )
+        filterExpressionError( expression, field + " must be compared with a number, not '" + tokens[pos] + "'" );
+    if ( !predicate.numericValue && predicate.comparison != FILTER_CMP_EQ && predicate.comparison != FILTER_CMP_NE )
+        filterExpressionError( expression, "text values can only be compared with == or !=" );
+    pos++;
+    return vector<FilterInstruction>( 1, predicate );
+}
+
+
+vector<FilterInstruction> parseFilterUnary( vector<string>& tokens, size_t& pos, string& expression )
+{
+    if ( pos >= tokens.size() )
+        filterExpressionError( expression, "expression ends too early" );
+    if ( tokens[pos] == "!" ) {
+        pos++;
+        vector<FilterInstruction> program = parseFilterUnary( tokens, pos, expression );
+        FilterInstruction negate;
+        negate.opcode = FILTER_OP_NOT;
+        program.push_back( negate );
+        return program;
+    }
+    if ( tokens[pos] == "(" ) {
+        pos++;
+        vector<FilterInstruction> program = parseFilterOr( tokens, pos, expression );
+        if ( pos >= tokens.size() || tokens[pos] != ")" )
+            filterExpressionError( expression, "missing ')'" );
+        pos++;
+        return program;
+    }
+    return parseFilterPredicate( tokens, pos, expression );
+}
+
+
+bool parseMetaColData( char*& cursor, long int SNPcount, bool checkFormat, FormatPlanCache& formatPlans, int maxSubfieldsInFormat, int formatOpsOrder[], int& numTokensInFormat, int& GTtoken, int& DPtoken, int& GQtoken, int& PLtoken, bool& lookForDP, bool& lookForGQ, bool& lookForPL, bool& lookForDPinINFO, char formatDelim, char* CHROM, char* POS, char* ID, char* REF, char* ALT, char* QUAL, char* FILTER, double& DPval, bool& isBiallelicSNP )
+{
+    // cursor starts at the beginning of the line and is left on the tab after FORMAT
+    //char myDelim = formatDelim;
+    char *INFO, FORMAT[MAX_BUFFER_SIZE];
+    size_t REFlength, ALTlength;
+    bool keepThis = true;
+
+
+    // loop over fields:
+    int col = 1;
+    //while( col <= NUM_META_COLS ) {
+    //    for ( int col = 1; col <= NUM_META_COLS; col++ ) {
+    //VCFfile.get( buffer, MAX_BUFFER_SIZE, VCF_DELIM );
+    //fprintf(stdout, "col = %i \t buffer = %s\n", col, buffer);
+    //switch ( col ) {
+    //            case 1:
+    copyVCFfield( cursor, CHROM );
+    if ( *cursor == VCF_DELIM ) cursor++;
+    //                break;
+    //            case 2:
+    copyVCFfield( cursor, POS );
+    if ( *cursor == VCF_DELIM ) cursor++;
+    //                break;
+    //            case 3:
+    copyVCFfield( cursor, ID );
+    if ( *cursor == VCF_DELIM ) cursor++;
+    //                break;
+    //            case 4:
+    copyVCFfield( cursor, REF );
+    REFlength = getLength( REF );
+    //                break;
+    if ( *cursor == VCF_DELIM ) cursor++;
+    //            case 5:
+    copyVCFfield( cursor, ALT );
+    ALTlength = getLength( ALT );
+    if ( *cursor == VCF_DELIM ) cursor++;
+    //                break;
+    //            case 6:
+    copyVCFfield( cursor, QUAL );
+    if ( *cursor == VCF_DELIM ) cursor++;
+    //QUAL = stod(buffer);
+    //                break;
+    //            case 7:                 // this also handles 8!
+    copyVCFfield( cursor, FILTER );
+    // need to prepare to handle INFO column next
+    if ( *cursor == VCF_DELIM ) cursor++; // move past tab
+    // INFO can be kilobytes long in annotated VCFs, so it is used in place, not copied:
+    INFO = cursor;
+    while ( *cursor != VCF_DELIM && *cursor != '\0' )
+        cursor++;
+    if ( *cursor == VCF_DELIM )
+        *cursor++ = '\0'; // terminate INFO; the tab isn't needed again
+    
+    //                fprintf(stdout, "INFO is: \t%s[end]\n", INFO);
+    // DP is the first key in INFO_KEYS; once a line without it has been seen,
+    // INFO only needs splitting for the other keys
+    if ( lookForDPinINFO || INFO_KEYS.keys.size() > 1 ) {
+        tokenizeINFO( INFO_KEYS, INFO );
+    }
+    if ( lookForDPinINFO ) {
+        DPval = extractDPvalue( INFO_KEYS, lookForDPinINFO );
+        //cout << "\tDPval extracted is: \t" << DPval << endl;
+        if ( !isnan( DPval ) ) {
+            if ( DPval >= OVERALL_DP_MIN_THRESHOLD )
+                keepThis = true;
+            else
+                keepThis = false;
+        }
+    } else {
+        DPval = std::numeric_limits<double>::quiet_NaN();
+        //                    cout << "\tYo DPval is " << DPval << " bruh\n\n  **************** \n\n";
+    }
+    
+    //                col++; // since this case also handles 8!
+    //                break;
+    
+    //            case 9:
+    copyVCFfield( cursor, FORMAT );
+    //cout << "\nFORMAT is " << FORMAT << endl;
+    
+    
+    //                FORMAT = buffer;
+    //                break;
+    //            default:
+    //                cout << "\nError in parseActualData():\n\t";
+    //                cout << "case-switch not working as expected.\n\tAborting ...\n\n";
+    //                exit(-3);
+    //                break;
+    //        }
+    //        if ( col < NUM_META_COLS )
+    //            VCFfile.ignore(unsigned(-1), VCF_DELIM); // move to tab, but not on last one, because
+    //            // calcSummaryStats() always clears a character at the beginning of its loop
+    //        col++;
+    //
+    //    }
+    //
+    
+    // status report:
+    if ( VERBOSE ) {
+        if ( SNPcount % 10000 == 0 ) {
+            cout << "\nSNP lines processed so far = " << SNPcount << "; Current SNP is:\n\t";
+            cout <<  CHROM << "\t" << POS << "\t" << ID << "\t" << REF << "\t" << ALT << endl;
+        }
+    }
+
+    if ( checkFormat ) {
+        // with -f > 1 this is every line, so each distinct FORMAT is only tokenized once:
+        const FormatPlan& plan = lookUpFormatPlan( formatPlans, FORMAT, formatDelim, maxSubfieldsInFormat );
+        numTokensInFormat = plan.numTokensInFormat;
+        GTtoken = plan.GTtoken;
+        DPtoken = plan.DPtoken;
+        GQtoken = plan.GQtoken;
+        PLtoken = plan.PLtoken;
+        lookForDP = plan.lookForDP;
+        lookForGQ = plan.lookForGQ;
+        lookForPL = plan.lookForPL;
+        for ( int i = 0; i < numTokensInFormat; i++ )
+            formatOpsOrder[i] = plan.formatOpsOrder[i];
+    }
+    // check for bi-allelic SNPs:
+    if ( REF[0] == 'N' || ALT[0] == 'N' || ALTlength != 1 || REFlength != 1 ) {
+        isBiallelicSNP = false;
+    } else {
+        isBiallelicSNP = true;
+    }
+    keepThis = keepThis && isBiallelicSNP;
+
+    // --filter conditions that only need the meta columns are checked here,
+    // before any of the sample columns are read:
+    if ( keepThis && !SITE_FILTERS.empty() ) {
+        keepThis = passesFilters( SITE_FILTERS, CHROM, POS, QUAL, FILTER, std::numeric_limits<double>::quiet_NaN(), std::numeric_limits<double>::quiet_NaN() );
+    }
+
+//    if ( !keepThis ) {
+//#ifdef DEBUG
+//        cout << "\nSNP #" << SNPcount << ", ID = " << ID << ", has REF = " << REF << " and ALT = " << ALT << endl;
+//#endif
+//    }
+
+    return keepThis;
+}
+
+
+inline void parsePL( char* tokenHolder )
+{
+    
+    // here's the description from the VCF file specification, pp. 10-11 of
+    // http://samtools.github.io/hts-specs/VCFv4.3.pdf, accessed 7/9/19:
+    /*
+     GL (Float): Genotype likelihoods comprised of comma
+     separated floating point log10-scaled
+     likelihoods for all possible genotypes given the set
+     of alleles defined in the REF and ALT fields.
+     In presence of the GT field the same ploidy is expected;
+     without GT field, diploidy is assumed.
+     
+     PL (Integer): The phred-scaled genotype likelihoods rounded
+     to the closest integer, and otherwise defined precisely as
+     the GL field.
+     */
+    
+#ifdef DEBUG
+    //cout << "\ntokenHolder = " << tokenHolder << endl;
+    //char* tempCharArray = strtok(tokenHolder, ",");
+    //int i = 0;
+    //while ( tempCharArray ) {
+    //    cout << "\ttoken part " << ++i << ":\t" << tempCharArray << endl;
+    //    tempCharArray = strtok(NULL, ",");
+    //}
+    //cout << endl;
+    //exit(0);
+#endif
+    
+}
+
+
+void parsePopulationDesigFile( string fname, int& numSamples, int& numPopulations, map<string,int>& mapOfPopulations, SampleTable& samples, bool popFileHeader )
+{
+    // goal is to get numSamples, numPopulations, the population index of every
+    // sample ID, and population indexes in alphabetical order.  The file is read
+    // whole and parsed in place, in a single pass
+
+    ifstream popMapFile( fname, ios_base::in | ios_base::binary );
+    if ( !popMapFile.good() ) {
+        cout << "\nError in parseCommandLineInput():\n\tPopulation file name '" << fname << "' not found!\n\t--> Check spelling and path.\n\tAborting ... \n\n";
+        abortRun( -1 );
+    }
+    string text( ( istreambuf_iterator<char>( popMapFile ) ), istreambuf_iterator<char>() );
+    popMapFile.close();
+    const char *cursor = text.data(), *end = cursor + text.length();
+    if ( popFileHeader ) {
+        const char *newline = static_cast<const char*>( memchr( cursor, '\n', end - cursor ) );
+        cursor = newline ? newline + 1 : end;   // skip header line
+    }
+
+    // size the sample table for at most half full, from the number of lines:
+    size_t numLines = 1, tableSize = 4;
+    for ( const char *c = cursor; ( c = static_cast<const char*>( memchr( c, '\n', end - c ) ) ) != NULL; c++ )
+        numLines++;
+    while ( tableSize < 2 * numLines )
+        tableSize <<= 1;
+    samples.IDs.clear();
+    samples.IDs.reserve( numLines );
+    samples.popIndexes.clear();
+    samples.popIndexes.reserve( numLines );
+    samples.slots.assign( tableSize, -1 );
+    samples.mask = static_cast<unsigned int>( tableSize - 1 );
+
+    // whitespace-separated sample ID and population, one pair per line; populations
+    // are numbered in order of appearance until all of them are known:
+    string popMembership;
+    int countPops = 0;
+    map<string, int>::iterator lastPop = mapOfPopulations.end();
+    while ( cursor < end ) {
+        while ( cursor < end && isspace( static_cast<unsigned char>( *cursor ) ) )
+            cursor++;
+        const char *sampleID = cursor;
+        while ( cursor < end && !isspace( static_cast<unsigned char>( *cursor ) ) )
+            cursor++;
+        size_t sampleIDlength = cursor - sampleID;
+        while ( cursor < end && isspace( static_cast<unsigned char>( *cursor ) ) )
+            cursor++;
+        const char *population = cursor;
+        while ( cursor < end && !isspace( static_cast<unsigned char>( *cursor ) ) )
+            cursor++;
+        if ( population == cursor )
+            break;      // end of file, or a sample ID without a population
+
+        // consecutive samples usually share a population:
+        if ( lastPop == mapOfPopulations.end() || lastPop->first.compare( 0, string::npos, population, cursor - population ) != 0 ) {
+            popMembership.assign( population, cursor - population );
+            lastPop = mapOfPopulations.find( popMembership );
+            if ( lastPop == mapOfPopulations.end() )
+                lastPop = mapOfPopulations.insert( pair<string, int>(popMembership, countPops++) ).first;
+        }
+        int slot = findSample( samples, sampleID, sampleIDlength );
+        if ( samples.slots[slot] >= 0 ) {
+            cerr << "\nError! Duplicate Sample ID (" << string( sampleID, sampleIDlength ) << ") found!\n\tAborting ...\n";
+            abortRun(-1);
+        }
+        samples.slots[slot] = static_cast<int>( samples.IDs.size() );
+        samples.IDs.push_back( string( sampleID, sampleIDlength ) );
+        samples.popIndexes.push_back( lastPop->second );
+    }
+
+    numSamples = static_cast<int>( samples.IDs.size() );
+    numPopulations = countPops;
+
+    // reassign integer designations based upon alphabetical ordering, which is map order:
+    vector<int> alphabeticalIndex( numPopulations );
+    int counter = 0;
+    for ( map<string, int>::iterator it = mapOfPopulations.begin(); it != mapOfPopulations.end(); it++ ) {
+        alphabeticalIndex[ it->second ] = counter;
+        it->second = counter++;
+    }
+    for ( size_t i = 0; i < samples.popIndexes.size(); i++ )
+        samples.popIndexes[i] = alphabeticalIndex[ samples.popIndexes[i] ];
+
+    if ( VERBOSE ) {
+        cout << "\nPopulation designations by integer ID:\n";
+        for ( map<string, int>::const_iterator it = mapOfPopulations.begin(); it != mapOfPopulations.end(); it++ )
+            cout << "\tPopulation " << it->second << " is " << it->first << endl;
+    }
+}
+
+bool passesFilters( vector< vector<FilterInstruction> >& filters, char* CHROM, char* POS, char* QUAL, char* FILTER, double MAF, double callRate )
+{
+    // every compiled term must hold; stop at the first one that doesn't
+    for ( size_t i = 0; i < filters.size(); i++ ) {
+        if ( !evaluateFilterProgram( filters[i], CHROM, POS, QUAL, FILTER, MAF, callRate ) )
+            return false;
+    }
+    return true;
+}
+
+
+void prefetchWithPread( ReadAheadState* state )
+{
+    // the prefetch thread of --read-ahead when io_uring can't be used: fills the
+    // buffers in turn, each one again as soon as readAhead() has handed it out.
+    // Read errors are left in readError for readAhead() to report
+    for ( int b = 0; ; b = ( b + 1 ) % state->depth ) {
+        unique_lock<mutex> guard( state->lock );
+        while ( state->bufferStates[b] != READ_AHEAD_FREE && !state->stopPrefetch )
+            state->changed.wait( guard );
+        if ( state->stopPrefetch || state->readError || state->nextOffset >= state->fileSize ) {
+            state->prefetchDone = true;
+            guard.unlock();
+            state->changed.notify_all();
+            return;
+        }
+        state->bufferOffsets[b] = state->nextOffset;
+        state->bufferLengths[b] = min( static_cast<unsigned long long>( READ_AHEAD_BUFFER_SIZE ), state->fileSize - state->nextOffset );
+        state->bufferFilled[b] = 0;
+        state->nextOffset += state->bufferLengths[b];
+        state->bufferStates[b] = READ_AHEAD_IN_FLIGHT;
+        state->startTimes[b] = chrono::steady_clock::now();
+        guard.unlock();
+
+        int error = 0;
+        while ( state->bufferFilled[b] < state->bufferLengths[b] ) {
+            ssize_t got = pread( state->fd, state->buffers[b].data() + state->bufferFilled[b], state->bufferLengths[b] - state->bufferFilled[b], state->bufferOffsets[b] + state->bufferFilled[b] );
+            if ( got < 0 && errno == EINTR )
+                continue;
+            if ( got < 0 )
+                error = errno;
+            if ( got <= 0 )
+                break;  // an error, or the file got shorter
+            state->bufferFilled[b] += got;
+        }
+        if ( READ_THROTTLE_MS > 0 )
+            this_thread::sleep_until( state->startTimes[b] + chrono::milliseconds( READ_THROTTLE_MS ) );
+
+        guard.lock();
+        state->bufferStates[b] = READ_AHEAD_READY;
+        if ( error )
+            state->readError = error;
+        guard.unlock();
+        state->changed.notify_all();
+    }
+}
+
+
+void previewVCF( istream& VCFfile, int numFormats, char formatDelim, int maxSubfieldsInFormat, unsigned long int VCFfileLineCount, int numSamples, PopulationDesignation* designations, int numDesignations, string* sampleIDs, string vcfName )
+{
+    // --preview: summarizes PREVIEW_LINES_PER_POINT lines at each of PREVIEW_POINTS
+    // places spread evenly over the file, instead of every line.  VCFfile stands at
+    // the first data line, which is the first place; the others are reached by
+    // seeking to a byte offset of an uncompressed VCF, or to the next BGZF block after
+    // it, and skipping the rest of the line found there.  Their line numbers can only
+    // be estimated, from the mean length of the lines read so far and, for BGZF, the
+    // compression ratio of the blocks read so far, unless an uncompressed VCF has a
+    // record index; then each place starts at the next indexed line, whose number is known
+    using namespace boost::iostreams;
+    // the buffers are arrays and vectors, so that they are also freed when abortRun()
+    // throws in the library build
+    char CHROM[MAX_BUFFER_SIZE], POS[MAX_BUFFER_SIZE], ID[MAX_BUFFER_SIZE], REF[MAX_BUFFER_SIZE], ALT[MAX_BUFFER_SIZE], QUAL[MAX_BUFFER_SIZE], FILTER[MAX_BUFFER_SIZE];
+    VCFlineReader lineReader;
+    char *line, *cursor;
+    size_t lineLength;
+    long int SNPcount = 0;
+    bool keepThis, checkFormat = true, lookForDP, lookForGQ, lookForPL, isBiallelicSNP;
+    bool lookForDPinINFO = true;
+    double DPval;
+    int numTokensInFormat, GTtoken = -1, DPtoken = -1, GQtoken = -1, PLtoken = -1;
+    int formatOpsOrder[maxSubfieldsInFormat];
+    FormatPlanCache formatPlans;    // one plan per distinct FORMAT; see lookUpFormatPlan()
+    SampleStats sampleStats;
+    SampleStats *sampleStatsPtr = NULL; // stays NULL unless --sample-stats was given
+    vector<char> codesOfLine( numSamples );
+    vector<int> DPofLine( numSamples ), GQofLine( numSamples );
+    char *genotypeCodes = codesOfLine.data();
+    int *DPvalues = DPofLine.data(), *GQvalues = GQofLine.data();
+    if ( SAMPLE_STATS ) {
+        setUpSampleStats( sampleStats, numSamples );
+        sampleStatsPtr = &sampleStats;
+    }
+
+    // parseCommandLineInput() has checked that a .gz file is BGZF:
+    unsigned long long fileSize, blockSize, dataSize;
+    long long fileModTime;
+    bool BGZF = ( vcfName.substr( vcfName.find_last_of( "." ) ) == ".gz" );
+    ifstream compressedFile;    // for finding and walking BGZF blocks
+    if ( BGZF )
+        compressedFile.open( vcfName, ios_base::in | ios_base::binary );
+    if ( !getSourceFileStats( vcfName, fileSize, fileModTime ) ) {
+        cout << "\nError in previewVCF():\n\tcould not stat " << vcfName << "\n\tAborting ... \n\n";
+        abortRun(-4);
+    }
+    unsigned long long headerBytes = countVCFheaderBytes( vcfName );
+    unsigned long long linesRead = 0, lineBytesRead = 0;        // for the mean line length
+    unsigned long long compressedRead = 0, uncompressedRead = 0;    // for the BGZF compression ratio
+    unsigned long long runEnd = 0;      // offset in the file that the last place's lines reached
+    unsigned long int lineNumber = VCFfileLineCount, estimate;
+    vector<RecordIndexEntry> recordIndex;   // see --build-index
+    bool indexed = !BGZF && readRecordIndex( vcfName, recordIndex );
+
+    for ( int point = 0; point < PREVIEW_POINTS; point++ ) {
+        filtering_streambuf<input> pointVCFin;
+        ifstream pointUnfiltered;
+        istream pointVCF( &pointVCFin );
+        istream *source = &VCFfile;
+        unsigned long long start = 0, skipped = 0;
+        if ( point > 0 ) {
+            if ( linesRead == 0 )
+                break;  // no data lines at all
+            start = static_cast<unsigned long long>( point ) * fileSize / PREVIEW_POINTS;
+            vector<RecordIndexEntry>::const_iterator entry = recordIndex.end();
+            if ( indexed ) {
+                entry = lower_bound( recordIndex.begin(), recordIndex.end(), start, []( const RecordIndexEntry& e, unsigned long long offset ) { return e.offset < offset; } );
+                if ( entry == recordIndex.end() )
+                    break;
+                start = entry->offset;
+            }
+            if ( start < runEnd )
+                continue;   // the last place's lines already went past this one
+            if ( BGZF ) {
+                start = findNextBGZFblock( compressedFile, start, fileSize );
+                if ( start >= fileSize )
+                    break;
+                pointVCFin.push( gzip_decompressor() );
+            }
+            pointUnfiltered.open( vcfName, ios_base::in | ios_base::binary );
+            pointUnfiltered.seekg( static_cast<streamoff>( start ) );
+            pointVCFin.push( pointUnfiltered );
+            source = &pointVCF;
+            if ( indexed ) {
+                // an indexed line starts right there:
+                lineNumber = entry->VCFlineNum - 1;     // counted up as the line is read
+            } else {
+                string partialLine;
+                if ( !getline( pointVCF, partialLine ) )
+                    break;
+                skipped = partialLine.length() + 1;
+                // where this place's first line is estimated to be:
+                double uncompressedOffset = BGZF ? static_cast<double>( start ) * uncompressedRead / compressedRead : static_cast<double>( start );
+                uncompressedOffset += skipped;
+                estimate = VCFfileLineCount;
+                if ( uncompressedOffset > headerBytes )
+                    estimate += static_cast<unsigned long int>( ( uncompressedOffset - headerBytes ) * linesRead / lineBytesRead );
+                lineNumber = max( lineNumber, estimate );
+            }
+        }
+
+        openLineReader( lineReader, *source, 0, PREVIEW_BLOCK_SIZE );  // only a few lines are read
+        for ( int n = 0; n < PREVIEW_LINES_PER_POINT && readVCFline( lineReader, line, lineLength ); n++ ) {
+            cursor = line;
+            SNPcount++;
+            lineNumber++;
+            linesRead++;
+            lineBytesRead += lineLength + 1;
+            keepThis = parseMetaColData( cursor, SNPcount, checkFormat, formatPlans, maxSubfieldsInFormat, formatOpsOrder, numTokensInFormat, GTtoken, DPtoken, GQtoken, PLtoken, lookForDP, lookForGQ, lookForPL, lookForDPinINFO, formatDelim, CHROM, POS, ID, REF, ALT, QUAL, FILTER, DPval, isBiallelicSNP );
+            if ( keepThis )
+                calculateSummaryStats( cursor, keepThis, numTokensInFormat, lookForDP, lookForGQ, lookForPL, formatDelim, formatOpsOrder, numSamples, designations, numDesignations, lineNumber, CHROM, POS, ID, REF, ALT, QUAL, FILTER, genotypeCodes, DPvalues, GQvalues, NULL, sampleStatsPtr, NULL, NULL, NULL, NULL, NULL );
+            if ( numFormats == 1 )
+                checkFormat = false;
+        }
+
+        // how far into the file the lines went, and the BGZF blocks they came from:
+        unsigned long long consumed = skipped + lineReader.blockOffset + lineReader.start;
+        if ( point == 0 )
+            consumed += headerBytes;
+        if ( BGZF ) {
+            unsigned long long blockStart = start, blockDataStart = 0;
+            if ( findBGZFvirtualOffset( compressedFile, blockStart, blockDataStart, consumed ) >= 0 && readBGZFblockSizes( compressedFile, blockStart, blockSize, dataSize ) ) {
+                compressedRead += blockStart + blockSize - start;
+                uncompressedRead += blockDataStart + dataSize;
+                runEnd = blockStart + blockSize;
+            } else {
+                runEnd = fileSize;
+            }
+        } else {
+            runEnd = start + consumed;
+        }
+        closeLineReader( lineReader );
+    }
+
+    cout << "\nPreview: " << linesRead << " lines summarized from places spread over " << vcfName << endl;
+    if ( SAMPLE_STATS ) {
+        writeSampleSummary( sampleStats, sampleIDs, vcfName + "_Preview_SampleSummary.tsv" );
+    }
+}
+
+
+void printCPUpath()
+{
+    // --print-cpu-path: which version of the CPU_DISPATCH kernels this CPU runs;
+    // the tests are the ones the loader makes when it picks a version
+#ifdef CPU_DISPATCH_CLONES
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "x86-64-v4" ) )
+        cout << "CPU path: x86-64-v4 (AVX-512)\n";
+    else if ( __builtin_cpu_supports( "x86-64-v3" ) )
+        cout << "CPU path: x86-64-v3 (AVX2, FMA, BMI2)\n";
+    else if ( __builtin_cpu_supports( "x86-64-v2" ) )
+        cout << "CPU path: x86-64-v2 (SSE4.2, POPCNT)\n";
+    else
+        cout << "CPU path: x86-64 (baseline)\n";
+#else
+    cout << "CPU path: single version (this build has no runtime CPU dispatch)\n";
+#endif
+}
+
+
+streamsize readAhead( ReadAheadState* state, char* s, streamsize n )
+{
+    // hands out the next bytes of the file, in order, up to the end of the current
+    // buffer; -1 at the end of the file
+    int b = state->current;
+    waitForReadAhead( state, b );
+    if ( state->bufferStates[b] == READ_AHEAD_FREE )
+        return -1;  // no read was started for it: the file is done
+    if ( state->readError ) {
+        cout << "\nError in readAhead():\n\treading the VCF failed: " << strerror( state->readError ) << "\n\tAborting ... \n\n";
+        abortRun(-4);
+    }
+    if ( state->ringFd >= 0 && READ_THROTTLE_MS > 0 && state->handedOut == 0 )
+        this_thread::sleep_until( state->startTimes[b] + chrono::milliseconds( READ_THROTTLE_MS ) );
+
+    streamsize copied = min( n, static_cast<streamsize>( state->bufferFilled[b] - state->handedOut ) );
+    memcpy( s, state->buffers[b].data() + state->handedOut, copied );
+    state->handedOut += copied;
+    if ( state->handedOut == state->bufferFilled[b] ) {
+        // used up: the buffer goes back for the next part of the file
+        state->current = ( b + 1 ) % state->depth;
+        state->handedOut = 0;
+        if ( state->ringFd >= 0 ) {
+            state->bufferStates[b] = READ_AHEAD_FREE;
+            submitReadAhead( state, b );
+        } else {
+            {
+                lock_guard<mutex> guard( state->lock );
+                state->bufferStates[b] = READ_AHEAD_FREE;
+            }
+            state->changed.notify_all();
+        }
+    }
+    return copied > 0 ? copied : readAhead( state, s, n );
+}
+
+
+ReadAheadState::ReadAheadState() : fd( -1 ), depth( 0 ), ringFd( -1 ), fixedBuffers( false ), prefetchDone( false ), stopPrefetch( false )
+{
+}
+
+
+ReadAheadState::~ReadAheadState()
+{
+    // stops reading ahead, also when a library run unwinds; reads still in flight
+    // have to finish first, since the kernel writes into the buffers
+    if ( ringFd >= 0 ) {
+#ifdef HAVE_IO_URING
+        for ( int b = 0; b < depth; b++ )
+            waitForReadAhead( this, b );
+        munmap( sqes, sqesSize );
+        if ( cqRing != sqRing )
+            munmap( cqRing, cqRingSize );
+        munmap( sqRing, sqRingSize );
+        close( ringFd );
+#endif
+    } else if ( prefetchThread.joinable() ) {
+        {
+            lock_guard<mutex> guard( lock );
+            stopPrefetch = true;
+        }
+        changed.notify_all();
+        prefetchThread.join();
+    }
+    if ( fd >= 0 )
+        close( fd );
+}
+
+
+streamsize ReadAheadSource::read( char* s, streamsize n )
+{
+    return readAhead( state.get(), s, n );
+}
+
+
+void ReadAheadSource::close()
+{
+    // the chain may close its devices more than once, and it keeps copies of the
+    // source; the state is freed with the last one (see ~ReadAheadState())
+    state.reset();
+}
+
+
+void readBCFheader( istream& BCFfile, BCFreader& reader, string& headerText, string vcfName )
+{
+    // checks the magic number, puts the header text (a VCF header, through the #CHROM
+    // line) in headerText, and builds the dictionaries from it: FILTER, INFO and FORMAT
+    // IDs share one, numbered from 1 after PASS in order of first appearance, and
+    // ##contig lines have their own; IDX= in a line overrides the numbering
+    char magic[sizeof( BCF_MAGIC )];
+    uint32_t textLength = 0;
+    BCFfile.read( magic, sizeof( magic ) );
+    BCFfile.read( reinterpret_cast<char*>( &textLength ), sizeof( textLength ) );
+    if ( !BCFfile.good() || memcmp( magic, BCF_MAGIC, sizeof( magic ) ) != 0 ) {
+        cout << "\nError in readBCFheader():\n\t" << vcfName << " is not a BCF2 file.\n\tAborting ... \n\n";
+        abortRun(-2);
+    }
+    headerText.resize( textLength );
+    BCFfile.read( &headerText[0], textLength );
+    if ( BCFfile.gcount() != static_cast<streamsize>( textLength ) ) {
+        cout << "\nError in readBCFheader():\n\tthe header of " << vcfName << " is truncated.\n\tAborting ... \n\n";
+        abortRun(-2);
+    }
+    size_t textEnd = headerText.find( '\0' );
+    if ( textEnd != string::npos )
+        headerText.resize( textEnd );
+
+    reader.source = &BCFfile;
+    reader.dictionary.assign( 1, "PASS" );
+    reader.contigs.clear();
+    istringstream lines( headerText );
+    string line, ID, IDX;
+    size_t index;
+    while ( getline( lines, line ) && line.compare( 0, 2, "##" ) == 0 ) {
+        bool isContig = ( line.compare( 0, 10, "##contig=<" ) == 0 );
+        if ( !isContig && line.compare( 0, 10, "##FILTER=<" ) != 0 && line.compare( 0, 8, "##INFO=<" ) != 0 && line.compare( 0, 10, "##FORMAT=<" ) != 0 )
+            continue;
+        vector<string>& dictionary = isContig ? reader.contigs : reader.dictionary;
+        ID = getBCFheaderValue( line, "ID" );
+        IDX = getBCFheaderValue( line, "IDX" );
+        if ( !IDX.empty() ) {
+            index = strtoul( IDX.c_str(), NULL, 10 );
+        } else {
+            // an INFO and a FORMAT field of the same name share an index:
+            index = dictionary.size();
+            for ( size_t i = 0; i < dictionary.size() && !isContig; i++ ) {
+                if ( dictionary[i] == ID )
+                    index = i;
+            }
+        }
+        if ( index >= dictionary.size() )
+            dictionary.resize( index + 1 );
+        dictionary[index] = ID;
+    }
+    reader.GTkey = reader.DPkey = reader.GQkey = -1;
+    for ( size_t i = 0; i < reader.dictionary.size(); i++ ) {
+        if ( reader.dictionary[i] == "GT" )
+            reader.GTkey = static_cast<int>( i );
+        else if ( reader.dictionary[i] == "DP" )
+            reader.DPkey = static_cast<int>( i );
+        else if ( reader.dictionary[i] == "GQ" )
+            reader.GQkey = static_cast<int>( i );
+    }
+}
+
+
+int readBCFkey( BCFreader& reader, const unsigned char*& cursor, const unsigned char* end )
+{
+    // reads an INFO or FORMAT key, a typed integer that indexes the dictionary
+    int type, count;
+    int32_t key = -1;
+    readBCFtype( cursor, end, type, count );
+    if ( count == 1 && type >= BCF_TYPE_INT8 && type <= BCF_TYPE_INT32 && end - cursor >= BCF_TYPE_SIZES[type] ) {
+        key = getBCFint( cursor, type );
+        cursor += BCF_TYPE_SIZES[type];
+    }
+    if ( key < 0 || key >= static_cast<int32_t>( reader.dictionary.size() ) || reader.dictionary[key].empty() ) {
+        cout << "\nError in readBCFkey():\n\ta record of the BCF file has a key that is not in its header.\n\tAborting ... \n\n";
+        abortRun(-5);
+    }
+    return key;
+}
+
+
+bool readBCFrecord( BCFreader& reader, char*& line, char formatDelim, int numSamples )
+{
+    // reads the next record of a .bcf, sets line to its CHROM to FORMAT columns written
+    // as in a VCF (for parseMetaColData()), and finds its GT, DP and GQ arrays for
+    // decodeBCFsamples(); returns false at the end of the file
+    uint32_t lengths[2];    // of the shared (CHROM to INFO) and per-sample data
+    reader.source->read( reinterpret_cast<char*>( lengths ), sizeof( lengths ) );
+    if ( reader.source->gcount() == 0 )
+        return false;
+    size_t recordLength = static_cast<size_t>( lengths[0] ) + lengths[1];
+    if ( reader.record.size() < recordLength )
+        reader.record.resize( recordLength );
+    if ( reader.source->gcount() == sizeof( lengths ) && lengths[0] >= 24 )
+        reader.source->read( reinterpret_cast<char*>( &reader.record[0] ), recordLength );
+    if ( lengths[0] < 24 || reader.source->gcount() != static_cast<streamsize>( recordLength ) ) {
+        cout << "\nError in readBCFrecord():\n\ta record of the BCF file is truncated or malformed.\n\tAborting ... \n\n";
+        abortRun(-5);
+    }
+    const unsigned char *cursor = &reader.record[0], *sharedEnd = cursor + lengths[0], *end = cursor + recordLength;
+    int32_t CHROM, POS;
+    uint32_t QUAL, alleleINFOcounts, formatSampleCounts;
+    float QUALvalue;
+    memcpy( &CHROM, cursor, sizeof( CHROM ) );
+    memcpy( &POS, cursor + 4, sizeof( POS ) );
+    memcpy( &QUAL, cursor + 12, sizeof( QUAL ) );
+    memcpy( &QUALvalue, cursor + 12, sizeof( QUALvalue ) );
+    memcpy( &alleleINFOcounts, cursor + 16, sizeof( alleleINFOcounts ) );
+    memcpy( &formatSampleCounts, cursor + 20, sizeof( formatSampleCounts ) );
+    cursor += 24;
+    int numAlleles = alleleINFOcounts >> 16, numINFO = alleleINFOcounts & 0xFFFF;
+    int numFORMAT = formatSampleCounts >> 24, recordSamples = formatSampleCounts & 0xFFFFFF;
+    if ( CHROM < 0 || CHROM >= static_cast<int32_t>( reader.contigs.size() ) || recordSamples != numSamples ) {
+        cout << "\nError in readBCFrecord():\n\ta record of the BCF file has a CHROM that is not in its header, or\n\t";
+        cout << recordSamples << " samples instead of numSamples = " << numSamples << ".\n\tAborting ... \n\n";
+        abortRun(-5);
+    }
+
+    string& text = reader.metaColumns;
+    char number[32];
+    int type, count;
+    text = reader.contigs[CHROM];
+    snprintf( number, sizeof( number ), "\t%d\t", POS + 1 );   // BCF positions start at 0
+    text += number;
+    // ID, REF and ALT are typed strings:
+    for ( int i = 0; i <= numAlleles; i++ ) {
+        readBCFtype( cursor, sharedEnd, type, count );
+        if ( count > 0 && type != BCF_TYPE_CHAR ) {
+            cout << "\nError in readBCFrecord():\n\ta record of the BCF file has an ID or allele that is not a string.\n\tAborting ... \n\n";
+            abortRun(-5);
+        }
+        if ( i > 2 )
+            text += ',';
+        if ( i == 0 && count == 0 )
+            text += '.';    // no ID
+        else
+            appendBCFvalues( text, cursor, sharedEnd, BCF_TYPE_CHAR, count );
+        if ( i < 2 )
+            text += '\t';
+    }
+    if ( numAlleles < 2 )
+        text += '.';    // no ALT
+    if ( QUAL == BCF_FLOAT_MISSING )
+        snprintf( number, sizeof( number ), "\t.\t" );
+    else
+        snprintf( number, sizeof( number ), "\t%g\t", QUALvalue );
+    text += number;
+    // FILTER is a vector of keys:
+    readBCFtype( cursor, sharedEnd, type, count );
+    if ( count == 0 )
+        text += '.';
+    for ( int i = 0; i < count; i++ ) {
+        int32_t key = ( type >= BCF_TYPE_INT8 && type <= BCF_TYPE_INT32 && sharedEnd - cursor >= BCF_TYPE_SIZES[type] ) ? getBCFint( cursor, type ) : -1;
+        if ( key < 0 || key >= static_cast<int32_t>( reader.dictionary.size() ) ) {
+            cout << "\nError in readBCFrecord():\n\ta record of the BCF file has a FILTER that is not in its header.\n\tAborting ... \n\n";
+            abortRun(-5);
+        }
+        if ( i > 0 )
+            text += ';';
+        text += reader.dictionary[key];
+        cursor += BCF_TYPE_SIZES[type];
+    }
+    text += '\t';
+    // INFO is key, value pairs; flags have no value:
+    if ( numINFO == 0 )
+        text += '.';
+    for ( int i = 0; i < numINFO; i++ ) {
+        if ( i > 0 )
+            text += ';';
+        text += reader.dictionary[ readBCFkey( reader, cursor, sharedEnd ) ];
+        readBCFtype( cursor, sharedEnd, type, count );
+        if ( count > 0 ) {
+            text += '=';
+            appendBCFvalues( text, cursor, sharedEnd, type, count );
+        }
+    }
+    text += '\t';
+
+    // FORMAT is key, array pairs, each array holding count values per sample:
+    reader.GT.data = reader.DP.data = reader.GQ.data = NULL;
+    cursor = sharedEnd;
+    for ( int i = 0; i < numFORMAT; i++ ) {
+        int key = readBCFkey( reader, cursor, end );
+        readBCFtype( cursor, end, type, count );
+        size_t arrayLength = static_cast<size_t>( count ) * BCF_TYPE_SIZES[type] * numSamples;
+        if ( static_cast<size_t>( end - cursor ) < arrayLength || ( ( key == reader.GTkey || key == reader.DPkey || key == reader.GQkey ) && ( type < BCF_TYPE_INT8 || type > BCF_TYPE_INT32 || count == 0 ) ) ) {
+            cout << "\nError in readBCFrecord():\n\ta record of the BCF file is truncated, or its " << reader.dictionary[key] << " is not an Integer.\n\tAborting ... \n\n";
+            abortRun(-5);
+        }
+        BCFfield *field = ( key == reader.GTkey ) ? &reader.GT : ( key == reader.DPkey ) ? &reader.DP : ( key == reader.GQkey ) ? &reader.GQ : NULL;
+        if ( field ) {
+            field->data = cursor;
+            field->type = type;
+            field->count = count;
+        }
+        if ( i > 0 )
+            text += formatDelim;
+        text += reader.dictionary[key];
+        cursor += arrayLength;
+    }
+    line = &text[0];
+    return true;
+}
+
+
+void readBCFtype( const unsigned char*& cursor, const unsigned char* end, int& type, int& count )
+{
+    // reads the descriptor of a typed value: the type is in the low 4 bits, and the
+    // count in the high 4, where 15 means that the count follows as a typed integer
+    bool valid = cursor < end;
+    if ( valid ) {
+        type = *cursor & 0x0F;
+        count = *cursor >> 4;
+        cursor++;
+        if ( count == 15 ) {
+            int countType = ( cursor < end ) ? ( *cursor & 0x0F ) : 0;
+            valid = countType >= BCF_TYPE_INT8 && countType <= BCF_TYPE_INT32 && ( *cursor >> 4 ) == 1 && end - cursor > BCF_TYPE_SIZES[countType];
+            if ( valid ) {
+                count = getBCFint( cursor + 1, countType );
+                cursor += 1 + BCF_TYPE_SIZES[countType];
+                valid = ( count >= 0 );
+            }
+        }
+        // a flag's value is an empty vector of type 0:
+        valid = valid && type < 8 && ( BCF_TYPE_SIZES[type] > 0 || count == 0 );
+    }
+    if ( !valid ) {
+        cout << "\nError in readBCFtype():\n\ta record of the BCF file is truncated or malformed.\n\tAborting ... \n\n";
+        abortRun(-5);
+    }
+}
+
+
+bool readBGZFblockSizes( ifstream& compressedFile, unsigned long long blockStart, unsigned long long& blockSize, unsigned long long& dataSize )
+{
+    // reads the compressed and uncompressed sizes of the BGZF block at blockStart from
+    // its header and footer; false if there is no BGZF block there
+    unsigned char header[18], footer[4];
+    compressedFile.clear();
+    compressedFile.seekg( static_cast<streamoff>( blockStart ) );
+    compressedFile.read( reinterpret_cast<char*>( header ), sizeof( header ) );
+    // gzip magic, FEXTRA set, and a 'BC' subfield holding the block size:
+    if ( !compressedFile.good() || header[0] != 31 || header[1] != 139 || !( header[3] & 4 ) || header[12] != 'B' || header[13] != 'C' || header[14] != 2 )
+        return false;
+    blockSize = ( header[16] | ( header[17] << 8 ) ) + 1;
+    compressedFile.seekg( static_cast<streamoff>( blockStart + blockSize - sizeof( footer ) ) );
+    compressedFile.read( reinterpret_cast<char*>( footer ), sizeof( footer ) );
+    if ( !compressedFile.good() )
+        return false;
+    dataSize = footer[0] | ( footer[1] << 8 ) | ( footer[2] << 16 ) | ( static_cast<unsigned long long>( footer[3] ) << 24 );
+    return true;
+}
+
+
+void readCheckpoint( Checkpoint& checkpoint, string vcfName, PopulationDesignation* designations, int numDesignations )
+{
+    // reads the checkpoint written by writeCheckpoint(), checks that it belongs to this
+    // command and this VCF, and truncates the output files to the sizes it recorded.
+    // The summary files are reopened for appending; parseActualData() does the same
+    // for the discarded-lines file
+    string checkpointName = vcfName + CHECKPOINT_SUFFIX;
+    string line, label, fileName, CHROM;
+    unsigned long long fileSize, checkpointFileSize, size;
+    long long fileModTime, checkpointFileModTime;
+    size_t numEntries;
+    int d;
+
+    ifstream checkpointFile( checkpointName );
+    if ( !checkpointFile.good() ) {
+        cout << "\nError in readCheckpoint():\n\tno checkpoint " << checkpointName << " to resume from.\n\t--> Please run again without --resume.\n\tExiting ... \n\n";
+        abortRun( -1 );
+    }
+    getline( checkpointFile, line );
+    if ( line != CHECKPOINT_HEADER ) {
+        cout << "\nError in readCheckpoint():\n\t" << checkpointName << " is not a checkpoint this version can read.\n\tExiting ... \n\n";
+        abortRun( -1 );
+    }
+    getline( checkpointFile, line );
+    if ( line != "commandLine\t" + COMMAND_LINE ) {
+        cout << "\nError in readCheckpoint():\n\t" << checkpointName << " was written by a different command:\n\t" << line.substr( line.find( '\t' ) + 1 ) << "\n";
+        cout << "\t--> Please resume with the same arguments, plus --resume.\n\tExiting ... \n\n";
+        abortRun( -1 );
+    }
+    checkpointFile >> label >> checkpointFileSize >> checkpointFileModTime;
+    if ( !getSourceFileStats( vcfName, fileSize, fileModTime ) || fileSize != checkpointFileSize || fileModTime != checkpointFileModTime ) {
+        cout << "\nError in readCheckpoint():\n\t" << vcfName << " has changed since " << checkpointName << " was written.\n\t--> Please run again without --resume.\n\tExiting ... \n\n";
+        abortRun( -1 );
+    }
+    checkpointFile >> label >> checkpoint.dataStart >> checkpoint.inputOffset >> checkpoint.virtualOffset;
+    checkpointFile >> label >> checkpoint.VCFfileLineCount >> checkpoint.SNPcount;
+    checkpointFile >> label >> checkpoint.checkFormat >> checkpoint.lookForDP >> checkpoint.lookForGQ >> checkpoint.lookForPL >> checkpoint.lookForDPinINFO;
+    checkpointFile >> checkpoint.numTokensInFormat >> checkpoint.GTtoken >> checkpoint.DPtoken >> checkpoint.GQtoken >> checkpoint.PLtoken >> numEntries;
+    checkpoint.formatOpsOrder.resize( numEntries );
+    for ( size_t i = 0; i < numEntries; i++ )
+        checkpointFile >> checkpoint.formatOpsOrder[i];
+    checkpointFile >> label >> size;
+    if ( !checkpointFile.good() || label != "discarded" ) {
+        cout << "\nError in readCheckpoint():\n\t" << checkpointName << " is damaged.\n\tExiting ... \n\n";
+        abortRun( -1 );
+    }
+    truncateOutputFile( vcfName + "_discardedLineNums.txt", size );
+
+    // then one entry per population designation, or per CHROM file with --split-by-chrom:
+    while ( checkpointFile >> label && label != "end" ) {
+        checkpointFile >> d;
+        if ( d < 0 || d >= numDesignations )
+            break;
+        PopulationDesignation& designation = designations[d];
+        if ( label == "summary" ) {
+            checkpointFile >> size;
+            truncateOutputFile( designation.outputFileName, size );
+            designation.outputFile.open( designation.outputFileName, ofstream::app );
+        } else if ( label == "chrom" ) {
+            ChromOutputFile chromFile;
+            checkpointFile >> chromFile.CHROM >> chromFile.numRows >> chromFile.minPOS >> chromFile.maxPOS >> size;
+            chromFile.fileName = designation.outputFileName;
+            chromFile.fileName.insert( chromFile.fileName.rfind( "_Unfiltered_Summary.tsv" ), "_" + chromFile.CHROM );
+            truncateOutputFile( chromFile.fileName, size );
+            designation.chromFileIndex[ chromFile.CHROM ] = static_cast<int>( designation.chromFiles.size() );
+            designation.chromFiles.push_back( chromFile );
+        } else {
+            break;
+        }
+    }
+    if ( label != "end" ) {
+        cout << "\nError in readCheckpoint():\n\t" << checkpointName << " is damaged.\n\tExiting ... \n\n";
+        abortRun( -1 );
+    }
+    cout << "\nResuming from " << checkpointName << " at VCF line " << checkpoint.VCFfileLineCount + 1 << endl;
+}
+
+
+bool readRecordIndex( string vcfName, vector<RecordIndexEntry>& entries )
+{
+    // reads the index written by buildRecordIndex(), if there is one and the VCF
+    // hasn't changed since; an out-of-date index is reported and ignored
+    string indexName = vcfName + RECORD_INDEX_SUFFIX;
+    string line, label;
+    unsigned long long fileSize, indexedFileSize;
+    long long fileModTime, indexedFileModTime;
+    RecordIndexEntry entry;
+
+    entries.clear();
+    ifstream indexFile( indexName );
+    if ( !indexFile.good() )
+        return false;   // no index; nothing to report
+    getline( indexFile, line );
+    if ( line != RECORD_INDEX_HEADER ) {
+        cout << "\n*** WARNING!  " << indexName << " is not a record index this version can read; it is ignored.\n";
+        return false;
+    }
+    indexFile >> label >> indexedFileSize >> indexedFileModTime;
+    if ( !getSourceFileStats( vcfName, fileSize, fileModTime ) || fileSize != indexedFileSize || fileModTime != indexedFileModTime ) {
+        cout << "\n*** WARNING!  " << vcfName << " has changed since " << indexName << " was built; the index is ignored.\n";
+        cout << "Run with --build-index again to use it.\n";
+        return false;
+    }
+    getline( indexFile, line );     // rest of the VCF line
+    getline( indexFile, line );     // interval
+    getline( indexFile, line );     // column names
+    while ( indexFile >> entry.offset ) {
+        indexFile >> entry.VCFlineNum >> entry.CHROM >> entry.POS;
+        entries.push_back( entry );
+    }
+    return !entries.empty();
+}
+
+
+bool readVCFheader( istream& VCFfile, string vcfName, int numSamples, PopulationDesignation* designations, int numDesignations, string* sampleIDs, unsigned long int& VCFfileLineCount, int& firstDataLineNumber, BCFreader& BCF )
+{
+    // reads the header of a VCF, or of a .bcf into BCF (whose source is left NULL
+    // otherwise), and assigns each sample column to a population
+    bool success;
+    BCF.source = NULL;
+    if ( vcfName.substr( vcfName.find_last_of( "." ) ) == ".bcf" ) {
+        // the header of a BCF is the text of a VCF header:
+        string headerText;
+        readBCFheader( VCFfile, BCF, headerText, vcfName );
+        istringstream header( headerText );
+        success = assignSamplesToPopulations(header, numSamples, designations, numDesignations, sampleIDs, VCFfileLineCount, firstDataLineNumber);
+    } else {
+        success = assignSamplesToPopulations(VCFfile, numSamples, designations, numDesignations, sampleIDs, VCFfileLineCount, firstDataLineNumber);
+    }
+    checkSampleColumns( sampleIDs, numSamples, vcfName );
+    return success;
+}
+
+
+bool readVCFline( VCFlineReader& reader, char*& line, size_t& lineLength )
+{
+    // sets line to the next line of the source, with its '\n' replaced by '\0', and
+    // returns false at the end of the source.  line points into reader.block and is
+    // only valid until the next call.  A line that runs past the end of the block is
+    // moved to the front of it and completed by the next read; if one line is longer
+    // than the whole block, the block is doubled
+    char *newline;
+    while ( true ) {
+        newline = static_cast<char*>( memchr( reader.block + reader.scanned, '\n', reader.end - reader.scanned ) );
+        if ( newline != NULL ) {
+            *newline = '\0';
+            line = reader.block + reader.start;
+            lineLength = newline - line;
+            reader.start = reader.scanned = ( newline - reader.block ) + 1;
+            return true;
+        }
+        reader.scanned = reader.end;
+        if ( reader.sourceDone ) {
+            if ( reader.start == reader.end )
+                return false;
+            // last line of a file that doesn't end with '\n'; reads always leave a byte for the '\0':
+            line = reader.block + reader.start;
+            lineLength = reader.end - reader.start;
+            line[lineLength] = '\0';
+            reader.start = reader.scanned = reader.end;
+            return true;
+        }
+
+        // keep the incomplete line, and read more behind it:
+        if ( reader.start > 0 ) {
+            reader.blockOffset += reader.start;
+            memmove( reader.block, reader.block + reader.start, reader.end - reader.start );
+            reader.end -= reader.start;
+            reader.scanned = reader.end;
+            reader.start = 0;
+        }
+        if ( reader.end + 1 >= reader.blockSize ) {
+            char *biggerBlock = new char[ 2 * reader.blockSize ];
+            memcpy( biggerBlock, reader.block, reader.end );
+            delete[] reader.block;
+            reader.block = biggerBlock;
+            reader.blockSize *= 2;
+        }
+        reader.source->read( reader.block + reader.end, reader.blockSize - reader.end - 1 );
+        reader.end += reader.source->gcount();
+        if ( reader.source->bad() ) {
+            cout << "\nError in readVCFline():\n\treading the VCF failed.\n\tAborting ... \n\n";
+            abortRun(-4);
+        }
+        if ( !reader.source->good() )
+            reader.sourceDone = true;
+    }
+}
+
+
+CPU_DISPATCH void reduceGenotypeBatch( GenotypeBatch& batch, int* populationReference, int numPopulations, int* popCodeCounts )
+{
+    // counts each GT code in each population for every SNP of the batch, into
+    // popCodeCounts ( numPopulations * NUM_GT_CODES per SNP ).  The samples are taken
+    // one block at a time, so the block's population indexes are read once for the
+    // whole batch and stay in cache, next to the block of each genotype row
+    int stride = numPopulations * NUM_GT_CODES;
+    int slots[GENOTYPE_BATCH_SAMPLE_BLOCK];     // population index * NUM_GT_CODES of each sample in the block
+    for ( int i = 0; i < batch.numRecords * stride; i++ )
+        popCodeCounts[i] = 0;
+    for ( int blockStart = 0; blockStart < batch.numSamples; blockStart += GENOTYPE_BATCH_SAMPLE_BLOCK ) {
+        int blockSize = min( GENOTYPE_BATCH_SAMPLE_BLOCK, batch.numSamples - blockStart );
+        for ( int i = 0; i < blockSize; i++ )
+            slots[i] = populationReference[ blockStart + i ] * NUM_GT_CODES;
+        for ( int r = 0; r < batch.numRecords; r++ ) {
+            const char *codes = batch.genotypeCodes.data() + static_cast<size_t>( r ) * batch.numSamples + blockStart;
+            int *counts = popCodeCounts + r * stride;
+            for ( int i = 0; i < blockSize; i++ )
+                counts[ slots[i] + codes[i] ]++;
+        }
+    }
+}
+
+
+void reportSNPsummary( PopulationDesignation& designation, int designationIndex, unsigned long int VCFfileLineCount, char* CHROM, char* POS, char* ID, char* REF, char* ALT, char* QUAL, int medianDP, int medianGQ, int homoRefCount, int hetCount, int homoAltCount, int altAlleleCounts[], int validSampleCounts[] )
+{
+    // hands one row of a summary to the library's callback (see vss_summarize());
+    // MEDIAN_NOT_AVAILABLE is INT_MIN, the same value as VSS_MISSING
+    vss_snp_summary summary;
+    summary.designation = designationIndex;
+    summary.VCFlineNum = VCFfileLineCount;
+    summary.CHROM = CHROM;
+    summary.POS = POS;
+    summary.ID = ID;
+    summary.REF = REF;
+    summary.ALT = ALT;
+    summary.QUAL = QUAL;
+    summary.medianDP = medianDP;
+    summary.medianGQ = medianGQ;
+    summary.homoRefCount = homoRefCount;
+    summary.hetCount = hetCount;
+    summary.homoAltCount = homoAltCount;
+    summary.numPopulations = designation.numPopulations;
+    summary.populationNames = designation.populationNames.data();
+    summary.altAlleleCounts = altAlleleCounts;
+    summary.rawAlleleCounts = validSampleCounts;
+    int status = SNP_SUMMARY_CALLBACK( &summary, SNP_SUMMARY_USER_DATA );
+    if ( status != 0 )
+        abortRun( status );
+}
+
+
+void runSampleThread( SampleThreadPool* pool, int chunkIndex )
+{
+    // a --sample-threads worker: does its chunk of each line that decodeSampleChunks() hands out
+    unsigned long int doneRound = 0;
+    while ( true ) {
+        {
+            unique_lock<mutex> guard( pool->lock );
+            pool->startWork.wait( guard, [pool, doneRound] { return pool->stop || pool->round != doneRound; } );
+            if ( pool->stop )
+                return;
+            doneRound = pool->round;
+        }
+        decodeSampleChunk( *pool, chunkIndex );
+        {
+            lock_guard<mutex> guard( pool->lock );
+            if ( --pool->chunksLeft == 0 )
+                pool->workDone.notify_one();
+        }
+    }
+}
+
+
+void selectChromOutputFile( PopulationDesignation& designation, char* CHROM, char* POS )
+{
+    // for --split-by-chrom: makes designation.outputFile the summary file of CHROM,
+    // creating it (with its header) the first time CHROM turns up, and records the
+    // row that is about to be written in CHROM's entry for the index file.
+    // Only one file per designation is open at a time; in a sorted VCF each one is
+    // opened once, and a CHROM that comes back later is appended to its file
+    int current = designation.currentChromFile;
+    if ( current < 0 || strcmp( designation.chromFiles[current].CHROM.c_str(), CHROM ) != 0 ) {
+        if ( current >= 0 )
+            designation.outputFile.close();
+        map<string, int>::iterator found = designation.chromFileIndex.find( CHROM );
+        if ( found == designation.chromFileIndex.end() ) {
+            if ( strchr( CHROM, '/' ) ) {
+                cout << "\nError in selectChromOutputFile():\n\tCHROM '" << CHROM << "' contains '/', so it can't be part of a file name.\n";
+                cout << "\t--> Please run without --split-by-chrom.\n\tExiting ... \n\n";
+                abortRun( -4 );
+            }
+            ChromOutputFile chromFile;
+            chromFile.CHROM = CHROM;
+            chromFile.fileName = designation.outputFileName;
+            chromFile.fileName.insert( chromFile.fileName.rfind( "_Unfiltered_Summary.tsv" ), "_" + chromFile.CHROM );
+            chromFile.numRows = 0;
+            chromFile.minPOS = LONG_MAX;
+            chromFile.maxPOS = LONG_MIN;
+            current = static_cast<int>( designation.chromFiles.size() );
+            designation.chromFiles.push_back( chromFile );
+            designation.chromFileIndex[ chromFile.CHROM ] = current;
+            setUpOutputFile( designation.outputFile, chromFile.fileName, designation.numPopulations, designation.mapOfPopulations );
+        } else {
+            current = found->second;
+            designation.outputFile.open( designation.chromFiles[current].fileName, ofstream::app );
+            if ( designation.outputFile.fail() ) {
+                cout << "\nError in selectChromOutputFile():\n\tcould not reopen " << designation.chromFiles[current].fileName << "\n\tAborting ... \n\n";
+                abortRun( -4 );
+            }
+        }
+        designation.currentChromFile = current;
+    }
+    ChromOutputFile& chromFile = designation.chromFiles[current];
+    long int position = atol( POS );
+    chromFile.numRows++;
+    if ( position < chromFile.minPOS )
+        chromFile.minPOS = position;
+    if ( position > chromFile.maxPOS )
+        chromFile.maxPOS = position;
+}
+
+
+void sendServedFile( int fd, string fileName )
+{
+    // --serve: sends a summary file as part of the reply to a request, after a
+    // line naming it
+    string line = "##summary\t" + fileName + "\n";
+    char block[65536];
+    ifstream summaryFile( fileName, ios_base::in | ios_base::binary );
+    if ( !writeToSocket( fd, line.data(), line.length() ) )
+        return;
+    while ( summaryFile.read( block, sizeof( block ) ) || summaryFile.gcount() > 0 ) {
+        if ( !writeToSocket( fd, block, summaryFile.gcount() ) )
+            return;     // the client has gone
+    }
+}
+
+
+void serveRequests( string socketName )
+{
+    // --serve: answers requests on a Unix domain socket, one at a time, until
+    // "shutdown" is sent.  A request is one line of command-line arguments separated by
+    // tabs.  It is run by a forked child, like an ordinary run of the program, except
+    // that the genotype cache of its VCF comes from memory (see loadServedCache()),
+    // and the summary files are also sent back (see sendServedFile()).  The reply
+    // ends with '##status', a tab and the status the ordinary run would exit with.
+    // An error thus only ends the child, which also leaves the server's state as it was
+    int listenFd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    struct sockaddr_un address;
+    memset( &address, 0, sizeof( address ) );
+    address.sun_family = AF_UNIX;
+    if ( listenFd < 0 || socketName.length() >= sizeof( address.sun_path ) ) {
+        cout << "\nError in serveRequests():\n\tcan't make a socket named " << socketName << "\n\tAborting ... \n\n";
+        abortRun( -4 );
+    }
+    strcpy( address.sun_path, socketName.c_str() );
+    // a socket left over from an earlier server is replaced; anything else is kept:
+    struct stat pathInfo;
+    if ( lstat( socketName.c_str(), &pathInfo ) == 0 ) {
+        if ( !S_ISSOCK( pathInfo.st_mode ) ) {
+            cout << "\nError in serveRequests():\n\t" << socketName << " already exists and is not a socket\n\t--> Please name a new path for the socket.\n\tAborting ... \n\n";
+            abortRun( -4 );
+        }
+        unlink( socketName.c_str() );
+    }
+    if ( bind( listenFd, reinterpret_cast<struct sockaddr*>( &address ), sizeof( address ) ) != 0 || listen( listenFd, 16 ) != 0 ) {
+        cout << "\nError in serveRequests():\n\tcan't listen on " << socketName << ": " << strerror( errno ) << "\n\tAborting ... \n\n";
+        abortRun( -4 );
+    }
+    signal( SIGPIPE, SIG_IGN );     // a client that leaves early must not end the server
+    cout << "\nServing requests on " << socketName << ", with up to " << ( SERVE_MEMORY_BUDGET >> 20 ) << " MB of genotype caches in memory\n" << flush;
+
+    map<string, ServedCache> caches;    // by VCF name
+    unsigned long int requestNumber = 0;
+    bool stop = false;
+    while ( !stop ) {
+        int connection = accept( listenFd, NULL, NULL );
+        if ( connection < 0 ) {
+            if ( errno == EINTR )
+                continue;
+            cout << "\nError in serveRequests():\n\taccept() failed: " << strerror( errno ) << "\n\tAborting ... \n\n";
+            abortRun( -4 );
+        }
+        chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+        requestNumber++;
+
+        // the request, up to its newline:
+        string request;
+        char block[4096];
+        ssize_t bytesRead;
+        while ( request.find( '\n' ) == string::npos && ( bytesRead = read( connection, block, sizeof( block ) ) ) > 0 )
+            request.append( block, bytesRead );
+        request = request.substr( 0, request.find( '\n' ) );
+        if ( !request.empty() && request[ request.length() - 1 ] == '\r' )
+            request.erase( request.length() - 1 );
+        vector<string> arguments( 1, "VCFtoSummStats" );
+        size_t start = 0, tab;
+        do {
+            tab = request.find( '\t', start );
+            string argument = request.substr( start, tab == string::npos ? string::npos : tab - start );
+            if ( !argument.empty() )
+                arguments.push_back( argument );
+            start = tab + 1;
+        } while ( tab != string::npos );
+
+        int status = 0;
+        if ( arguments.size() == 2 && arguments[1] == "shutdown" ) {
+            stop = true;
+        } else {
+            // the VCF of a request that names exactly one:
+            string vcfName;
+            int numVCFs = 0;
+            for ( size_t i = 1; i < arguments.size(); i++ ) {
+                if ( arguments[i] == "-V" && i + 1 < arguments.size() ) {
+                    vcfName = arguments[++i];
+                    numVCFs++;
+                } else if ( arguments[i].compare( 0, 2, "-V" ) == 0 && arguments[i].length() > 2 ) {
+                    vcfName = arguments[i].substr( 2 );
+                    numVCFs++;
+                } else if ( arguments[i] == "--vcf-list" ) {
+                    numVCFs += 2;
+                }
+            }
+            ServedCache *served = ( numVCFs == 1 ) ? loadServedCache( caches, vcfName, requestNumber ) : NULL;
+
+            cout.flush();
+            pid_t child = fork();
+            if ( child < 0 ) {
+                cout << "\nError in serveRequests():\n\tfork() failed: " << strerror( errno ) << "\n\tAborting ... \n\n";
+                abortRun( -4 );
+            }
+            if ( child == 0 ) {
+                close( listenFd );
+                SERVE_REPLY_FD = connection;
+                SERVE_CACHE_DATA = served ? served->bytes.data() : NULL;
+                SERVE_CACHE_LENGTH = served ? served->bytes.size() : 0;
+                vector<char*> argv( arguments.size() + 1, NULL );
+                for ( size_t i = 0; i < arguments.size(); i++ )
+                    argv[i] = &arguments[i][0];
+                exit( summarizeVCF( static_cast<int>( arguments.size() ), argv.data() ) );
+            }
+            int childStatus;
+            while ( waitpid( child, &childStatus, 0 ) < 0 && errno == EINTR )
+                ;
+            // exit statuses are 8 bits, so that e.g. abortRun(-2) arrives as 254:
+            status = WIFEXITED( childStatus ) ? static_cast<signed char>( WEXITSTATUS( childStatus ) ) : -128 - WTERMSIG( childStatus );
+        }
+        string statusLine = "##status\t" + to_string( status ) + "\n";
+        writeToSocket( connection, statusLine.data(), statusLine.length() );
+        close( connection );
+        replace( request.begin(), request.end(), '\t', ' ' );
+        cout << "Request " << requestNumber << " (" << request << "): status " << status << ", ";
+        cout << chrono::duration_cast<chrono::microseconds>( chrono::steady_clock::now() - startTime ).count() / 1000.0 << " ms\n" << flush;
+    }
+    close( listenFd );
+    unlink( socketName.c_str() );
+}
+
+
+void setUpGenotypeBatch( GenotypeBatch& batch, int numSamples )
+{
+    // --record-batch: room for GENOTYPE_BATCH_RECORDS SNPs
+    batch.capacity = GENOTYPE_BATCH_RECORDS;
+    batch.numRecords = 0;
+    batch.numSamples = numSamples;
+    batch.genotypeCodes.resize( static_cast<size_t>( batch.capacity ) * numSamples );
+    batch.lineNumbers.resize( batch.capacity );
+    batch.medianDPs.resize( batch.capacity );
+    batch.medianGQs.resize( batch.capacity );
+    batch.metaFields.assign( batch.capacity * 6, string() );
+    batch.INFOcolumns.assign( batch.capacity, string() );
+}
+
+
+void setUpHWEtable()
+{
+    // p-values for every genotype count triple with at most HWE_TABLE_MAX_SAMPLES
+    // genotypes, indexed by ( homoRef, het, homoAlt ); see lookUpHWEpvalue()
+    int side = HWE_TABLE_MAX_SAMPLES + 1;
+    HWE_SMALL_TABLE.assign( side * side * side, std::numeric_limits<double>::quiet_NaN() );
+    for ( int homoRef = 0; homoRef <= HWE_TABLE_MAX_SAMPLES; homoRef++ ) {
+        for ( int het = 0; homoRef + het <= HWE_TABLE_MAX_SAMPLES; het++ ) {
+            for ( int homoAlt = 0; homoRef + het + homoAlt <= HWE_TABLE_MAX_SAMPLES; homoAlt++ ) {
+                HWE_SMALL_TABLE[ ( homoRef * side + het ) * side + homoAlt ] = calculateHWEpvalue( homoRef, het, homoAlt );
+            }
+        }
+    }
+}
+
+
+bool setUpIOuring( ReadAheadState* state )
+{
+    // sets up an io_uring for --read-ahead, with the buffers registered so the kernel
+    // doesn't map them for every read.  Returns false if io_uring can't be used (no
+    // support, a kernel before 5.6 without IORING_OP_READ, or not allowed in a
+    // container), and prefetchWithPread() reads instead
+#ifdef HAVE_IO_URING
+    struct io_uring_params params;
+    memset( &params, 0, sizeof( params ) );
+    int ringFd = static_cast<int>( syscall( __NR_io_uring_setup, state->depth, &params ) );
+    if ( ringFd < 0 )
+        return false;
+    if ( !( params.features & IORING_FEAT_RW_CUR_POS ) ) {   // came with IORING_OP_READ
+        close( ringFd );
+        return false;
+    }
+    state->sqRingSize = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+    state->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof( struct io_uring_cqe );
+    if ( params.features & IORING_FEAT_SINGLE_MMAP )
+        state->sqRingSize = state->cqRingSize = max( state->sqRingSize, state->cqRingSize );
+    state->sqesSize = params.sq_entries * sizeof( struct io_uring_sqe );
+    state->sqRing = mmap( NULL, state->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING );
+    state->cqRing = state->sqRing;
+    if ( state->sqRing != MAP_FAILED && !( params.features & IORING_FEAT_SINGLE_MMAP ) )
+        state->cqRing = mmap( NULL, state->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING );
+    void *sqes = MAP_FAILED;
+    if ( state->cqRing != MAP_FAILED )
+        sqes = mmap( NULL, state->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES );
+    if ( sqes == MAP_FAILED ) {
+        if ( state->cqRing != MAP_FAILED && state->cqRing != state->sqRing )
+            munmap( state->cqRing, state->cqRingSize );
+        if ( state->sqRing != MAP_FAILED )
+            munmap( state->sqRing, state->sqRingSize );
+        close( ringFd );
+        return false;
+    }
+    char *sq = static_cast<char*>( state->sqRing ), *cq = static_cast<char*>( state->cqRing );
+    state->sqes = static_cast<struct io_uring_sqe*>( sqes );
+    state->sqTail = reinterpret_cast<unsigned*>( sq + params.sq_off.tail );
+    state->sqMask = reinterpret_cast<unsigned*>( sq + params.sq_off.ring_mask );
+    state->sqArray = reinterpret_cast<unsigned*>( sq + params.sq_off.array );
+    state->cqHead = reinterpret_cast<unsigned*>( cq + params.cq_off.head );
+    state->cqTail = reinterpret_cast<unsigned*>( cq + params.cq_off.tail );
+    state->cqMask = reinterpret_cast<unsigned*>( cq + params.cq_off.ring_mask );
+    state->cqes = reinterpret_cast<struct io_uring_cqe*>( cq + params.cq_off.cqes );
+
+    // registering can fail, e.g. over RLIMIT_MEMLOCK; plain reads work without it
+    struct iovec *buffers = new struct iovec[state->depth];
+    for ( int b = 0; b < state->depth; b++ ) {
+        buffers[b].iov_base = state->buffers[b].data();
+        buffers[b].iov_len = READ_AHEAD_BUFFER_SIZE;
+    }
+    state->fixedBuffers = ( syscall( __NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, buffers, state->depth ) == 0 );
+    delete[] buffers;
+    state->ringFd = ringFd;
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+void setUpLD( LDwindow& LD, int numSamples, PopulationDesignation* designations, int numDesignations )
+{
+    // opens one LD file per population designation, next to its summary file, and
+    // builds the population masks; populationReference must already be filled in
+    LD.numSamples = numSamples;
+    LD.numWords = ( numSamples + 63 ) / 64;
+    LD.capacity = LD_WINDOW_SNPS ? LD_WINDOW_SNPS : 64; // grows if only --ld-bp limits the window
+    LD.first = LD.count = 0;
+    LD.planes.assign( static_cast<size_t>( LD.capacity + 1 ) * 3 * LD.numWords, 0 ); // the last slot holds the newest SNP
+    LD.positions.assign( LD.capacity, 0 );
+    LD.CHROM = "";
+
+    for ( int d = 0; d < numDesignations; d++ ) {
+        PopulationDesignation& designation = designations[d];
+        int numPopulations = designation.numPopulations;
+        designation.populationMasks.assign( static_cast<size_t>( numPopulations ) * LD.numWords, 0 );
+        for ( int i = 0; i < numSamples; i++ ) {
+            designation.populationMasks[ designation.populationReference[i] * LD.numWords + ( i >> 6 ) ] |= static_cast<uint64_t>( 1 ) << ( i & 63 );
+        }
+
+        string LDfileName = designation.outputFileName;
+        size_t suffix = LDfileName.rfind( "_Unfiltered_Summary.tsv" );
+        LDfileName = LDfileName.substr( 0, suffix ) + ( LD_BIN_WIDTH ? "_LDdecay.tsv" : "_LD.tsv" );
+        designation.LDfile.open( LDfileName, ofstream::out );
+        if ( designation.LDfile.fail() ) {
+            cout << "\nError in setUpLD():\n\tcould not open " << LDfileName << "\n\t--> Please make sure you have write access to the data file directory.\n\tAborting ... \n\n";
+            abortRun(-4);
+        }
+        designation.LDfile << ( LD_BIN_WIDTH ? "binStart\tbinEnd" : "CHROM\tPOS1\tPOS2\tdistance" );
+        // map order is population index order (see setUpOutputFile()):
+        for ( map<string, int>::const_iterator it = designation.mapOfPopulations.begin(); it != designation.mapOfPopulations.end(); it++ ) {
+            if ( LD_BIN_WIDTH )
+                designation.LDfile << "\tnumPairs_" << it->first << "\tmeanR2_" << it->first << "\tmeanDprime_" << it->first;
+            else
+                designation.LDfile << "\tr2_" << it->first << "\tDprime_" << it->first;
+        }
+        designation.LDfile << endl;
+        designation.LDbinR2sums.clear();
+        designation.LDbinDprimeSums.clear();
+        designation.LDbinPairs.clear();
+    }
+}
+
+
+void setUpSFS( PopulationDesignation& designation, int numSamplesPerPopulation[] )
+{
+    // gives each population its --sfs projection size and allocates the spectra:
+    // one per population, and one joint spectrum per pair of those populations
+    int numPopulations = designation.numPopulations;
+    designation.SFSsizes.assign( numPopulations, 0 );
+    for ( map<string, int>::const_iterator it = designation.mapOfPopulations.begin(); it != designation.mapOfPopulations.end(); it++ ) {
+        int m = SFS_SIZE_ALL;
+        if ( SFS_SIZES_BY_POP.count( it->first ) )
+            m = SFS_SIZES_BY_POP[ it->first ];
+        if ( m > 2 * numSamplesPerPopulation[ it->second ] ) {
+            cout << "\nError in setUpSFS():\n\t--sfs projects population " << it->first << " to " << m << " alleles, but it only has ";
+            cout << numSamplesPerPopulation[ it->second ] << " diploid samples.\n\tExiting ... \n\n";
+            abortRun( -1 );
+        }
+        designation.SFSsizes[ it->second ] = m;
+    }
+    designation.SFS1D.resize( numPopulations );
+    designation.SFS1Dsites.assign( numPopulations, 0 );
+    for ( int pop = 0; pop < numPopulations; pop++ )
+        designation.SFS1D[pop].assign( designation.SFSsizes[pop] + 1, 0.0 );
+    for ( int pop1 = 0; pop1 < numPopulations; pop1++ ) {
+        for ( int pop2 = pop1 + 1; pop2 < numPopulations; pop2++ ) {
+            if ( designation.SFSsizes[pop1] && designation.SFSsizes[pop2] ) {
+                designation.SFSpairs.push_back( make_pair( pop1, pop2 ) );
+                designation.SFS2D.push_back( vector<double>( ( designation.SFSsizes[pop1] + 1 ) * ( designation.SFSsizes[pop2] + 1 ), 0.0 ) );
+            }
+        }
+    }
+    designation.SFS2Dsites.assign( designation.SFSpairs.size(), 0 );
+}
+
+
+void setUpOutputFile (ofstream& outputFile, string filename, int numPopulations, const map<string, int>& mapOfPopulations )
+{
+    string popHeader, popName, colHeaders, alleleCountHeader;
+    int popIndex;
+    map<string, int>::const_iterator it = mapOfPopulations.begin();
+
+    // open file for output
+    outputFile.open( filename, ofstream::out );
+    if ( outputFile.fail() ) {
+        cout << "\nError in setUpOutputFile():\n\toutputFile.fail()!\n\t--> Please make sure you have write access to the data file directory.\n\tAborting ... \n\n";
+        abortRun(-4);
+    }
+    // first several column headers:
+    colHeaders = PREVIEW_POINTS ? "approxVCFlineNum" : "VCFlineNum";    // see previewVCF()
+    colHeaders += "\tCHROM\tPOS\tID\tREF\tALT\tQUAL";
+    for ( size_t i = 0; i < INFO_OUTPUT_COLS.size(); i++ )
+        colHeaders += "\tINFO_" + INFO_KEYS.keys[ INFO_OUTPUT_COLS[i] ];
+    colHeaders += "\tmedianDP\tmedianGQ\thomoRefCount\thetCount\thomoAltCount";
+    // put first few headers in file:
+    outputFile << colHeaders;
+
+
+    // loop over populations:
+    popHeader = "\tALT_SNP_freq_";
+    alleleCountHeader = "\trawAlleleCount_";
+    for ( int i = 0; i < numPopulations; i++ ) {
+        popName = it->first;
+        popIndex = it->second;
+        if ( popIndex != i ) {
+            cout << "\nError in setUpOutputFile():\n\tmap isn't ordered as you expect!\n\tAborting ... \n\n";
+            abortRun(-4);
+        }
+        outputFile << popHeader << popName << alleleCountHeader << popName;
+        it++;
+    }
+    if ( HWE_TESTS ) {
+        // map order is population index order, as checked above:
+        for ( it = mapOfPopulations.begin(); it != mapOfPopulations.end(); it++ ) {
+            popName = it->first;
+            outputFile << "\thomoRefCount_" << popName << "\thetCount_" << popName << "\thomoAltCount_" << popName << "\tHWE_p_" << popName;
+        }
+    }
+    outputFile << endl;
+
+    //outputFile.close();
+
+}
+
+
+void setUpPlinkExport( PlinkExport& plink, int numSamples, string* sampleIDs, PopulationDesignation& designation )
+{
+    // --export-plink: writes the .fam, one line per sample column with its population
+    // in designation as the family ID, and opens the .bed, whose rows writePlinkSNP()
+    // adds in the order of the .bim
+    plink.prefix = PLINK_PREFIX;
+    plink.numBytes = ( numSamples + 3 ) / 4;
+    plink.packed.resize( plink.numBytes );
+    plink.numSNPs = 0;
+    ofstream famFile( plink.prefix + ".fam", ofstream::out );
+    plink.bim.open( plink.prefix + ".bim", ofstream::out );
+    plink.bed.open( plink.prefix + ".bed", ofstream::out | ofstream::binary );
+    if ( famFile.fail() || plink.bim.fail() || plink.bed.fail() ) {
+        cout << "\nError in setUpPlinkExport():\n\tcould not open " << plink.prefix << ".bed, .bim or .fam\n\t--> Please make sure you have write access to that directory.\n\tAborting ... \n\n";
+        abortRun(-4);
+    }
+    for ( int i = 0; i < numSamples; i++ )
+        famFile << designation.populationNames[ designation.populationReference[i] ] << "\t" << sampleIDs[i] << "\t0\t0\t0\t-9\n";
+    famFile.close();
+    plink.bed.write( reinterpret_cast<const char*>( PLINK_BED_MAGIC ), sizeof( PLINK_BED_MAGIC ) );
+}
+
+
+void setUpSampleStats( SampleStats& stats, int numSamples )
+{
+    stats.numSamples = numSamples;
+    stats.numSites = 0;
+    stats.calledCount.assign( numSamples, 0 );
+    stats.missingCount.assign( numSamples, 0 );
+    stats.hetCount.assign( numSamples, 0 );
+    stats.DPcount.assign( numSamples, 0 );
+    stats.DPsum.assign( numSamples, 0 );
+    stats.DPhistogram.assign( static_cast<size_t>( numSamples ) * SAMPLE_DP_HISTOGRAM_BINS, 0 );
+    stats.GQcount.assign( numSamples, 0 );
+    stats.GQsum.assign( numSamples, 0 );
+}
+
+
+void setUpSampleThreads( SampleThreadPool& pool, int numSamples, PopulationDesignation* designations, int numDesignations )
+{
+    // --sample-threads: one chunk per thread, but no chunk of fewer than
+    // SAMPLE_CHUNK_MIN samples; with a single chunk no workers are started
+    int numChunks = min( SAMPLE_THREADS, numSamples / SAMPLE_CHUNK_MIN );
+    if ( numChunks < 2 )
+        return;
+    pool.numSamples = numSamples;
+    pool.designations = designations;
+    pool.numDesignations = numDesignations;
+    pool.chunks.resize( numChunks );
+    for ( int k = 0; k < numChunks; k++ ) {
+        pool.chunks[k].status = 0;
+        pool.chunks[k].popCounts.resize( numDesignations );
+        for ( int d = 0; d < numDesignations; d++ )
+            pool.chunks[k].popCounts[d].assign( ( 2 + NUM_GT_CODES ) * designations[d].numPopulations, 0 );
+    }
+    pool.round = 0;
+    pool.stop = false;
+    for ( int k = 0; k < numChunks - 1; k++ )
+        pool.workers.push_back( thread( runSampleThread, &pool, k ) );
+    if ( VERBOSE )
+        cout << "\nThe sample columns of each line are decoded in " << numChunks << " chunks at the same time\n";
+}
+
+
+void summarizeFromCache( istream& cacheFile, string vcfName, int numSamples, PopulationDesignation* designations, int numDesignations )
+{
+    // replays a genotype cache written by --build-cache; produces the same
+    // outputs as parseActualData() would for the VCF the cache came from.
+    // After the header (see openGenotypeCacheForWriting()) each VCF data line has one record:
+    //   uint8 flags, double INFO DP (NaN when not used for filtering)
+    // and, for biallelic SNPs only (flags & CACHE_RECORD_IS_SNP):
+    //   CHROM, POS, ID, REF, ALT, QUAL as uint16 length + chars
+    //   (numSamples + 3)/4 bytes of 2-bit genotype codes
+    //   uint32 count of half calls, then (uint32 sample, uint8 code) for each
+    //   numSamples DP bytes if flags & CACHE_RECORD_HAS_DP, likewise for GQ
+    //   int32 medianDP, int32 medianGQ
+    uint64_t headerLineNumber;
+    uint32_t numSamplesInCache, nameLength, numExceptions, exceptionSample;
+    unsigned char flags, exceptionCode;
+    double DPval;
+    bool keepThis;
+    int32_t medians[2];
+
+    cacheFile.read( reinterpret_cast<char*>( &headerLineNumber ), sizeof( headerLineNumber ) );
+    cacheFile.read( reinterpret_cast<char*>( &numSamplesInCache ), sizeof( numSamplesInCache ) );
+    if ( !cacheFile.good() || static_cast<int>( numSamplesInCache ) != numSamples ) {
+        cout << "\nError in summarizeFromCache():\n\tgenotype cache has " << numSamplesInCache << " samples, but the population file has " << numSamples << ".\n";
+        cout << "--> Please check that your population file designates\nsamples EXACTLY as they appear in the VCF." << endl;
+        cout << "\tAborting ... " << endl;
+        abortRun(-2);
+    }
+
+    // map each cached sample column to a population, just as assignSamplesToPopulations() does:
+    vector<string> sampleIDs( numSamples );
+    for ( int i = 0; i < numSamples; i++ ) {
+        cacheFile.read( reinterpret_cast<char*>( &nameLength ), sizeof( nameLength ) );
+        sampleIDs[i].resize( nameLength );
+        cacheFile.read( &sampleIDs[i][0], nameLength );
+    }
+    checkSampleColumns( sampleIDs.data(), numSamples, vcfName + GENOTYPE_CACHE_SUFFIX );
+    for ( int d = 0; d < numDesignations; d++ )
+        mapSamplesToPopulations( sampleIDs.data(), numSamples, designations[d], "genotype cache" );
+    PlinkExport plink;
+    if ( !PLINK_PREFIX.empty() )
+        setUpPlinkExport( plink, numSamples, sampleIDs.data(), designations[0] );
+    GenotypeBatch batch;
+    if ( GENOTYPE_BATCH_RECORDS )
+        setUpGenotypeBatch( batch, numSamples );
+    LDwindow LD;
+    if ( LD_WINDOW_SNPS || LD_WINDOW_BP )
+        setUpLD( LD, numSamples, designations, numDesignations );
+
+    // arrays and vectors, so that they are also freed when abortRun() throws in the library build:
+    char metaFields[6][MAX_BUFFER_SIZE];
+    uint16_t fieldLength;
+    int numPackedBytes = (numSamples + 3) / 4;
+    vector<unsigned char> packedBytes( numPackedBytes );
+    vector<unsigned char> depthOfLine( numSamples );
+    vector<char> codesOfLine( numSamples );
+    unsigned char *packedGenotypes = packedBytes.data();
+    unsigned char *depthBytes = depthOfLine.data();  // DP or GQ, for the genotype masks
+    char *genotypeCodes = codesOfLine.data();   // or the batch's next row
+    int homoRefCount, hetCount, homoAltCount;
+    unsigned long int VCFfileLineCount = headerLineNumber;
+
+    string discardedLinesFileName = ( WORKER_OUTPUT_BASE.empty() ? vcfName : WORKER_OUTPUT_BASE ) + "_discardedLineNums.txt";
+    ofstream discardedLinesFile( discardedLinesFileName, ostream::out );
+    discardedLinesFile << "VCFfileLinesNotUsed" << endl; // header row
+
+    while ( cacheFile.read( reinterpret_cast<char*>( &flags ), sizeof( flags ) ) ) {
+        VCFfileLineCount++;
+        cacheFile.read( reinterpret_cast<char*>( &DPval ), sizeof( DPval ) );
+        // same rule as parseMetaColData():
+        keepThis = ( isnan( DPval ) || DPval >= OVERALL_DP_MIN_THRESHOLD ) && ( flags & CACHE_RECORD_IS_SNP );
+
+        if ( flags & CACHE_RECORD_IS_SNP ) {
+            for ( int i = 0; i < 6; i++ ) {
+                cacheFile.read( reinterpret_cast<char*>( &fieldLength ), sizeof( fieldLength ) );
+                if ( !cacheFile.good() || fieldLength >= MAX_BUFFER_SIZE ) {
+                    cacheFile.setstate( ios_base::failbit );    // a damaged cache; reported below
+                    break;
+                }
+                cacheFile.read( metaFields[i], fieldLength );
+                metaFields[i][fieldLength] = '\0';
+            }
+            cacheFile.read( reinterpret_cast<char*>( packedGenotypes ), numPackedBytes );
+            if ( GENOTYPE_BATCH_RECORDS )
+                genotypeCodes = batch.genotypeCodes.data() + static_cast<size_t>( batch.numRecords ) * numSamples;
+            if ( keepThis ) {
+                for ( int i = 0; i < numSamples; i++ )
+                    genotypeCodes[i] = static_cast<char>( (packedGenotypes[i >> 2] >> ((i & 3) << 1)) & 3 );
+            }
+            cacheFile.read( reinterpret_cast<char*>( &numExceptions ), sizeof( numExceptions ) );
+            for ( uint32_t j = 0; j < numExceptions; j++ ) {
+                cacheFile.read( reinterpret_cast<char*>( &exceptionSample ), sizeof( exceptionSample ) );
+                cacheFile.read( reinterpret_cast<char*>( &exceptionCode ), sizeof( exceptionCode ) );
+                if ( !cacheFile.good() || exceptionSample >= numSamplesInCache ) {
+                    cacheFile.setstate( ios_base::failbit );
+                    break;
+                }
+                genotypeCodes[ exceptionSample ] = static_cast<char>( exceptionCode );
+            }
+            // the per-sample DP and GQ bytes are only needed for the genotype masks, which
+            // treat them as decodeSampleColumns() does (checkGenotypeCache() has made sure
+            // the limits are below the bytes' saturation at 254):
+            if ( flags & CACHE_RECORD_HAS_DP ) {
+                if ( keepThis && ( MIN_GT_DP > 0 || MAX_GT_DP != INT_MAX ) ) {
+                    cacheFile.read( reinterpret_cast<char*>( depthBytes ), numSamples );
+                    for ( int i = 0; i < numSamples; i++ ) {
+                        if ( depthBytes[i] != CACHE_BYTE_MISSING && ( depthBytes[i] < MIN_GT_DP || depthBytes[i] > MAX_GT_DP ) )
+                            genotypeCodes[i] = GT_CODE_MISSING;
+                    }
+                } else {
+                    cacheFile.ignore( numSamples );
+                }
+            }
+            if ( flags & CACHE_RECORD_HAS_GQ ) {
+                if ( keepThis && MIN_GT_GQ > 0 ) {
+                    cacheFile.read( reinterpret_cast<char*>( depthBytes ), numSamples );
+                    for ( int i = 0; i < numSamples; i++ ) {
+                        if ( depthBytes[i] != CACHE_BYTE_MISSING && depthBytes[i] < MIN_GT_GQ )
+                            genotypeCodes[i] = GT_CODE_MISSING;
+                    }
+                } else {
+                    cacheFile.ignore( numSamples );
+                }
+            }
+            cacheFile.read( reinterpret_cast<char*>( medians ), sizeof( medians ) );
+        }
+        if ( !cacheFile.good() ) {
+            cout << "\nError in summarizeFromCache():\n\tgenotype cache ended in the middle of the record for VCF line " << VCFfileLineCount << "\n";
+            cout << "--> Rebuild it with --build-cache, or run with --no-cache.\n\tAborting ... \n\n";
+            abortRun(-2);
+        }
+
+        // --filter terms; only QUAL, CHROM, MAF and CALLRATE can occur here:
+        if ( keepThis && !SITE_FILTERS.empty() ) {
+            keepThis = passesFilters( SITE_FILTERS, metaFields[0], metaFields[1], metaFields[5], NULL, std::numeric_limits<double>::quiet_NaN(), std::numeric_limits<double>::quiet_NaN() );
+        }
+        if ( keepThis && !GENOTYPE_FILTERS.empty() ) {
+            double MAF, callRate;
+            calculateFilterGenotypeStats( genotypeCodes, numSamples, MAF, callRate );
+            keepThis = passesFilters( GENOTYPE_FILTERS, metaFields[0], metaFields[1], metaFields[5], NULL, MAF, callRate );
+        }
+
+        if ( keepThis && GENOTYPE_BATCH_RECORDS )
+            addToGenotypeBatch( batch, VCFfileLineCount, metaFields[0], metaFields[1], metaFields[2], metaFields[3], metaFields[4], metaFields[5], medians[0], medians[1], designations, numDesignations );
+        if ( keepThis ) {
+            for ( int d = 0; d < numDesignations && !GENOTYPE_BATCH_RECORDS; d++ ) {
+                int numPopulations = designations[d].numPopulations;
+                int altAlleleCounts[numPopulations], validSampleCounts[numPopulations];
+                int popCodeCounts[numPopulations * NUM_GT_CODES];
+                ofstream& outputFile = designations[d].outputFile;
+                tallyGenotypes( genotypeCodes, numSamples, designations[d].populationReference.data(), numPopulations, altAlleleCounts, validSampleCounts, homoRefCount, hetCount, homoAltCount, HWE_TESTS ? popCodeCounts : NULL );
+                if ( WRITE_SUMMARY_FILES ) {
+                    if ( SPLIT_BY_CHROM )
+                        selectChromOutputFile( designations[d], metaFields[0], metaFields[1] );
+                    outputFile << VCFfileLineCount;
+                    for ( int i = 0; i < 6; i++ )
+                        outputFile << "\t" << metaFields[i];
+                    writeSummaryColumns( outputFile, medians[0], medians[1], homoRefCount, hetCount, homoAltCount, altAlleleCounts, validSampleCounts, numPopulations );
+                    if ( HWE_TESTS )
+                        writeHWEcolumns( outputFile, popCodeCounts, numPopulations );
+                    outputFile << endl;
+                }
+                if ( SFS_SIZE_ALL || !SFS_SIZES_BY_POP.empty() )
+                    accumulateSFS( designations[d], altAlleleCounts, validSampleCounts );
+                if ( SNP_SUMMARY_CALLBACK )
+                    reportSNPsummary( designations[d], d, VCFfileLineCount, metaFields[0], metaFields[1], metaFields[2], metaFields[3], metaFields[4], metaFields[5], medians[0], medians[1], homoRefCount, hetCount, homoAltCount, altAlleleCounts, validSampleCounts );
+            }
+            if ( LD_WINDOW_SNPS || LD_WINDOW_BP )
+                updateLD( LD, designations, numDesignations, metaFields[0], metaFields[1], genotypeCodes );
+            if ( !PLINK_PREFIX.empty() )
+                writePlinkSNP( plink, genotypeCodes, numSamples, metaFields[0], metaFields[1], metaFields[2], metaFields[3], metaFields[4] );
+        } else {
+            discardedLinesFile << VCFfileLineCount << endl;
+        }
+    }
+
+    if ( GENOTYPE_BATCH_RECORDS )
+        finishGenotypeBatch( batch, designations, numDesignations );
+    discardedLinesFile.close();
+    if ( LD_WINDOW_SNPS || LD_WINDOW_BP )
+        finishLD( LD, designations, numDesignations );
+    if ( !PLINK_PREFIX.empty() )
+        finishPlinkExport( plink );
+}
+
+
+void summarizeOneVCF( string vcfName, int numSamples, int numFormats, char formatDelim, int maxSubfieldsInFormat, PopulationDesignation* designations, int numDesignations )
+{
+    // everything done for one VCF once the population files are read: the summary
+    // files are opened and written, from the VCF or from its genotype cache
+    // for filtering_streambuf:
+    using namespace boost::iostreams;
+
+    unsigned long int VCFfileLineCount = 0;
+    int firstDataLineNumber = -1;
+    // data file streams:
+    filtering_streambuf<input> myVCFin;     // filter for VCF for dealing with compression
+    ifstream vcfUnfiltered; // needed to read in unfiltered
+
+    // --resume: carry on from the checkpoint of an earlier run of the same command
+    Checkpoint checkpoint;
+    if ( RESUME )
+        readCheckpoint( checkpoint, vcfName, designations, numDesignations );
+
+    // a genotype cache from an earlier --build-cache run replaces parsing of the VCF;
+    // a server (--serve) may hold it in memory already:
+    ifstream cacheFile;
+    MemoryBuffer servedBytes( SERVE_CACHE_DATA, SERVE_CACHE_LENGTH );
+    istream servedCache( &servedBytes );
+    istream& cache = SERVE_CACHE_DATA ? servedCache : cacheFile;
+    bool useCache = !BUILD_CACHE && !IGNORE_CACHE && !RESUME && !PREVIEW_POINTS;
+    if ( useCache && !SERVE_CACHE_DATA )
+        cacheFile.open( vcfName + GENOTYPE_CACHE_SUFFIX, ios_base::in | ios_base::binary );
+    if ( useCache && checkGenotypeCache( cache, vcfName, numFormats, formatDelim, maxSubfieldsInFormat ) ) {
+        for ( int d = 0; d < numDesignations && !SPLIT_BY_CHROM && WRITE_SUMMARY_FILES; d++ )
+            setUpOutputFile( designations[d].outputFile, designations[d].outputFileName, designations[d].numPopulations, designations[d].mapOfPopulations );
+        summarizeFromCache( cache, vcfName, numSamples, designations, numDesignations );
+        if ( cacheFile.is_open() )
+            cacheFile.close();
+    } else {
+        if ( cacheFile.is_open() )
+            cacheFile.close();
+
+        createVCFfilter( myVCFin, vcfName, vcfUnfiltered );    // create filter
+        istream VCFfile( &myVCFin );            // create stream from filter
+        if ( !VCFfile.good() ) {
+            cerr << "\nError!  istream VCFfile is not good!\n";
+        }
+
+        // assign each sample column in the VCF to a population:
+        vector<string> sampleColumns( numSamples );  // sample column headers, in VCF order
+        string *sampleIDs = sampleColumns.data();
+        BCFreader BCF;
+        if ( !readVCFheader( VCFfile, vcfName, numSamples, designations, numDesignations, sampleIDs, VCFfileLineCount, firstDataLineNumber, BCF ) ) {
+            cout << "\nError in summarizeOneVCF():\n\tcould not read the header of " << vcfName << "\n\tAborting ... \n\n";
+            abortRun(-2);
+        }
+        BCFreader *BCFptr = BCF.source ? &BCF : NULL;   // NULL unless the input is a .bcf
+
+#ifdef DEBUG
+        cout << "VCFfileLineCount after assignSamplesToPopulations() is: \t" << VCFfileLineCount << endl;
+#endif
+
+        // if all has gone well to this point, the output files can be constructed
+        // (with --split-by-chrom they are opened as each CHROM turns up, and with
+        // --resume readCheckpoint() has already reopened them):
+        for ( int d = 0; d < numDesignations && !SPLIT_BY_CHROM && !RESUME && WRITE_SUMMARY_FILES; d++ )
+            setUpOutputFile( designations[d].outputFile, designations[d].outputFileName, designations[d].numPopulations, designations[d].mapOfPopulations );
+
+        // after that function call, the  VCFfile stream has pointed
+        // to the first entry of the first line of data
+
+        // go through data and calculate allele frequencies:
+        if ( PREVIEW_POINTS ) {
+            previewVCF( VCFfile, numFormats, formatDelim, maxSubfieldsInFormat, VCFfileLineCount, numSamples, designations, numDesignations, sampleIDs, vcfName );
+        } else if ( RESUME ) {
+            // the header was read again above for the sample columns; the data lines
+            // come from a second stream that starts where the checkpoint was taken
+            filtering_streambuf<input> resumedVCFin;
+            ifstream resumedUnfiltered;
+            unsigned long long skipBytes = openVCFatCheckpoint( resumedVCFin, vcfName, resumedUnfiltered, checkpoint );
+            istream resumedVCF( &resumedVCFin );
+            resumedVCF.ignore( static_cast<streamsize>( skipBytes ) );
+            parseActualData( resumedVCF, numFormats, formatDelim, maxSubfieldsInFormat, VCFfileLineCount, numSamples, designations, numDesignations, sampleIDs, vcfName, &checkpoint, NULL );
+        } else {
+            parseActualData( VCFfile, numFormats, formatDelim, maxSubfieldsInFormat, VCFfileLineCount, numSamples, designations, numDesignations, sampleIDs, vcfName, NULL, BCFptr );
+        }
+    }
+}
+
+
+int summarizeVCF( int argc, char* argv[] )
+{
+    // the whole run, for main() and vss_summarize(); errors end it through abortRun()
+    clock_t startTime = clock();  // for tracking performance
+
+    // variables for command line arguments:
+    int numSamples, numFields, numFormats, numDesignations;
+    int maxSubfieldsInFormat = MAX_SUBFIELDS_IN_FORMAT_DEFAULT;
+	bool popFileHeader;
+    char formatDelim = FORMAT_DELIM_DEFAULT;
+    string vcfName;
+
+#ifdef DEBUG
+    string progname = argv[0];
+    cout << "\n\t" << progname << " is running!\n\n";
+#endif
+
+    // one entry per population designation file (-P); each holds its own
+    // population map, sample-to-population cross referencing, and output file
+    // (a vector, so that it is also freed when abortRun() throws in the library build)
+    vector<PopulationDesignation> designationList;
+
+	// parse command line options and open file streams for reading:
+    parseCommandLineInput(argc, argv, popFileHeader, numSamples, numFields, numFormats, formatDelim, maxSubfieldsInFormat, vcfName, designationList, numDesignations );
+    PopulationDesignation *designations = designationList.data();
+
+    // create cross referencing for population membership by sample:
+    for ( int d = 0; d < numDesignations; d++ ) {
+        int numSamplesPerPopulation[ designations[d].numPopulations ];    // for later frequency calculations
+        for ( int i = 0; i < designations[d].numPopulations; i++ )
+            numSamplesPerPopulation[i] = 0;
+        for ( int i = 0; i < numSamples; i++ )
+            numSamplesPerPopulation[ designations[d].samples.popIndexes[i] ]++;
+        if ( SFS_SIZE_ALL || !SFS_SIZES_BY_POP.empty() )
+            setUpSFS( designations[d], numSamplesPerPopulation );
+        designations[d].populationReference.resize( numSamples );
+        designations[d].populationNames.resize( designations[d].numPopulations );
+        for ( map<string, int>::const_iterator it = designations[d].mapOfPopulations.begin(); it != designations[d].mapOfPopulations.end(); it++ )
+            designations[d].populationNames[ it->second ] = it->first.c_str();
+    }
+
+    // one VCF, or several with merged outputs (then vcfName only names the outputs):
+    if ( VCF_FILE_NAMES.empty() )
+        summarizeOneVCF( vcfName, numSamples, numFormats, formatDelim, maxSubfieldsInFormat, designations, numDesignations );
+    else
+        summarizeVCFfiles( vcfName, numSamples, numFormats, formatDelim, maxSubfieldsInFormat, designations, numDesignations );
+
+	// cleanup: close files:
+    for ( int d = 0; d < numDesignations; d++ ) {
+        if ( SFS_SIZE_ALL || !SFS_SIZES_BY_POP.empty() )
+            writeSFS( designations[d] );
+        if ( SPLIT_BY_CHROM && WRITE_SUMMARY_FILES )
+            writeChromIndex( designations[d] );
+        designations[d].outputFile.close();
+        if ( SERVE_REPLY_FD >= 0 && WRITE_SUMMARY_FILES )
+            sendServedFile( SERVE_REPLY_FD, designations[d].outputFileName );
+    }
+	//delete mySamples;
+
+
+#ifdef DEBUG
+		cout << "\nI ran!!\n\n";
+#endif
+    clock_t endTime = clock();
+    int minutes;
+	double seconds;
+    convertTimeInterval( (endTime - startTime), minutes, seconds);
+    cout << "\nIt took " << minutes << "min., " << seconds << "sec."  << " to run.\n";
+
+    return 0;
+}
+
+
+void summarizeVCFfiles( string outputBase, int numSamples, int numFormats, char formatDelim, int maxSubfieldsInFormat, PopulationDesignation* designations, int numDesignations )
+{
+    // several VCFs with merged outputs: each VCF is summarized by a forked worker
+    // process, up to NUM_JOBS at a time, which inherits the population maps and
+    // writes part files named after outputBase.  The parts are appended to the merged
+    // outputs in input order, as soon as every earlier VCF is done
+    using namespace boost::iostreams;
+    int numFiles = static_cast<int>( VCF_FILE_NAMES.size() );
+    chrono::steady_clock::time_point startTime = chrono::steady_clock::now();   // the workers' time isn't in clock()
+
+    // the first VCF's sample columns are the ones every VCF must have:
+    {
+        filtering_streambuf<input> myVCFin;
+        ifstream vcfUnfiltered;
+        createVCFfilter( myVCFin, VCF_FILE_NAMES[0], vcfUnfiltered );
+        istream VCFfile( &myVCFin );
+        vector<string> sampleIDs( numSamples );
+        unsigned long int VCFfileLineCount = 0;
+        int firstDataLineNumber = -1;
+        BCFreader BCF;
+        if ( !readVCFheader( VCFfile, VCF_FILE_NAMES[0], numSamples, designations, numDesignations, sampleIDs.data(), VCFfileLineCount, firstDataLineNumber, BCF ) ) {
+            cout << "\nError in summarizeVCFfiles():\n\tcould not read the header of " << VCF_FILE_NAMES[0] << "\n\tAborting ... \n\n";
+            abortRun(-2);
+        }
+        FIRST_VCF_SAMPLE_IDS = sampleIDs;
+    }
+
+    // merged outputs: one summary per population designation, then the discarded lines
+    vector<string> mergedNames, partSuffixes;
+    for ( int d = 0; d < numDesignations; d++ ) {
+        mergedNames.push_back( designations[d].outputFileName );
+        partSuffixes.push_back( designations[d].outputFileName.substr( outputBase.length() ) );
+    }
+    mergedNames.push_back( outputBase + "_discardedLineNums.txt" );
+    partSuffixes.push_back( "_discardedLineNums.txt" );
+    ofstream *mergedFiles = new ofstream[mergedNames.size()];
+    for ( size_t m = 0; m < mergedNames.size(); m++ ) {
+        mergedFiles[m].open( mergedNames[m], ofstream::out );
+        if ( mergedFiles[m].fail() ) {
+            cout << "\nError in summarizeVCFfiles():\n\tcould not write " << mergedNames[m] << "\n\t--> Please make sure you have write access to the data file directory.\n\tAborting ... \n\n";
+            abortRun(-4);
+        }
+    }
+
+    vector<pid_t> workers( numFiles, 0 );
+    vector<bool> finished( numFiles, false );
+    int started = 0, merged = 0, running = 0, waitStatus;
+    pid_t pid;
+    while ( merged < numFiles ) {
+        while ( running < NUM_JOBS && started < numFiles ) {
+            string partBase = outputBase + "_part" + to_string( started );
+            cout.flush();   // or the worker would write the parent's buffered output again
+            pid = fork();
+            if ( pid == 0 ) {
+                // the worker: the usual run on one VCF, into its part files.  In the
+                // library build abortRun() throws, and the worker must then end here
+                // instead of returning into the code of the program that called it
+                int status = 0;
+                try {
+                    WORKER_OUTPUT_BASE = partBase;
+                    for ( int d = 0; d < numDesignations; d++ )
+                        designations[d].outputFileName = partBase + partSuffixes[d];
+                    summarizeOneVCF( VCF_FILE_NAMES[started], numSamples, numFormats, formatDelim, maxSubfieldsInFormat, designations, numDesignations );
+                    for ( int d = 0; d < numDesignations; d++ )
+                        designations[d].outputFile.close();
+                } catch ( int abortStatus ) {
+                    status = abortStatus;
+                } catch ( ... ) {
+                    status = -1;
+                }
+                cout.flush();
+                _exit( status & 0xff );
+            } else if ( pid < 0 ) {
+                cout << "\nError in summarizeVCFfiles():\n\tcould not start a worker process: " << strerror( errno ) << "\n\tAborting ... \n\n";
+                abortRun(-6);
+            }
+            workers[started++] = pid;
+            running++;
+        }
+
+        pid = waitpid( -1, &waitStatus, 0 );
+        int file = 0;
+        while ( file < started && workers[file] != pid )
+            file++;
+        if ( file == started )
+            continue;   // not one of the workers
+        running--;
+        workers[file] = 0;
+        if ( !WIFEXITED( waitStatus ) || WEXITSTATUS( waitStatus ) != 0 ) {
+            // stop the other workers, and return the status a run on that VCF alone would have had:
+            int status = WIFEXITED( waitStatus ) ? WEXITSTATUS( waitStatus ) : 128 + WTERMSIG( waitStatus );
+            cout << "\nError in summarizeVCFfiles():\n\tsummarizing " << VCF_FILE_NAMES[file] << " failed (status " << status << ").\n\tAborting ... \n\n";
+            for ( int i = 0; i < started; i++ ) {
+                if ( workers[i] ) {
+                    kill( workers[i], SIGTERM );
+                    waitpid( workers[i], NULL, 0 );
+                }
+                for ( size_t m = 0; m < partSuffixes.size() && ( i >= merged ); m++ )
+                    remove( ( outputBase + "_part" + to_string( i ) + partSuffixes[m] ).c_str() );
+            }
+            abortRun( status > 127 ? status - 256 : status );
+        }
+        finished[file] = true;
+        while ( merged < numFiles && finished[merged] ) {
+            for ( size_t m = 0; m < mergedNames.size(); m++ )
+                appendPartFile( mergedFiles[m], outputBase + "_part" + to_string( merged ) + partSuffixes[m], VCF_FILE_NAMES[merged], merged == 0 );
+            if ( VERBOSE )
+                cout << "\nMerged the outputs of " << VCF_FILE_NAMES[merged] << " (" << merged + 1 << " of " << numFiles << ")" << endl;
+            merged++;
+        }
+    }
+
+    for ( size_t m = 0; m < mergedNames.size(); m++ ) {
+        mergedFiles[m].close();
+        if ( mergedFiles[m].fail() ) {
+            cout << "\nError in summarizeVCFfiles():\n\tcould not finish writing " << mergedNames[m] << "\n\tAborting ... \n\n";
+            abortRun(-4);
+        }
+    }
+    delete[] mergedFiles;
+    double seconds = chrono::duration<double>( chrono::steady_clock::now() - startTime ).count();
+    cout << "\nSummarized " << numFiles << " VCFs into " << mergedNames[0] << " in " << seconds << " sec. with " << NUM_JOBS << " worker processes" << endl;
+}
+
+
+void submitReadAhead( ReadAheadState* state, int buffer )
+{
+    // starts the io_uring read that fills a free buffer with the next part of the
+    // file, or the rest of a short read into a buffer in flight.  A free buffer stays
+    // free when the whole file has been read
+#ifdef HAVE_IO_URING
+    if ( state->bufferStates[buffer] == READ_AHEAD_FREE ) {
+        if ( state->nextOffset >= state->fileSize )
+            return;
+        state->bufferOffsets[buffer] = state->nextOffset;
+        state->bufferLengths[buffer] = min( static_cast<unsigned long long>( READ_AHEAD_BUFFER_SIZE ), state->fileSize - state->nextOffset );
+        state->bufferFilled[buffer] = 0;
+        state->nextOffset += state->bufferLengths[buffer];
+        state->bufferStates[buffer] = READ_AHEAD_IN_FLIGHT;
+        state->startTimes[buffer] = chrono::steady_clock::now();
+    }
+    unsigned tail = *state->sqTail, index = tail & *state->sqMask;
+    struct io_uring_sqe *sqe = &state->sqes[index];
+    memset( sqe, 0, sizeof( *sqe ) );
+    sqe->opcode = state->fixedBuffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = state->fd;
+    sqe->off = state->bufferOffsets[buffer] + state->bufferFilled[buffer];
+    sqe->addr = reinterpret_cast<unsigned long long>( state->buffers[buffer].data() + state->bufferFilled[buffer] );
+    sqe->len = static_cast<unsigned>( state->bufferLengths[buffer] - state->bufferFilled[buffer] );
+    sqe->buf_index = static_cast<unsigned short>( buffer );
+    sqe->user_data = static_cast<unsigned long long>( buffer );
+    state->sqArray[index] = index;
+    __atomic_store_n( state->sqTail, tail + 1, __ATOMIC_RELEASE );
+    long submitted;
+    do {
+        submitted = syscall( __NR_io_uring_enter, state->ringFd, 1, 0, 0, NULL, 0 );
+    } while ( submitted < 0 && errno == EINTR );
+    if ( submitted < 0 ) {
+        state->readError = errno;
+        state->bufferStates[buffer] = READ_AHEAD_READY;
+    }
+#endif
+}
+
+
+void tallyGenotypes( char* genotypeCodes, int numSamples, int* populationReference, int numPopulations, int altAlleleCounts[], int validSampleCounts[], int& homoRefCount, int& hetCount, int& homoAltCount, int* popCodeCounts )
+{
+    // popCodeCounts, if not NULL, gets the count of each GT code in each
+    // population ( NUM_GT_CODES entries per population )
+    int codeCounts[NUM_GT_CODES] = { 0 };
+    int popIndex, code;
+    // initialize all array values to zero:
+    for ( int i = 0; i < numPopulations; i++ ) {
+        altAlleleCounts[i] = 0;
+        validSampleCounts[i] = 0;
+    }
+    if ( popCodeCounts ) {
+        for ( int i = 0; i < numPopulations * NUM_GT_CODES; i++ )
+            popCodeCounts[i] = 0;
+    }
+    for ( int sampleCounter = 0; sampleCounter < numSamples; sampleCounter++ ) {
+        popIndex = populationReference[ sampleCounter ];
+        code = genotypeCodes[ sampleCounter ];
+        codeCounts[ code ]++;
+        validSampleCounts[ popIndex ] += VALID_ALLELES_BY_GT_CODE[ code ];
+        altAlleleCounts[ popIndex ] += ALT_ALLELES_BY_GT_CODE[ code ];
+        if ( popCodeCounts )
+            popCodeCounts[ popIndex * NUM_GT_CODES + code ]++;
+    }
+    // diploid genotype counts only include samples with both alleles called:
+    homoRefCount = codeCounts[ static_cast<int>( GT_CODE_HOMO_REF ) ];
+    hetCount = codeCounts[ static_cast<int>( GT_CODE_HET ) ];
+    homoAltCount = codeCounts[ static_cast<int>( GT_CODE_HOMO_ALT ) ];
+}
+
+vector<string> tokenizeFilterExpression( string expression )
+{
+    // operators and punctuation become their own tokens; anything else up to
+    // whitespace or an operator character is a word (field name or value)
+    vector<string> tokens;
+    const string operatorChars = "&|!(){},<>=";
+    size_t i = 0, n = expression.length();
+    while ( i < n ) {
+        char c = expression[i];
+        if ( isspace( static_cast<unsigned char>( c ) ) ) {
+            i++;
+        } else if ( (c == '&' || c == '|') && i + 1 < n && expression[i + 1] == c ) {
+            tokens.push_back( expression.substr( i, 2 ) );
+            i += 2;
+        } else if ( (c == '<' || c == '>' || c == '!' || c == '=') && i + 1 < n && expression[i + 1] == '=' ) {
+            tokens.push_back( expression.substr( i, 2 ) );
+            i += 2;
+        } else if ( operatorChars.find( c ) != string::npos ) {
+            if ( c == '&' || c == '|' )
+                filterExpressionError( expression, string( "single '" ) + c + "'; use '" + c + c + "'" );
+            tokens.push_back( string( 1, c ) );
+            i++;
+        } else {
+            size_t start = i;
+            while ( i < n && !isspace( static_cast<unsigned char>( expression[i] ) ) && operatorChars.find( expression[i] ) == string::npos )
+                i++;
+            tokens.push_back( expression.substr( start, i - start ) );
+        }
+    }
+    return tokens;
+}
 
 
-	// open file streams and check for errors:
-//    if ( !VCFfile.good() ) {
-//        cout << "\nError in parseCommandLineInput():\n\tVCF file name '" << vcfName << " 'not found!\n\t--> Check spelling and path.\n\tExiting ... \n\n";
-//        exit( -1 );
-//    }
-	PopulationFile.open( popFileName );
-	if ( !PopulationFile.good() ) {
-		cout << "\nError in parseCommandLineInput():\n\tPopulation file name '" << popFileName << "' not found!\n\t--> Check spelling and path.\n\tExiting ... \n\n";
-		exit( -1 );
-	}
 
-	// error checking on user input; some arguments are mandatory!
-    string testString;
-#ifdef DEBUG
-        cout << "\nMax length of string on this system = " << testString.max_size() << "\n\n";
-#endif
-	if ( numPopulations < 2 ) {
-		cout << "\nError!  numPopulations = " << numPopulations << ", but it has to be >= 2 for this program.\nExiting ...\n\n";
-		exit( -1 );
-	}
-	if ( !numFormatsSet ) {
-        cout << "\nWarning!! numFormats (-f) not set on command line.\nAssuming numFormats = " << numFormats << endl;
+void tokenizeINFO( INFOkeyTable& table, const char* INFO )
+{
+    // splits INFO once on ';' and records the value of every entry whose key is in
+    // table; the values point into INFO, so they are only valid for the current line.
+    // Spaces around the key and after '=' are tolerated (e.g. "DP = 5")
+    const char *entry = INFO, *keyEnd, *value, *end;
+    for ( size_t i = 0; i < table.keys.size(); i++ )
+        table.values[i] = NULL;
+    while ( *entry != '\0' ) {
+        while ( *entry == ' ' )
+            entry++;
+        end = entry;
+        while ( *end != ';' && *end != '=' && *end != '\0' )
+            end++;
+        keyEnd = end;
+        while ( keyEnd > entry && keyEnd[-1] == ' ' )
+            keyEnd--;
+        if ( *end == '=' ) {
+            value = end + 1;
+            while ( *value == ' ' )
+                value++;
+            end = value;
+            while ( *end != ';' && *end != '\0' )
+                end++;
+        } else {
+            value = end;    // a flag
+        }
+        int key = table.slots[ hashINFOkey( entry, keyEnd - entry, table.seed ) & table.mask ];
+        if ( key >= 0 && table.values[key] == NULL && table.keys[key].length() == static_cast<size_t>( keyEnd - entry )
+             && memcmp( entry, table.keys[key].data(), keyEnd - entry ) == 0 ) {
+            table.values[key] = value;
+            table.valueLengths[key] = end - value;
+        }
+        entry = ( *end == ';' ) ? end + 1 : end;
     }
 }
 
 
-bool parseMetaColData( istream& VCFfile, long int SNPcount, bool checkFormat, int& numTokensInFormat, int& GTtoken, int& DPtoken, int& GQtoken, int& PLtoken, bool& lookForDP, bool& lookForGQ, bool& lookForPL, char formatDelim, char* CHROM, char* POS, char* ID, char* REF, char* ALT, char* QUAL )
+void truncateOutputFile( string fileName, unsigned long long size )
 {
-    int subfieldCount;  // field counter, starting with index of 1
-    double DPval;
-    char *buffer = new char[MAX_BUFFER_SIZE];
-    char *token = new char[MAX_TOKEN_LENGTH];
-    //char myDelim = formatDelim;
-    char *FILTER, *INFO, *FORMAT;
-    size_t pos, REFlength, ALTlength;
-    bool keepThis = true;
-    char *INFObuffer = new char[MAX_BUFFER_SIZE];
-    static bool lookForDPinINFO = true;
-    FILTER = new char[MAX_BUFFER_SIZE];
-    INFO = new char[MAX_BUFFER_SIZE];
-    FORMAT = new char[MAX_BUFFER_SIZE];
+    if ( truncate( fileName.c_str(), static_cast<off_t>( size ) ) != 0 ) {
+        cout << "\nError in truncateOutputFile():\n\tcould not truncate " << fileName << " to the size recorded in the checkpoint.\n\tAborting ... \n\n";
+        abortRun(-4);
+    }
+}
 
 
-    // loop over fields:
-    int col = 1;
-    //while( col <= NUM_META_COLS ) {
-    //    for ( int col = 1; col <= NUM_META_COLS; col++ ) {
-    //VCFfile.get( buffer, MAX_BUFFER_SIZE, VCF_DELIM );
-    //fprintf(stdout, "col = %i \t buffer = %s\n", col, buffer);
-    //switch ( col ) {
-    //            case 1:
-    VCFfile.get( CHROM, MAX_BUFFER_SIZE, VCF_DELIM );
-    VCFfile.ignore(unsigned(-1), VCF_DELIM);
-    //                break;
-    //            case 2:
-    VCFfile.get( POS, MAX_BUFFER_SIZE, VCF_DELIM );
-    VCFfile.ignore(unsigned(-1), VCF_DELIM);
-    //                break;
-    //            case 3:
-    VCFfile.get( ID, MAX_BUFFER_SIZE, VCF_DELIM );
-    VCFfile.ignore(unsigned(-1), VCF_DELIM);
-    //                break;
-    //            case 4:
-    VCFfile.get( REF, MAX_BUFFER_SIZE, VCF_DELIM );
-    REFlength = getLength( REF );
-    //                break;
-    VCFfile.ignore(unsigned(-1), VCF_DELIM);
-    //            case 5:
-    VCFfile.get( ALT, MAX_BUFFER_SIZE, VCF_DELIM );
-    ALTlength = getLength( ALT );
-    VCFfile.ignore(unsigned(-1), VCF_DELIM);
-    //                break;
-    //            case 6:
-    VCFfile.get( QUAL, MAX_BUFFER_SIZE, VCF_DELIM );
-    VCFfile.ignore(unsigned(-1), VCF_DELIM);
-    //QUAL = stod(buffer);
-    //                break;
-    //            case 7:                 // this also handles 8!
-    VCFfile.get( FILTER, MAX_BUFFER_SIZE, VCF_DELIM );
-    // need to prepare to handle INFO column next
-    VCFfile.ignore(unsigned(-1), VCF_DELIM); // move to tab
-    VCFfile.get( INFObuffer, MAX_BUFFER_SIZE, VCF_DELIM );
-    
-    //                fprintf(stdout, "INFObuffer is: \t%s[end]\n", INFObuffer);
-    if ( lookForDPinINFO ) {
-        DPval = extractDPvalue( INFObuffer, lookForDPinINFO );
-        //cout << "\tDPval extracted is: \t" << DPval << endl;
-        if ( !isnan( DPval ) ) {
-            if ( DPval >= OVERALL_DP_MIN_THRESHOLD )
-                keepThis = true;
-            else
-                keepThis = false;
+void updateLD( LDwindow& LD, PopulationDesignation* designations, int numDesignations, char* CHROM, char* POS, char* genotypeCodes )
+{
+    // compares a newly kept SNP with every SNP in the window on the same CHROM,
+    // for every population, and then adds it to the window
+    int numWords = LD.numWords;
+    size_t SNPsize = 3 * static_cast<size_t>( numWords );
+    long int position = strtol( POS, NULL, 10 );
+    uint64_t *newSNP = LD.planes.data() + static_cast<size_t>( LD.capacity ) * SNPsize;
+    double r2, Dprime;
+
+    if ( LD.CHROM != CHROM ) {
+        LD.CHROM = CHROM;
+        LD.count = 0;
+    }
+    while ( LD.count && LD_WINDOW_BP && position - LD.positions[ LD.first ] > LD_WINDOW_BP ) {
+        LD.first = ( LD.first + 1 ) % LD.capacity;
+        LD.count--;
+    }
+    packLDgenotypes( genotypeCodes, LD.numSamples, newSNP, numWords );
+
+    for ( int k = 0; k < LD.count; k++ ) {
+        int slot = ( LD.first + k ) % LD.capacity;
+        uint64_t *oldSNP = LD.planes.data() + static_cast<size_t>( slot ) * SNPsize;
+        long int distance = position - LD.positions[slot];
+        for ( int d = 0; d < numDesignations; d++ ) {
+            PopulationDesignation& designation = designations[d];
+            int numPopulations = designation.numPopulations;
+            size_t bin = LD_BIN_WIDTH ? static_cast<size_t>( distance / LD_BIN_WIDTH ) : 0;
+            if ( LD_BIN_WIDTH && designation.LDbinPairs.size() < ( bin + 1 ) * numPopulations ) {
+                designation.LDbinPairs.resize( ( bin + 1 ) * numPopulations, 0 );
+                designation.LDbinR2sums.resize( ( bin + 1 ) * numPopulations, 0.0 );
+                designation.LDbinDprimeSums.resize( ( bin + 1 ) * numPopulations, 0.0 );
+            }
+            if ( !LD_BIN_WIDTH )
+                designation.LDfile << CHROM << "\t" << LD.positions[slot] << "\t" << position << "\t" << distance;
+            for ( int pop = 0; pop < numPopulations; pop++ ) {
+                bool defined = calculateLD( oldSNP, newSNP, designation.populationMasks.data() + static_cast<size_t>( pop ) * numWords, numWords, r2, Dprime );
+                if ( LD_BIN_WIDTH ) {
+                    if ( defined ) {
+                        designation.LDbinPairs[ bin * numPopulations + pop ]++;
+                        designation.LDbinR2sums[ bin * numPopulations + pop ] += r2;
+                        designation.LDbinDprimeSums[ bin * numPopulations + pop ] += Dprime;
+                    }
+                } else if ( defined ) {
+                    designation.LDfile << "\t" << r2 << "\t" << Dprime;
+                } else {
+                    designation.LDfile << "\t" << MISSING_DATA_INDICATOR << "\t" << MISSING_DATA_INDICATOR;
+                }
+            }
+            if ( !LD_BIN_WIDTH )
+                designation.LDfile << "\n";
         }
-    } else {
-        DPval = std::numeric_limits<double>::quiet_NaN();
-        //                    cout << "\tYo DPval is " << DPval << " bruh\n\n  **************** \n\n";
     }
-    VCFfile.ignore(unsigned(-1), VCF_DELIM); // move to tab
-    
-    //                col++; // since this case also handles 8!
-    //                break;
-    
-    //            case 9:
-    VCFfile.get( FORMAT, MAX_BUFFER_SIZE, VCF_DELIM );
-    //cout << "\nFORMAT is " << FORMAT << endl;
-    
-    
-    //                FORMAT = buffer;
-    //                break;
-    //            default:
-    //                cout << "\nError in parseActualData():\n\t";
-    //                cout << "case-switch not working as expected.\n\tAborting ...\n\n";
-    //                exit(-3);
-    //                break;
-    //        }
-    //        if ( col < NUM_META_COLS )
-    //            VCFfile.ignore(unsigned(-1), VCF_DELIM); // move to tab, but not on last one, because
-    //            // calcSummaryStats() always clears a character at the beginning of its loop
-    //        col++;
-    //
-    //    }
-    //
-    
-    // status report:
-    if ( VERBOSE ) {
-        if ( SNPcount % 10000 == 0 ) {
-            cout << "\nSNP lines processed so far = " << SNPcount << "; Current SNP is:\n\t";
-            cout <<  CHROM << "\t" << POS << "\t" << ID << "\t" << REF << "\t" << ALT << endl;
+
+    // add the new SNP, dropping the oldest one or growing the window if it is full:
+    if ( LD.count == LD.capacity ) {
+        if ( LD_WINDOW_SNPS ) {
+            LD.first = ( LD.first + 1 ) % LD.capacity;
+            LD.count--;
+        } else {
+            int newCapacity = 2 * LD.capacity;
+            vector<uint64_t> newPlanes( static_cast<size_t>( newCapacity + 1 ) * SNPsize );
+            vector<long int> newPositions( newCapacity );
+            for ( int k = 0; k < LD.count; k++ ) {
+                int slot = ( LD.first + k ) % LD.capacity;
+                memcpy( newPlanes.data() + static_cast<size_t>( k ) * SNPsize, LD.planes.data() + static_cast<size_t>( slot ) * SNPsize, SNPsize * sizeof( uint64_t ) );
+                newPositions[k] = LD.positions[slot];
+            }
+            memcpy( newPlanes.data() + static_cast<size_t>( newCapacity ) * SNPsize, newSNP, SNPsize * sizeof( uint64_t ) );
+            LD.planes.swap( newPlanes );
+            LD.positions.swap( newPositions );
+            LD.capacity = newCapacity;
+            LD.first = 0;
+            newSNP = LD.planes.data() + static_cast<size_t>( LD.capacity ) * SNPsize;
         }
     }
+    int slot = ( LD.first + LD.count ) % LD.capacity;
+    memcpy( LD.planes.data() + static_cast<size_t>( slot ) * SNPsize, newSNP, SNPsize * sizeof( uint64_t ) );
+    LD.positions[slot] = position;
+    LD.count++;
+}
 
-    if ( checkFormat ) {
-        subfieldCount = 0;
-        // string splitting, with thanks to:
-        // https://stackoverflow.com/questions/14265581/parse-split-a-string-in-c-using-string-delimiter-standard-c
-#ifdef DEBUG
-        cout << "** Parsing FORMAT **\n\tsubfieldcount\tpos\ttoken\n" << FORMAT << endl;
-        cout << "CHROM: " << CHROM << ", INFO: " << INFO << endl;
+
+void waitForReadAhead( ReadAheadState* state, int buffer )
+{
+    // returns once buffer is no longer in flight: its read is done, or it's free
+    // because the file has been read to the end.  Completions for other buffers that
+    // arrive in the meantime are recorded too, and short reads are continued
+    if ( state->ringFd < 0 ) {
+        unique_lock<mutex> guard( state->lock );
+        while ( state->bufferStates[buffer] != READ_AHEAD_READY && !( state->bufferStates[buffer] == READ_AHEAD_FREE && state->prefetchDone ) )
+            state->changed.wait( guard );
+        return;
+    }
+#ifdef HAVE_IO_URING
+    while ( state->bufferStates[buffer] == READ_AHEAD_IN_FLIGHT ) {
+        unsigned head = *state->cqHead, tail = __atomic_load_n( state->cqTail, __ATOMIC_ACQUIRE );
+        if ( head == tail ) {
+            if ( syscall( __NR_io_uring_enter, state->ringFd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0 ) < 0 && errno != EINTR ) {
+                state->readError = errno;
+                state->bufferStates[buffer] = READ_AHEAD_READY;
+            }
+            continue;
+        }
+        int b = static_cast<int>( state->cqes[ head & *state->cqMask ].user_data );
+        int result = state->cqes[ head & *state->cqMask ].res;
+        __atomic_store_n( state->cqHead, head + 1, __ATOMIC_RELEASE );
+        if ( result > 0 )
+            state->bufferFilled[b] += result;
+        if ( result == -EINTR || result == -EAGAIN || ( result > 0 && state->bufferFilled[b] < state->bufferLengths[b] ) ) {
+            submitReadAhead( state, b );
+        } else {
+            if ( result < 0 )
+                state->readError = -result;
+            state->bufferStates[b] = READ_AHEAD_READY;  // done, or the file got shorter
+        }
+    }
 #endif
-        //
-        pos = 0;
-        char nextChar = FORMAT[pos];
-        int subCount;
-        while ( nextChar != '\0' ) {
-            // get the next subfield:
-            subfieldCount++; // number of subfields processed
-            subCount = 0;
-            do {
-                //cout << "\nnextChar is " << nextChar << endl;
-                token[subCount++] = nextChar; // build it char by char
-                nextChar = FORMAT[++pos]; // get next char
-            } while ( nextChar != formatDelim && nextChar != '\0' );
-            token[subCount] = '\0'; // terminate string
-            // process subfield:
-            //cout << "\ntoken is " << token << endl;
-            checkFormatToken( token, GTtoken, DPtoken, GQtoken, PLtoken, subfieldCount );
-            
-            if ( nextChar != '\0' )
-                nextChar = FORMAT[++pos]; // get the next character past the delimiter
-        }
-        if ( !pos ) {
-            cerr << "\nError in parseMetaColData():\n\tpos = 0 meaning FORMAT has length zero!\n\tFORMAT = " << FORMAT << endl;
-            exit(-1);
-        }
-        numTokensInFormat = subfieldCount;
-        errorCheckTokens( GTtoken, DPtoken, GQtoken, PLtoken, lookForDP, lookForGQ, lookForPL );
-            
-//        while ( (pos = FORMAT.find( myDelim )) != string::npos ) {
-//            subfieldCount++;
-//            token = FORMAT.substr(0, pos);
-//            // record sub-field if it matches one we're looking for:
-//            checkFormatToken( token, GTtoken, DPtoken, GQtoken, subfieldCount );
-//#ifdef DEBUG
-//                cout << "\t" << subfieldCount << "\t\t" << pos  << "\t" << token << endl;
-//#endif
-//            FORMAT.erase(0, pos + myDelim.length());
-//        }
-//        numTokensInFormat = subfieldCount + 1;
-//        checkFormatToken( FORMAT, GTtoken, DPtoken, GQtoken, numTokensInFormat ); // check remaining field (after last occurrence of delimiter)
-//        // error checking on occurrence of GT:
-//        errorCheckTokens( GTtoken, DPtoken, GQtoken, lookForDP, lookForGQ );
+}
 
-#ifdef DEBUG
-        cout << "\t" << numTokensInFormat << "\t\tlast\t" << FORMAT << "\twhile loop count = " << subfieldCount << endl;
-        cout << "GTtoken = " << GTtoken << "; DPtoken = " << DPtoken << "; GQtoken = " << GQtoken << "; PLtoken = " << PLtoken << "; lookForPL = " << lookForPL << endl;
-        
+
+#ifdef VSS_LIBRARY
+int vss_summarize( int argc, const char *argv[], vss_snp_callback callback, void *userData, int writeSummaryFiles )
+{
+    // the library's entry point (see vcfsummstats.h): one run of summarizeVCF() with
+    // its own copy of the arguments, since getopt_long() may reorder them
+    vector<string> argumentCopies( argv, argv + argc );
+    vector<char*> arguments( argc + 1, NULL );
+    for ( int i = 0; i < argc; i++ )
+        arguments[i] = &argumentCopies[i][0];
+    int status;
+
+    SNP_SUMMARY_CALLBACK = callback;
+    SNP_SUMMARY_USER_DATA = userData;
+    WRITE_SUMMARY_FILES = ( writeSummaryFiles != 0 );
+    try {
+        status = summarizeVCF( argc, arguments.data() );
+    } catch ( int abortStatus ) {
+        status = abortStatus;
+    }
+    cout.flush();
+    SNP_SUMMARY_CALLBACK = NULL;
+    SNP_SUMMARY_USER_DATA = NULL;
+    WRITE_SUMMARY_FILES = true;
+    return status;
+}
 #endif
 
 
+void writeCacheSampleData( ofstream& cacheFile, char* genotypeCodes, int* DPvalues, int* GQvalues, bool lookForDP, bool lookForGQ, int numSamples )
+{
+    // sample section of a cache record; see summarizeFromCache() for the layout.
+    // Half calls don't fit in 2 bits, so they are written as GT_CODE_MISSING
+    // and listed separately (they are rare in practice)
+    int numPackedBytes = (numSamples + 3) / 4;
+    unsigned char packedGenotypes[numPackedBytes];
+    unsigned char depthBytes[numSamples];
+    uint32_t numExceptions = 0, sampleIndex;
+    char code;
+
+    memset( packedGenotypes, 0, numPackedBytes );
+    for ( int i = 0; i < numSamples; i++ ) {
+        code = genotypeCodes[i];
+        if ( code > GT_CODE_MISSING ) {
+            numExceptions++;
+            code = GT_CODE_MISSING;
+        }
+        packedGenotypes[i >> 2] |= static_cast<unsigned char>( code << ((i & 3) << 1) );
     }
-    // check for bi-allelic SNPs:
-    if ( keepThis ) {
-        if ( REF[0] == 'N' || ALT[0] == 'N' || ALTlength != 1 || REFlength != 1 ) {
-            keepThis = false;
-        } else {
-            keepThis = true;
+    cacheFile.write( reinterpret_cast<char*>( packedGenotypes ), numPackedBytes );
+    cacheFile.write( reinterpret_cast<char*>( &numExceptions ), sizeof( numExceptions ) );
+    for ( int i = 0; numExceptions && i < numSamples; i++ ) {
+        if ( genotypeCodes[i] > GT_CODE_MISSING ) {
+            sampleIndex = static_cast<uint32_t>( i );
+            cacheFile.write( reinterpret_cast<char*>( &sampleIndex ), sizeof( sampleIndex ) );
+            cacheFile.write( &genotypeCodes[i], sizeof( char ) );
         }
     }
 
-//    if ( !keepThis ) {
-//#ifdef DEBUG
-//        cout << "\nSNP #" << SNPcount << ", ID = " << ID << ", has REF = " << REF << " and ALT = " << ALT << endl;
-//#endif
-//    }
-    
-    delete[] INFObuffer;
-    delete[] buffer;
-    delete[] FILTER;
-    delete[] INFO;
-    delete[] FORMAT;
-    delete[] token;
-
-    return keepThis;
+    // DP and GQ quantized to a byte each:
+    if ( lookForDP ) {
+        for ( int i = 0; i < numSamples; i++ )
+            depthBytes[i] = ( DPvalues[i] < 0 ) ? CACHE_BYTE_MISSING : static_cast<unsigned char>( min( DPvalues[i], CACHE_BYTE_MISSING - 1 ) );
+        cacheFile.write( reinterpret_cast<char*>( depthBytes ), numSamples );
+    }
+    if ( lookForGQ ) {
+        for ( int i = 0; i < numSamples; i++ )
+            depthBytes[i] = ( GQvalues[i] < 0 ) ? CACHE_BYTE_MISSING : static_cast<unsigned char>( min( GQvalues[i], CACHE_BYTE_MISSING - 1 ) );
+        cacheFile.write( reinterpret_cast<char*>( depthBytes ), numSamples );
+    }
 }
 
 
-inline void parsePL( char* tokenHolder )
+void writeCacheSiteData( ofstream& cacheFile, bool isBiallelicSNP, bool lookForDP, bool lookForGQ, double DPval, char* CHROM, char* POS, char* ID, char* REF, char* ALT, char* QUAL )
 {
-    
-    // here's the description from the VCF file specification, pp. 10-11 of
-    // http://samtools.github.io/hts-specs/VCFv4.3.pdf, accessed 7/9/19:
-    /*
-     GL (Float): Genotype likelihoods comprised of comma
-     separated floating point log10-scaled
-     likelihoods for all possible genotypes given the set
-     of alleles defined in the REF and ALT fields.
-     In presence of the GT field the same ploidy is expected;
-     without GT field, diploidy is assumed.
-     
-     PL (Integer): The phred-scaled genotype likelihoods rounded
-     to the closest integer, and otherwise defined precisely as
-     the GL field.
-     */
-    
-#ifdef DEBUG
-    //cout << "\ntokenHolder = " << tokenHolder << endl;
-    //char* tempCharArray = strtok(tokenHolder, ",");
-    //int i = 0;
-    //while ( tempCharArray ) {
-    //    cout << "\ttoken part " << ++i << ":\t" << tempCharArray << endl;
-    //    tempCharArray = strtok(NULL, ",");
-    //}
-    //cout << endl;
-    //exit(0);
-#endif
-    
+    // site section of a cache record; see summarizeFromCache() for the layout
+    unsigned char flags = 0;
+    uint16_t fieldLength;
+    char *metaFields[6] = { CHROM, POS, ID, REF, ALT, QUAL };
+
+    if ( isBiallelicSNP ) {
+        flags |= CACHE_RECORD_IS_SNP;
+        if ( lookForDP )
+            flags |= CACHE_RECORD_HAS_DP;
+        if ( lookForGQ )
+            flags |= CACHE_RECORD_HAS_GQ;
+    }
+    cacheFile.write( reinterpret_cast<char*>( &flags ), sizeof( flags ) );
+    cacheFile.write( reinterpret_cast<char*>( &DPval ), sizeof( DPval ) );
+    if ( isBiallelicSNP ) {
+        for ( int i = 0; i < 6; i++ ) {
+            fieldLength = static_cast<uint16_t>( strlen( metaFields[i] ) );
+            cacheFile.write( reinterpret_cast<char*>( &fieldLength ), sizeof( fieldLength ) );
+            cacheFile.write( metaFields[i], fieldLength );
+        }
+    }
 }
 
 
-void parsePopulationDesigFile( string fname, int& numSamples, int& numPopulations, map<string,int>& mapOfPopulations, bool popFileHeader )
+void writeCheckpoint( Checkpoint& checkpoint, string vcfName, PopulationDesignation* designations, int numDesignations, ofstream& discardedLinesFile )
 {
-    // goal is to get numSamples, numPopulations, and uniquePopulationNames
+    // records checkpoint, plus the sizes of the outputs, which are flushed first so
+    // that everything up to those sizes is on disk.  The checkpoint is written under
+    // a temporary name and renamed, so a run stopped while writing it keeps the last one
+    string checkpointName = vcfName + CHECKPOINT_SUFFIX;
+    unsigned long long fileSize;
+    long long fileModTime;
+
+    if ( !getSourceFileStats( vcfName, fileSize, fileModTime ) ) {
+        cout << "\nError in writeCheckpoint():\n\tcould not stat " << vcfName << "\n\tAborting ... \n\n";
+        abortRun(-4);
+    }
+    ofstream checkpointFile( checkpointName + ".partial", ofstream::out | ofstream::trunc );
+    if ( checkpointFile.fail() ) {
+        cout << "\nError in writeCheckpoint():\n\tcould not open " << checkpointName << ".partial\n\t--> Please make sure you have write access to the data file directory.\n\tAborting ... \n\n";
+        abortRun(-4);
+    }
+    checkpointFile << CHECKPOINT_HEADER << "\n";
+    checkpointFile << "commandLine\t" << COMMAND_LINE << "\n";
+    checkpointFile << "VCF\t" << fileSize << "\t" << fileModTime << "\n";
+    checkpointFile << "input\t" << checkpoint.dataStart << "\t" << checkpoint.inputOffset << "\t" << checkpoint.virtualOffset << "\n";
+    checkpointFile << "lines\t" << checkpoint.VCFfileLineCount << "\t" << checkpoint.SNPcount << "\n";
+    checkpointFile << "format\t" << checkpoint.checkFormat << "\t" << checkpoint.lookForDP << "\t" << checkpoint.lookForGQ << "\t" << checkpoint.lookForPL << "\t" << checkpoint.lookForDPinINFO;
+    checkpointFile << "\t" << checkpoint.numTokensInFormat << "\t" << checkpoint.GTtoken << "\t" << checkpoint.DPtoken << "\t" << checkpoint.GQtoken << "\t" << checkpoint.PLtoken;
+    checkpointFile << "\t" << checkpoint.formatOpsOrder.size();
+    for ( size_t i = 0; i < checkpoint.formatOpsOrder.size(); i++ )
+        checkpointFile << "\t" << checkpoint.formatOpsOrder[i];
+    checkpointFile << "\n";
+
+    // the sizes of the outputs, as they are on disk:
+    discardedLinesFile.flush();
+    getSourceFileStats( vcfName + "_discardedLineNums.txt", fileSize, fileModTime );
+    checkpointFile << "discarded\t" << fileSize << "\n";
+    for ( int d = 0; d < numDesignations; d++ ) {
+        PopulationDesignation& designation = designations[d];
+        designation.outputFile.flush();
+        if ( !SPLIT_BY_CHROM ) {
+            getSourceFileStats( designation.outputFileName, fileSize, fileModTime );
+            checkpointFile << "summary\t" << d << "\t" << fileSize << "\n";
+            continue;
+        }
+        for ( size_t i = 0; i < designation.chromFiles.size(); i++ ) {
+            ChromOutputFile& chromFile = designation.chromFiles[i];
+            getSourceFileStats( chromFile.fileName, fileSize, fileModTime );
+            checkpointFile << "chrom\t" << d << "\t" << chromFile.CHROM << "\t" << chromFile.numRows << "\t" << chromFile.minPOS << "\t" << chromFile.maxPOS << "\t" << fileSize << "\n";
+        }
+    }
+    checkpointFile << "end" << endl;
+    checkpointFile.close();
+    if ( checkpointFile.fail() || rename( ( checkpointName + ".partial" ).c_str(), checkpointName.c_str() ) != 0 ) {
+        cout << "\nError in writeCheckpoint():\n\tcould not write " << checkpointName << "\n\tAborting ... \n\n";
+        abortRun(-4);
+    }
+}
 
-    ifstream popMapFile( fname );
-    string sampleID, popMembership;
-    int countPops = 0, countSamples = 0, lineCount = 0;
-    map<string, int> tempSampleMap;
 
-    if ( !popMapFile.good() ) {
-        cout << "\nError in parseCommandLineInput():\n\tPopulation file name '" << fname << "' not found!\n\t--> Check spelling and path.\n\tAborting ... \n\n";
-        exit( -1 );
+void writeChromIndex( PopulationDesignation& designation )
+{
+    // lists the files written with --split-by-chrom, one row per CHROM in order of
+    // first appearance.  File names are given without their directory, since the
+    // index sits in the same directory as the files
+    string indexFileName = designation.outputFileName;
+    indexFileName = indexFileName.substr( 0, indexFileName.rfind( "_Unfiltered_Summary.tsv" ) ) + "_CHROMindex.tsv";
+    ofstream indexFile( indexFileName, ofstream::out );
+    if ( indexFile.fail() ) {
+        cout << "\nError in writeChromIndex():\n\tcould not open " << indexFileName << "\n\t--> Please make sure you have write access to the data file directory.\n\tAborting ... \n\n";
+        abortRun(-4);
     }
+    indexFile << "CHROM\tfile\tnumRows\tminPOS\tmaxPOS" << endl;
+    for ( size_t i = 0; i < designation.chromFiles.size(); i++ ) {
+        ChromOutputFile& chromFile = designation.chromFiles[i];
+        indexFile << chromFile.CHROM << "\t" << chromFile.fileName.substr( chromFile.fileName.find_last_of( '/' ) + 1 );
+        indexFile << "\t" << chromFile.numRows << "\t" << chromFile.minPOS << "\t" << chromFile.maxPOS << endl;
+    }
+    indexFile.close();
+}
 
 
-    if ( popFileHeader ) {
-        popMapFile.ignore(unsigned(-1), '\n'); // skip header line
+void writeHWEcolumns( ofstream& outputFile, int popCodeCounts[], int numPopulations )
+{
+    // --hwe: each population's diploid genotype counts and HWE exact-test p-value
+    int homoRef, het, homoAlt;
+    for ( int i = 0; i < numPopulations; i++ ) {
+        homoRef = popCodeCounts[ i * NUM_GT_CODES + GT_CODE_HOMO_REF ];
+        het = popCodeCounts[ i * NUM_GT_CODES + GT_CODE_HET ];
+        homoAlt = popCodeCounts[ i * NUM_GT_CODES + GT_CODE_HOMO_ALT ];
+        outputFile << "\t" << homoRef << "\t" << het << "\t" << homoAlt << "\t";
+        if ( homoRef + het + homoAlt )
+            outputFile << lookUpHWEpvalue( homoRef, het, homoAlt );
+        else
+            outputFile << MISSING_DATA_INDICATOR;
     }
-
-    while( popMapFile >> sampleID >> popMembership ) {
-//        cout << sampleID << "\t" << popMembership << endl;
-        ++lineCount;
-        if ( tempSampleMap.count( sampleID ) ) {
-            cerr << "\nError! Duplicate Sample ID (" << sampleID << ") found!\n\tAborting ...\n";
-            exit(-1);
-        } else {
-            tempSampleMap.insert( pair<string, int>(sampleID, ++countSamples) );
-        }
-        if ( !mapOfPopulations.count( popMembership ) ) {
-            mapOfPopulations.insert( pair<string, int>(popMembership, ++countPops) );
-        }
+}
 
 
+void writeINFOcolumns( ostream& outputFile )
+{
+    // one column per --info-cols key, as written in the VCF; flags are written as 1
+    for ( size_t i = 0; i < INFO_OUTPUT_COLS.size(); i++ ) {
+        int key = INFO_OUTPUT_COLS[i];
+        outputFile << "\t";
+        if ( INFO_KEYS.values[key] == NULL )
+            outputFile << MISSING_DATA_INDICATOR;
+        else if ( !INFO_KEYS.valueLengths[key] )
+            outputFile << "1";
+        else
+            outputFile.write( INFO_KEYS.values[key], INFO_KEYS.valueLengths[key] );
     }
-//    cout << "lineCount is " << lineCount << endl;
+}
 
-    popMapFile.close();
 
-    numSamples = countSamples;
-    numPopulations = countPops;
+void writePlinkSNP( PlinkExport& plink, char* genotypeCodes, int numSamples, char* CHROM, char* POS, char* ID, char* REF, char* ALT )
+{
+    // adds a summarized SNP to the .bim and its genotypes to the .bed, packed from
+    // the decoded codes four samples to a byte, the first sample in the low bits
+    for ( int byte = 0, i = 0; byte < plink.numBytes; byte++ ) {
+        unsigned char packed = 0;
+        for ( int shift = 0; shift < 8 && i < numSamples; shift += 2, i++ )
+            packed |= PLINK_CODE_BY_GT_CODE[ static_cast<int>( genotypeCodes[i] ) ] << shift;
+        plink.packed[byte] = packed;
+    }
+    plink.bed.write( reinterpret_cast<char*>( plink.packed.data() ), plink.numBytes );
+    plink.bim << CHROM << "\t" << ID << "\t0\t" << POS << "\t" << ALT << "\t" << REF << "\n";
+    plink.numSNPs++;
+}
 
 
-    string uniquePopulationNames[numPopulations];
-    int counter = 0;
-    //cout << "\nInitial state of mapOfPopulations:\n\tkey\tvalue\n";
-    // get an alphabetical list of names:
-    for( map<string, int>::const_iterator it = mapOfPopulations.begin();
-        counter < numPopulations;
-        counter++ )
-    {
-        uniquePopulationNames[counter] = it->first;
-        // cout << "\t" << it->first << "\t" << it->second << endl;
-        it++;
+void writeSFS( PopulationDesignation& designation )
+{
+    // writes the spectra next to the summary file, each as a title line followed by
+    // a matrix: one row for a 1D spectrum (entry j = sites with j ALT alleles), and
+    // for a joint spectrum one row per ALT count in the first population
+    string SFSfileName = designation.outputFileName;
+    SFSfileName = SFSfileName.substr( 0, SFSfileName.rfind( "_Unfiltered_Summary.tsv" ) ) + "_SFS.txt";
+    ofstream SFSfile( SFSfileName, ofstream::out );
+    if ( SFSfile.fail() ) {
+        cout << "\nError in writeSFS():\n\tcould not open " << SFSfileName << "\n\t--> Please make sure you have write access to the data file directory.\n\tAborting ... \n\n";
+        abortRun(-4);
     }
-    counter = 0; // reassign integer designations based upon alphabetical ordering
-    string dums;
-    for( map<string, int>::const_iterator it = mapOfPopulations.begin();
-        counter < numPopulations;
-        counter++ )
-    {
-        dums = uniquePopulationNames[counter];
-        // change value:
-        mapOfPopulations[ dums ] = counter;
-        it++;
+    SFSfile.precision( 10 );
+    vector<string> popNames( designation.numPopulations );
+    for ( map<string, int>::const_iterator it = designation.mapOfPopulations.begin(); it != designation.mapOfPopulations.end(); it++ )
+        popNames[ it->second ] = it->first;
+
+    for ( int pop = 0; pop < designation.numPopulations; pop++ ) {
+        if ( !designation.SFSsizes[pop] )
+            continue;
+        SFSfile << "SFS\t" << popNames[pop] << "\tprojection=" << designation.SFSsizes[pop] << "\tsites=" << designation.SFS1Dsites[pop] << endl;
+        for ( int j = 0; j <= designation.SFSsizes[pop]; j++ )
+            SFSfile << ( j ? "\t" : "" ) << designation.SFS1D[pop][j];
+        SFSfile << endl << endl;
     }
-
-    if ( VERBOSE )
-        cout << "\nPopulation designations by integer ID:\n";
-    for ( int i = 0; i < numPopulations; i++ ) {
-        if ( VERBOSE )
-            cout << "\tPopulation " << i << " is " << uniquePopulationNames[i] << endl;
-        dums = uniquePopulationNames[i];
-        if ( mapOfPopulations[ dums ] != i ) {
-            cerr << "\nError in parsePopulationDesigFile():\n\tindexes not set up as you expect!\n\tAborting ... \n";
-            exit(-1);
+    for ( size_t i = 0; i < designation.SFSpairs.size(); i++ ) {
+        int pop1 = designation.SFSpairs[i].first, pop2 = designation.SFSpairs[i].second;
+        int columns = designation.SFSsizes[pop2] + 1;
+        SFSfile << "JointSFS\t" << popNames[pop1] << "\t" << popNames[pop2] << "\tprojection=" << designation.SFSsizes[pop1] << "x" << designation.SFSsizes[pop2];
+        SFSfile << "\tsites=" << designation.SFS2Dsites[i] << endl;
+        for ( int j1 = 0; j1 <= designation.SFSsizes[pop1]; j1++ ) {
+            for ( int j2 = 0; j2 < columns; j2++ )
+                SFSfile << ( j2 ? "\t" : "" ) << designation.SFS2D[i][ j1 * columns + j2 ];
+            SFSfile << endl;
         }
+        SFSfile << endl;
     }
-
+    SFSfile.close();
 }
 
-void setUpOutputFile (ofstream& outputFile, string vcfName, int numPopulations, map<string, int> mapOfPopulations )
-{
-    string filename = vcfName + "_Unfiltered_Summary" + ".tsv";
-    string popHeader, popName, colHeaders, alleleCountHeader;
-    int popIndex;
-    map<string, int>::const_iterator it = mapOfPopulations.begin();
 
-    // open file for output
-    outputFile.open( filename, ofstream::out );
-    if ( outputFile.fail() ) {
-        cout << "\nError in setUpOutputFile():\n\toutputFile.fail()!\n\t--> Please make sure you have write access to the data file directory.\n\tAborting ... \n\n";
-        exit(-4);
+void writeSampleSummary( SampleStats& stats, string* sampleIDs, string filename )
+{
+    // writes one row per sample.  missingRate counts
+    // genotypes with neither allele called, and observedHet is out of genotypes with
+    // both alleles called.  Statistics without any data are written as NA
+    ofstream summaryFile( filename, ofstream::out );
+    if ( summaryFile.fail() ) {
+        cout << "\nError in writeSampleSummary():\n\tcould not open " << filename << "\n\t--> Please make sure you have write access to the data file directory.\n\tAborting ... \n\n";
+        abortRun(-4);
     }
-    // first several column headers:
-    colHeaders = "VCFlineNum\tCHROM\tPOS\tID\tREF\tALT\tQUAL\tmedianDP\tmedianGQ\thomoRefCount\thetCount\thomoAltCount";
-    // put first few headers in file:
-    outputFile << colHeaders;
+    summaryFile << "sampleID\tnumSites\tnumCalled\tnumMissing\tmissingRate\tobservedHet\tmeanDP\tmedianDP\tmeanGQ" << endl;
+    for ( int i = 0; i < stats.numSamples; i++ ) {
+        summaryFile << sampleIDs[i] << "\t" << stats.numSites << "\t" << stats.calledCount[i] << "\t" << stats.missingCount[i];
+        if ( stats.numSites )
+            summaryFile << "\t" << static_cast<double>( stats.missingCount[i] ) / static_cast<double>( stats.numSites );
+        else
+            summaryFile << "\t" << MISSING_DATA_INDICATOR;
+        if ( stats.calledCount[i] )
+            summaryFile << "\t" << static_cast<double>( stats.hetCount[i] ) / static_cast<double>( stats.calledCount[i] );
+        else
+            summaryFile << "\t" << MISSING_DATA_INDICATOR;
+        if ( stats.DPcount[i] ) {
+            // same median position as calculateMedian(), found by walking the histogram:
+            unsigned int *histogram = stats.DPhistogram.data() + static_cast<size_t>( i ) * SAMPLE_DP_HISTOGRAM_BINS;
+            unsigned long int medianSpot = stats.DPcount[i] / 2, seen = 0;
+            int bin = 0;
+            while ( seen + histogram[bin] <= medianSpot ) {
+                seen += histogram[bin];
+                bin++;
+            }
+            summaryFile << "\t" << static_cast<double>( stats.DPsum[i] ) / static_cast<double>( stats.DPcount[i] ) << "\t" << bin;
+        } else {
+            summaryFile << "\t" << MISSING_DATA_INDICATOR << "\t" << MISSING_DATA_INDICATOR;
+        }
+        if ( stats.GQcount[i] )
+            summaryFile << "\t" << static_cast<double>( stats.GQsum[i] ) / static_cast<double>( stats.GQcount[i] );
+        else
+            summaryFile << "\t" << MISSING_DATA_INDICATOR;
+        summaryFile << endl;
+    }
+    summaryFile.close();
+    cout << "\nPer-sample statistics written to " << filename << endl;
+}
 
 
-    // loop over populations:
-    popHeader = "\tALT_SNP_freq_";
-    alleleCountHeader = "\trawAlleleCount_";
+void writeSummaryColumns( ofstream& outputFile, int medianDP, int medianGQ, int homoRefCount, int hetCount, int homoAltCount, int altAlleleCounts[], int validSampleCounts[], int numPopulations )
+{
+    // medianDP:
+    if ( medianDP != MEDIAN_NOT_AVAILABLE ) {
+        outputFile << "\t" << medianDP;
+    } else {
+        outputFile << "\t" << MISSING_DATA_INDICATOR;
+    }
+    // median GQ:
+    if ( medianGQ != MEDIAN_NOT_AVAILABLE ) {
+        outputFile << "\t" << medianGQ;
+    } else {
+        outputFile << "\t" << MISSING_DATA_INDICATOR;
+    }
+    // diploid genotype counts:
+    outputFile << "\t" << homoRefCount << "\t" << hetCount << "\t" << homoAltCount;
+    double freq;
     for ( int i = 0; i < numPopulations; i++ ) {
-        popName = it->first;
-        popIndex = it->second;
-        if ( popIndex != i ) {
-            cout << "\nError in setUpOutputFile():\n\tmap isn't ordered as you expect!\n\tAborting ... \n\n";
-            exit(-4);
+        if ( !validSampleCounts[i] ) {
+          // no div by zero
+            freq = std::numeric_limits<double>::quiet_NaN();
+        } else {
+            freq = static_cast<double>( altAlleleCounts[i] ) / static_cast<double>( validSampleCounts[i] );
         }
-        outputFile << popHeader << popName << alleleCountHeader << popName;
-        it++;
+        outputFile << "\t" << freq << "\t" << validSampleCounts[i];
     }
-    outputFile << endl;
+}
 
-    //outputFile.close();
 
+bool writeToSocket( int fd, const char* data, size_t length )
+{
+    // writes all of data, or returns false if the connection has failed
+    while ( length > 0 ) {
+        ssize_t written = write( fd, data, length );
+        if ( written < 0 && errno == EINTR )
+            continue;
+        if ( written <= 0 )
+            return false;
+        data += written;
+        length -= written;
+    }
+    return true;
 }
@@ -3,45 +3,571 @@
 #include <fstream>
 #include <string>
 #include <map>
+#include <unordered_map>
+#include <vector>
+#include <set>
+#include <cstdint>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
 using namespace std;
 
 #include <boost/iostreams/filtering_streambuf.hpp>
 
+// --read-ahead uses io_uring where the kernel headers have it, and pread() otherwise
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+
+// class definitions:
+
+// the summary file of one CHROM under --split-by-chrom, with what its line in
+// the index file needs (see writeChromIndex())
+struct ChromOutputFile {
+    string CHROM;
+    string fileName;
+    unsigned long int numRows;
+    long int minPOS, maxPOS;
+};
+
+// the sample IDs of one population file, in an open-addressing hash table built
+// by parsePopulationDesigFile(), so that a million samples load in one pass and
+// each VCF column costs one hash lookup (see findSample())
+struct SampleTable {
+    vector<string> IDs;                 // in population file order
+    vector<int> popIndexes;             // population index of each of IDs
+    vector<int> slots;                  // hash slot -> index into IDs, or -1
+    unsigned int mask;
+};
+
+// one population designation file (-P) and everything derived from it; the
+// program accepts several, and all of them are tallied from a single pass
+struct PopulationDesignation {
+    string popFileName;
+    string outputFileName;
+    int numPopulations;
+    map<string, int> mapOfPopulations;  // key = population ID, value = integer population index
+    SampleTable samples;                // sample ID -> population index
+    vector<int> populationReference;    // population index of each sample column in the VCF
+    vector<const char*> populationNames;    // by population index, for the library's callback
+    ofstream outputFile;
+    // LD mode (see updateLD()):
+    vector<uint64_t> populationMasks;   // one bit per sample, numWords per population
+    ofstream LDfile;
+    vector<double> LDbinR2sums, LDbinDprimeSums;    // --ld-bin: bin * numPopulations + population
+    vector<unsigned long int> LDbinPairs;
+    // site frequency spectra (see accumulateSFS()):
+    vector<int> SFSsizes;               // projection size in alleles per population; 0 = no SFS
+    vector< vector<double> > SFS1D;     // per population, SFSsizes + 1 entries
+    vector<unsigned long int> SFS1Dsites;
+    vector< pair<int, int> > SFSpairs;  // populations of each joint SFS
+    vector< vector<double> > SFS2D;     // per pair, row-major by the first population's count
+    vector<unsigned long int> SFS2Dsites;
+    // --split-by-chrom: outputFile is the current CHROM's file (see selectChromOutputFile()):
+    vector<ChromOutputFile> chromFiles;     // in order of first appearance
+    map<string, int> chromFileIndex;        // key = CHROM, value = index into chromFiles
+    int currentChromFile;                   // -1 until the first row is written
+};
+
+// one instruction of a compiled --filter program; programs are flat lists
+// in postfix order, evaluated with a small stack of bools
+struct FilterInstruction {
+    int opcode;             // FILTER_OP_* code
+    int comparison;         // FILTER_CMP_* code, for predicates
+    double value;           // right-hand side of numeric comparisons
+    bool numericValue;      // false if the right-hand side is compared as text
+    int INFOkey;            // index into INFO_KEYS, for INFO.key predicates
+    string text;            // right-hand side of text comparisons
+    set<string> textSet;    // right-hand side of 'in { ... }'
+    string lastCHROM;       // CHROM changes rarely, so its last result is remembered
+    bool lastResult;
+};
+
+// the INFO keys the program needs (DP, INFO.key in --filter, --info-cols); they are
+// matched through a perfect hash built by buildINFOkeyTable(), and tokenizeINFO()
+// records where each one's value sits in the current line's INFO column
+struct INFOkeyTable {
+    vector<string> keys;
+    vector<int> slots;                  // hash slot -> index into keys, or -1
+    unsigned int seed, mask;
+    vector<const char*> values;         // NULL if the key is absent from the current line
+    vector<size_t> valueLengths;        // 0 for flags
+};
+
+// how to read the sample columns under one FORMAT string (see lookUpFormatPlan());
+// with -f > 1 each distinct FORMAT is tokenized once, and later lines with the
+// same FORMAT only cost a hash lookup
+struct FormatPlan {
+    int numTokensInFormat;
+    int GTtoken, DPtoken, GQtoken, PLtoken;     // subfield indexes from 1; -1 if absent
+    bool lookForDP, lookForGQ, lookForPL;
+    vector<int> formatOpsOrder;                 // see determineFormatOpsOrder()
+};
+
+struct FormatPlanCache {
+    unordered_map<string, FormatPlan> plans;    // by FORMAT string
+    string key;     // reused for each lookup, so a known FORMAT costs no allocation
+};
+
+// hands out the data lines of the VCF one at a time (see readVCFline()); the
+// source is read in large blocks, so the decompressing streambuf is called once
+// per block instead of once per field
+struct VCFlineReader {
+    istream *source;
+    char *block;
+    size_t blockSize;   // grows if a single line doesn't fit
+    size_t start;       // first byte not yet handed out
+    size_t scanned;     // bytes before this were already searched for '\n'
+    size_t end;         // one past the last byte read from source
+    bool sourceDone;
+    unsigned long long blockOffset;     // offset of block[0] in the uncompressed VCF
+    VCFlineReader();
+    ~VCFlineReader();                   // frees the block, also when a library run unwinds
+};
+
+// one line of a record index (see buildRecordIndex()): where a data line of an
+// uncompressed VCF starts, and which line it is
+struct RecordIndexEntry {
+    unsigned long long offset;
+    unsigned long int VCFlineNum;
+    string CHROM, POS;
+};
+
+// one FORMAT field of the current BCF record: numSamples * count values of
+// BCF_TYPE_SIZES[type] bytes, starting at data (NULL if the record lacks it)
+struct BCFfield {
+    const unsigned char *data;
+    int type;
+    int count;          // values per sample
+};
+
+// a .bcf input (see readBCFheader() and readBCFrecord()); the header's dictionaries
+// are looked up once, and each record's meta columns are written out as VCF text
+// so that parseMetaColData() handles them like a line of a VCF
+struct BCFreader {
+    istream *source;
+    vector<string> dictionary;          // FILTER, INFO and FORMAT IDs by index; PASS is 0
+    vector<string> contigs;             // CHROM by index
+    int GTkey, DPkey, GQkey;            // indices in dictionary, or -1
+    vector<unsigned char> record;       // shared and per-sample data of the current record
+    string metaColumns;                 // CHROM to FORMAT of the current record
+    BCFfield GT, DP, GQ;
+};
+
+// the VCF file read ahead of the decompressor or parser (--read-ahead): depth
+// buffers of READ_AHEAD_BUFFER_SIZE, filled in file order either by io_uring reads
+// that are all in flight at once, or by a prefetch thread calling pread().
+// readAhead() hands the buffers out in order and refills each one once it's used
+struct ReadAheadState {
+    int fd;
+    unsigned long long fileSize;
+    unsigned long long nextOffset;      // file offset of the next read to start
+    int depth;
+    vector< vector<char> > buffers;
+    vector<size_t> bufferLengths;       // bytes the read into each buffer asks for
+    vector<size_t> bufferFilled;        // bytes read into it so far
+    vector<unsigned long long> bufferOffsets;   // file offset of each buffer's first byte
+    vector<int> bufferStates;           // READ_AHEAD_FREE, _IN_FLIGHT or _READY
+    vector<chrono::steady_clock::time_point> startTimes;    // for --read-throttle
+    int current;                        // buffer being handed out
+    size_t handedOut;                   // bytes of it already handed out
+    int readError;                      // errno of a failed read, 0 if none
+    // io_uring (ringFd is -1 if it isn't used):
+    int ringFd;
+    bool fixedBuffers;                  // buffers are registered with the ring
+#ifdef HAVE_IO_URING
+    void *sqRing, *cqRing;
+    size_t sqRingSize, cqRingSize, sqesSize;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned *sqTail, *sqMask, *sqArray, *cqHead, *cqTail, *cqMask;
+#endif
+    // pread() in a prefetch thread otherwise (see prefetchWithPread()):
+    thread prefetchThread;
+    mutex lock;
+    condition_variable changed;
+    bool prefetchDone, stopPrefetch;
+    ReadAheadState();
+    ~ReadAheadState();                  // stops the reads and closes the file
+};
+
+// the boost::iostreams Source that createVCFfilter() pushes for --read-ahead
+struct ReadAheadSource {
+    typedef char char_type;
+    struct category : boost::iostreams::source_tag, boost::iostreams::closable_tag {};
+    shared_ptr<ReadAheadState> state;   // shared by the copies the chain makes
+    streamsize read( char* s, streamsize n );
+    void close();
+};
+
+// where --resume picks up a stopped run (see writeCheckpoint()).  The sizes of
+// the output files are not kept here; readCheckpoint() truncates the files to
+// them as soon as it reads them
+struct Checkpoint {
+    unsigned long long dataStart;       // uncompressed bytes of the VCF header, through the #CHROM line
+    unsigned long long inputOffset;     // uncompressed bytes of the VCF before the next line to parse
+    long long virtualOffset;            // BGZF block offset << 16 | offset in the block; -1 if not BGZF
+    unsigned long int VCFfileLineCount;
+    long int SNPcount;
+    // FORMAT parse state, as kept by parseActualData():
+    bool checkFormat, lookForDP, lookForGQ, lookForPL, lookForDPinINFO;
+    int numTokensInFormat, GTtoken, DPtoken, GQtoken, PLtoken;
+    vector<int> formatOpsOrder;
+};
+
+// the SNPs that new SNPs are compared with in LD mode, as a ring buffer.  Each
+// SNP's genotypes are three bit-planes of numWords words: called (both alleles),
+// at least one ALT, and homozygous ALT, so that dosage = bit 2 + bit 3
+struct LDwindow {
+    int numSamples, numWords;
+    int capacity, first, count;
+    vector<uint64_t> planes;    // (capacity + 1) * 3 * numWords
+    vector<long int> positions;
+    string CHROM;
+};
+
+// --record-batch: kept SNPs whose rows flushGenotypeBatch() writes together, so
+// that reduceGenotypeBatch() can tally the whole batch one block of samples at a time
+struct GenotypeBatch {
+    int capacity, numRecords, numSamples;
+    vector<char> genotypeCodes;         // one row of numSamples codes per record
+    vector<unsigned long int> lineNumbers;
+    vector<int> medianDPs, medianGQs;
+    vector<string> metaFields;          // CHROM, POS, ID, REF, ALT and QUAL of each record
+    vector<string> INFOcolumns;         // the --info-cols text of each record
+    vector<int> popCodeCounts;          // per designation, record and population, NUM_GT_CODES counts
+};
+
+// --sample-threads: one chunk of a line's sample columns, split at a tab (see
+// decodeSampleChunk()); its tallies are summed in chunk order, so the result
+// is the same as decoding the line in one piece
+struct SampleChunk {
+    char *start;                        // the tab before the chunk's first sample
+    int firstSample, numSamples;
+    int DPnoCall, GQnoCall;
+    vector<int> DPhistogram, GQhistogram;   // SAMPLE_HISTOGRAM_SIZE counts of -1, 0, 1, ...
+    bool outOfHistogram;                // a DP or GQ the histograms can't hold
+    vector< vector<int> > popCounts;    // per designation: altAlleleCounts, validSampleCounts, then (--hwe) popCodeCounts
+    int homoRefCount, hetCount, homoAltCount;
+    int status;                         // abortRun() status of a failed chunk (library build), else 0
+};
+
+// --sample-threads: workers that decode and tally chunks of each long line
+// together with the calling thread, which does the last chunk itself
+struct SampleThreadPool {
+    vector<thread> workers;             // worker i does chunk i
+    vector<SampleChunk> chunks;
+    // the current line (see decodeSampleChunks()):
+    char *sampleData, *lineEnd;
+    int numTokensInFormat, *formatOpsOrder;
+    bool lookForDP, lookForGQ, lookForPL, tally;
+    char formatDelim;
+    char *genotypeCodes;
+    int *DPvalues, *GQvalues;
+    int numSamples;
+    PopulationDesignation *designations;
+    int numDesignations;
+    // merged results:
+    bool decoded;                       // false if the line didn't have numSamples columns
+    vector<int> DPhistogram, GQhistogram;
+    bool outOfHistogram;
+    mutex lock;
+    condition_variable startWork, columnsCounted, workDone;
+    unsigned long int round;            // bumped for each line
+    int chunksCounting, chunksLeft;
+    bool stop;
+    ~SampleThreadPool();                // stops the workers, also when a library run unwinds
+};
+
+// --serve: the genotype cache of one VCF, held in memory between requests (see
+// loadServedCache()); a request reads it through a MemoryBuffer instead of from disk
+struct ServedCache {
+    string bytes;                       // the whole cache file
+    unsigned long long fileSize;        // of the cache file when it was read, to notice a rebuilt cache
+    long long fileModTime;
+    unsigned long int lastUsed;         // request number, for evicting the least recently used
+};
+
+// a stream buffer over bytes that are already in memory
+struct MemoryBuffer : streambuf {
+    MemoryBuffer( const char* data, size_t length );
+};
+
+// --export-plink: the PLINK 1 files written alongside the summary; see setUpPlinkExport()
+struct PlinkExport {
+    string prefix;
+    ofstream bed, bim;
+    int numBytes;               // per SNP in the .bed, 4 samples to a byte
+    vector<unsigned char> packed;   // the current SNP's .bed bytes
+    unsigned long int numSNPs;
+};
+
+// per-sample QC totals for --sample-stats, one array per statistic so that
+// each update walks memory in sample order
+struct SampleStats {
+    int numSamples;
+    unsigned long int numSites;         // sites that were kept and summarized
+    vector<unsigned long int> calledCount;      // both alleles called
+    vector<unsigned long int> missingCount;     // neither allele called
+    vector<unsigned long int> hetCount;
+    vector<unsigned long int> DPcount;          // sites with a DP value
+    vector<unsigned long long int> DPsum;
+    vector<unsigned int> DPhistogram;           // SAMPLE_DP_HISTOGRAM_BINS per sample, for the median
+    vector<unsigned long int> GQcount;
+    vector<unsigned long long int> GQsum;
+};
 
 
 // function prototypes (in alphabetical order):
-void assignPopIndexToSamples( map<string, int>& mapOfPopulations, map<string, int>& mapOfSamples, ifstream& PopulationFile, int numSamplesPerPopulation[], int numPopulations, int numSamples );
+[[noreturn]] void abortRun( int status );
+
+void accumulateSampleStats( SampleStats& stats, char* genotypeCodes, int* DPvalues, int* GQvalues, bool lookForDP, bool lookForGQ );
+
+void accumulateSFS( PopulationDesignation& designation, int altAlleleCounts[], int validSampleCounts[] );
+
+int addINFOkey( string key );
+
+void addToGenotypeBatch( GenotypeBatch& batch, unsigned long int VCFfileLineCount, char* CHROM, char* POS, char* ID, char* REF, char* ALT, char* QUAL, int medianDP, int medianGQ, PopulationDesignation* designations, int numDesignations );
+
+void appendBCFvalues( string& text, const unsigned char*& cursor, const unsigned char* end, int type, int count );
+
+void appendPartFile( ofstream& mergedFile, string partFileName, string sourceFile, bool withHeader );
+
+bool assignSamplesToPopulations(istream& VCFfile, int numSamples, PopulationDesignation* designations, int numDesignations, string* sampleIDs, unsigned long int& VCFfileLineCount, int& firstDataLineNumber );
+
+void buildINFOkeyTable( INFOkeyTable& table );
+
+void buildRecordIndex( string vcfName );
 
-bool assignSamplesToPopulations(istream& VCFfile, int numSamples, int numFields, map<string, int> mapOfSamples, int *populationReference, unsigned long int& VCFfileLineCount, int& firstDataLineNumber );
+double calculateHWEpvalue( int homoRefCount, int hetCount, int homoAltCount );
 
-inline int calculateMedian( int values[], int n );
+void calculateFilterGenotypeStats( char* genotypeCodes, int numSamples, double& MAF, double& callRate );
 
-void calculateSummaryStats( istream& VCFfile, ofstream& outputFile, int numTokensInFormat, int GTtoken, int DPtoken, int GQtoken, int PLtoken, bool lookForDP, bool lookForGQ, bool lookForPL, char formatDelim, int formatOpsOrder[], int numSamples, int numPopulations, unsigned long int VCFfileLineCount, int* populationReference );
+inline int calculateMedian( int values[], int n, int ignoreFirst );
 
-inline void checkFormatToken( char* token, int& GTtoken, int& DPtoken, int& GQtoken, int& PLtoken, int subfieldCount  );
+bool calculateLD( uint64_t* snp1, uint64_t* snp2, uint64_t* populationMask, int numWords, double& r2, double& Dprime );
+
+bool calculateSummaryStats( char* sampleData, bool keepThis, int numTokensInFormat, bool lookForDP, bool lookForGQ, bool lookForPL, char formatDelim, int formatOpsOrder[], int numSamples, PopulationDesignation* designations, int numDesignations, unsigned long int VCFfileLineCount, char* CHROM, char* POS, char* ID, char* REF, char* ALT, char* QUAL, char* FILTER, char* genotypeCodes, int* DPvalues, int* GQvalues, ofstream* cacheFile, SampleStats* sampleStats, LDwindow* LD, PlinkExport* plink, GenotypeBatch* batch, SampleThreadPool* sampleThreads, BCFreader* BCF );
+
+inline void checkFormatToken( const string& token, int& GTtoken, int& DPtoken, int& GQtoken, int& PLtoken, int subfieldCount  );
+
+bool checkGenotypeCache( istream& cacheFile, string vcfName, int numFormats, char formatDelim, int maxSubfieldsInFormat );
+
+void checkSampleColumns( string* sampleIDs, int numSamples, string source );
+
+void closeLineReader( VCFlineReader& reader );
+
+
+void compileFilterExpression( string expression );
 
 void convertTimeInterval( clock_t myTimeInterval, int& minutes, double& seconds);
 
+inline void copyVCFfield( char*& cursor, char* field );
+
+unsigned long long countVCFheaderBytes( string vcfName );
+
 void createVCFfilter( boost::iostreams::filtering_streambuf<boost::iostreams::input>& myVCFin, string vcfName, ifstream& vcfUnfiltered );
 
+void decodeBCFsamples( BCFreader& reader, bool lookForDP, bool lookForGQ, int numSamples, char* genotypeCodes, int* DPvalues, int* GQvalues, int& DPnoCall, int& GQnoCall );
+
+void decodeSampleChunk( SampleThreadPool& pool, int chunkIndex );
+
+void decodeSampleChunks( SampleThreadPool& pool, char* sampleData, int numTokensInFormat, bool lookForDP, bool lookForGQ, bool lookForPL, char formatDelim, int formatOpsOrder[], int numSamples, char* genotypeCodes, int* DPvalues, int* GQvalues, int& DPnoCall, int& GQnoCall, bool tally );
+
+void decodeSampleColumns( char* sampleData, int numTokensInFormat, bool lookForDP, bool lookForGQ, bool lookForPL, char formatDelim, int formatOpsOrder[], int numSamples, char* genotypeCodes, int* DPvalues, int* GQvalues, int& DPnoCall, int& GQnoCall, bool endsLine );
+
 void determineFormatOpsOrder( int numTokensInFormat, int GTtoken, int DPtoken, int GQtoken, int PLtoken, bool lookForDP, bool lookForGQ, bool lookForPL, char formatDelim, int formatOpsOrder[], int maxSubfieldsInFormat );
 
 inline void errorCheckTokens( int GTtoken, int DPtoken, int GQtoken, int PLtoken, bool& lookForDP, bool& lookForGQ, bool& lookForPL );
 
+bool evaluateFilterPredicate( FilterInstruction& instruction, char* CHROM, char* POS, char* QUAL, char* FILTER, double MAF, double callRate );
+
+bool evaluateFilterProgram( vector<FilterInstruction>& program, char* CHROM, char* POS, char* QUAL, char* FILTER, double MAF, double callRate );
+
 //void makePopulationMap( map<string, int>& mapOfPopulations, int numPopulations, string popFileName );
 
-double extractDPvalue( char* INFObuffer, bool& lookForDPinINFO );
+double extractDPvalue( INFOkeyTable& table, bool& lookForDPinINFO );
+
+long long findBGZFvirtualOffset( ifstream& compressedFile, unsigned long long& blockStart, unsigned long long& blockDataStart, unsigned long long target );
+
+unsigned long long findNextBGZFblock( ifstream& compressedFile, unsigned long long target, unsigned long long fileSize );
+
+int findSample( const SampleTable& samples, const char* ID, size_t length );
+
+void finishGenotypeBatch( GenotypeBatch& batch, PopulationDesignation* designations, int numDesignations );
+
+void finishLD( LDwindow& LD, PopulationDesignation* designations, int numDesignations );
+
+void finishPlinkExport( PlinkExport& plink );
+
+void finishSampleThreads( SampleThreadPool& pool );
+
+void flushGenotypeBatch( GenotypeBatch& batch, PopulationDesignation* designations, int numDesignations );
+
+inline bool filterCompareNumber( FilterInstruction& instruction, double number );
+
+inline bool filterCompareText( FilterInstruction& instruction, const string& text );
+
+void filterExpressionError( string expression, string message );
+
+const double* getProjectionWeights( int n, int m, int k );
+
+string getBCFheaderValue( const string& line, string key );
+
+inline int32_t getBCFint( const unsigned char* value, int type );
 
 inline size_t getLength( char *myCharArray );
 
-void parseActualData(istream& VCFfile, int numFormats, char formatDelim, int maxSubfieldsInFormat, unsigned long int& VCFfileLineCount, ofstream& outputFile, int numSamples, int numPopulations, int* populationReference, string vcfName );
+bool getSourceFileStats( string fname, unsigned long long& fileSize, long long& fileModTime );
+
+inline unsigned int hashINFOkey( const char* key, size_t length, unsigned int seed );
+
+int histogramMedian( const vector<int>& histogram, int position );
+
+ServedCache* loadServedCache( map<string, ServedCache>& caches, string vcfName, unsigned long int requestNumber );
 
-void parseCommandLineInput(int argc, char *argv[], ifstream& PopulationFile, bool& popFileHeader, int& numSamples, int& numPopulations, int& numFields, int& numFormats, char& formatDelim, int& maxSubfieldsInFormat, string& vcfName, string& popFileName, map<string, int>& mapOfPopulations );
+const FormatPlan& lookUpFormatPlan( FormatPlanCache& formatPlans, const char* FORMAT, char formatDelim, int maxSubfieldsInFormat );
 
-bool parseMetaColData( istream& VCFfile, long int SNPcount, bool checkFormat, int& numTokensInFormat, int& GTtoken, int& DPtoken, int& GQtoken, int& PLtoken, bool& lookForDP, bool& lookForGQ, bool& lookForPL, char formatDelim, char* CHROM, char* POS, char* ID, char* REF, char* ALT, char* QUAL );
+double lookUpHWEpvalue( int homoRefCount, int hetCount, int homoAltCount );
+
+void mapSamplesToPopulations( string* sampleIDs, int numSamples, PopulationDesignation& designation, string source );
+
+void mergeSampleChunkTallies( SampleThreadPool& pool, int designationIndex, int numPopulations, int altAlleleCounts[], int validSampleCounts[], int& homoRefCount, int& hetCount, int& homoAltCount, int* popCodeCounts );
+
+double numericINFOvalue( INFOkeyTable& table, int key );
+
+void openGenotypeCacheForWriting( ofstream& cacheFile, string vcfName, int numFormats, char formatDelim, int maxSubfieldsInFormat, int numSamples, string* sampleIDs, unsigned long int VCFfileLineCount );
+
+void openLineReader( VCFlineReader& reader, istream& source, unsigned long long offset, size_t blockSize );
+
+shared_ptr<ReadAheadState> openReadAhead( string vcfName, unsigned long long offset );
+
+unsigned long long openVCFatCheckpoint( boost::iostreams::filtering_streambuf<boost::iostreams::input>& myVCFin, string vcfName, ifstream& vcfUnfiltered, Checkpoint& checkpoint );
+
+void packLDgenotypes( char* genotypeCodes, int numSamples, uint64_t* planes, int numWords );
+
+void parseActualData(istream& VCFfile, int numFormats, char formatDelim, int maxSubfieldsInFormat, unsigned long int& VCFfileLineCount, int numSamples, PopulationDesignation* designations, int numDesignations, string* sampleIDs, string vcfName, Checkpoint* resumeFrom, BCFreader* BCF );
+
+void parseCommandLineInput(int argc, char *argv[], bool& popFileHeader, int& numSamples, int& numFields, int& numFormats, char& formatDelim, int& maxSubfieldsInFormat, string& vcfName, vector<PopulationDesignation>& designations, int& numDesignations );
+
+vector<FilterInstruction> parseFilterAnd( vector<string>& tokens, size_t& pos, string& expression );
+
+vector<FilterInstruction> parseFilterOr( vector<string>& tokens, size_t& pos, string& expression );
+
+vector<FilterInstruction> parseFilterPredicate( vector<string>& tokens, size_t& pos, string& expression );
+
+vector<FilterInstruction> parseFilterUnary( vector<string>& tokens, size_t& pos, string& expression );
+
+bool parseMetaColData( char*& cursor, long int SNPcount, bool checkFormat, FormatPlanCache& formatPlans, int maxSubfieldsInFormat, int formatOpsOrder[], int& numTokensInFormat, int& GTtoken, int& DPtoken, int& GQtoken, int& PLtoken, bool& lookForDP, bool& lookForGQ, bool& lookForPL, bool& lookForDPinINFO, char formatDelim, char* CHROM, char* POS, char* ID, char* REF, char* ALT, char* QUAL, char* FILTER, double& DPval, bool& isBiallelicSNP );
 
 inline void parsePL( char* tokenHolder );
 
-void parsePopulationDesigFile( string fname, int& numSamples, int& numPopulations, map<string,int>& mapOfPopulations, bool popFileHeader );
+void parsePopulationDesigFile( string fname, int& numSamples, int& numPopulations, map<string,int>& mapOfPopulations, SampleTable& samples, bool popFileHeader );
+
+bool passesFilters( vector< vector<FilterInstruction> >& filters, char* CHROM, char* POS, char* QUAL, char* FILTER, double MAF, double callRate );
+
+void prefetchWithPread( ReadAheadState* state );
+
+void previewVCF( istream& VCFfile, int numFormats, char formatDelim, int maxSubfieldsInFormat, unsigned long int VCFfileLineCount, int numSamples, PopulationDesignation* designations, int numDesignations, string* sampleIDs, string vcfName );
+
+void printCPUpath();
+
+streamsize readAhead( ReadAheadState* state, char* s, streamsize n );
+
+void readBCFheader( istream& BCFfile, BCFreader& reader, string& headerText, string vcfName );
+
+int readBCFkey( BCFreader& reader, const unsigned char*& cursor, const unsigned char* end );
+
+bool readBCFrecord( BCFreader& reader, char*& line, char formatDelim, int numSamples );
+
+void readBCFtype( const unsigned char*& cursor, const unsigned char* end, int& type, int& count );
+
+bool readBGZFblockSizes( ifstream& compressedFile, unsigned long long blockStart, unsigned long long& blockSize, unsigned long long& dataSize );
+
+void readCheckpoint( Checkpoint& checkpoint, string vcfName, PopulationDesignation* designations, int numDesignations );
+
+bool readRecordIndex( string vcfName, vector<RecordIndexEntry>& entries );
+
+bool readVCFheader( istream& VCFfile, string vcfName, int numSamples, PopulationDesignation* designations, int numDesignations, string* sampleIDs, unsigned long int& VCFfileLineCount, int& firstDataLineNumber, BCFreader& BCF );
+
+bool readVCFline( VCFlineReader& reader, char*& line, size_t& lineLength );
+
+void reduceGenotypeBatch( GenotypeBatch& batch, int* populationReference, int numPopulations, int* popCodeCounts );
+
+void reportSNPsummary( PopulationDesignation& designation, int designationIndex, unsigned long int VCFfileLineCount, char* CHROM, char* POS, char* ID, char* REF, char* ALT, char* QUAL, int medianDP, int medianGQ, int homoRefCount, int hetCount, int homoAltCount, int altAlleleCounts[], int validSampleCounts[] );
+
+void runSampleThread( SampleThreadPool* pool, int chunkIndex );
+
+void selectChromOutputFile( PopulationDesignation& designation, char* CHROM, char* POS );
+
+void sendServedFile( int fd, string fileName );
+
+void serveRequests( string socketName );
+
+void setUpPlinkExport( PlinkExport& plink, int numSamples, string* sampleIDs, PopulationDesignation& designation );
+
+void setUpSampleStats( SampleStats& stats, int numSamples );
+
+void setUpSampleThreads( SampleThreadPool& pool, int numSamples, PopulationDesignation* designations, int numDesignations );
+
+void setUpGenotypeBatch( GenotypeBatch& batch, int numSamples );
+
+void setUpHWEtable();
+
+bool setUpIOuring( ReadAheadState* state );
+
+void setUpLD( LDwindow& LD, int numSamples, PopulationDesignation* designations, int numDesignations );
+
+void setUpSFS( PopulationDesignation& designation, int numSamplesPerPopulation[] );
+
+void setUpOutputFile (ofstream& outputFile, string filename, int numPopulations, const map<string, int>& mapOfPopulations );
+
+void summarizeFromCache( istream& cacheFile, string vcfName, int numSamples, PopulationDesignation* designations, int numDesignations );
+
+void summarizeOneVCF( string vcfName, int numSamples, int numFormats, char formatDelim, int maxSubfieldsInFormat, PopulationDesignation* designations, int numDesignations );
+
+int summarizeVCF( int argc, char* argv[] );
+
+void summarizeVCFfiles( string outputBase, int numSamples, int numFormats, char formatDelim, int maxSubfieldsInFormat, PopulationDesignation* designations, int numDesignations );
+
+void submitReadAhead( ReadAheadState* state, int buffer );
+
+void tallyGenotypes( char* genotypeCodes, int numSamples, int* populationReference, int numPopulations, int altAlleleCounts[], int validSampleCounts[], int& homoRefCount, int& hetCount, int& homoAltCount, int* popCodeCounts );
+
+vector<string> tokenizeFilterExpression( string expression );
+
+void tokenizeINFO( INFOkeyTable& table, const char* INFO );
+
+void truncateOutputFile( string fileName, unsigned long long size );
+
+void updateLD( LDwindow& LD, PopulationDesignation* designations, int numDesignations, char* CHROM, char* POS, char* genotypeCodes );
+
+void waitForReadAhead( ReadAheadState* state, int buffer );
+
+void writeCacheSampleData( ofstream& cacheFile, char* genotypeCodes, int* DPvalues, int* GQvalues, bool lookForDP, bool lookForGQ, int numSamples );
+
+void writeCacheSiteData( ofstream& cacheFile, bool isBiallelicSNP, bool lookForDP, bool lookForGQ, double DPval, char* CHROM, char* POS, char* ID, char* REF, char* ALT, char* QUAL );
+
+void writeCheckpoint( Checkpoint& checkpoint, string vcfName, PopulationDesignation* designations, int numDesignations, ofstream& discardedLinesFile );
+
+void writeChromIndex( PopulationDesignation& designation );
+
+void writeHWEcolumns( ofstream& outputFile, int popCodeCounts[], int numPopulations );
+
+void writeINFOcolumns( ostream& outputFile );
+
+void writePlinkSNP( PlinkExport& plink, char* genotypeCodes, int numSamples, char* CHROM, char* POS, char* ID, char* REF, char* ALT );
+
+void writeSFS( PopulationDesignation& designation );
+
+void writeSampleSummary( SampleStats& stats, string* sampleIDs, string filename );
+
+void writeSummaryColumns( ofstream& outputFile, int medianDP, int medianGQ, int homoRefCount, int hetCount, int homoAltCount, int altAlleleCounts[], int validSampleCounts[], int numPopulations );
 
-void setUpOutputFile (ofstream& outputFile, string vcfName, int numPopulations, map<string, int> mapOfPopulations );
+bool writeToSocket( int fd, const char* data, size_t length );
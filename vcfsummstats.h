@@ -0,0 +1,45 @@
+/* vcfsummstats.h
+ * C interface of libvcfsummstats, the library build of VCFtoSummStats
+ * (see "Using VCFtoSummStats as a library" in README.md).
+ * Build the library with 'make lib'.
+ */
+#ifndef VCFSUMMSTATS_H
+#define VCFSUMMSTATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* medianDP and medianGQ are VSS_MISSING where the summary file has NA */
+#define VSS_MISSING (-2147483647 - 1)
+
+/* one row of a summary file; the pointers are only valid during the callback */
+typedef struct {
+    int designation;                    /* which -P file, in command-line order from 0 */
+    unsigned long VCFlineNum;
+    const char *CHROM, *POS, *ID, *REF, *ALT, *QUAL;
+    int medianDP, medianGQ;
+    int homoRefCount, hetCount, homoAltCount;
+    int numPopulations;
+    const char *const *populationNames;  /* in the order of the summary file's columns */
+    const int *altAlleleCounts;         /* per population; ALT_SNP_freq = altAlleleCounts / rawAlleleCounts */
+    const int *rawAlleleCounts;         /* per population, called alleles */
+} vss_snp_summary;
+
+/* called for every summarized SNP; returning nonzero stops the run */
+typedef int (*vss_snp_callback)( const vss_snp_summary *summary, void *userData );
+
+/* runs VCFtoSummStats with the command-line arguments argv[0] .. argv[argc - 1]
+ * (argv[0] is the program name, as for main), and calls callback, if not NULL,
+ * with each SNP of each summary.  Unless writeSummaryFiles is nonzero, the
+ * _Unfiltered_Summary.tsv files are not written; all other outputs are.
+ * Returns 0 on success, the status the command-line program would have exited
+ * with on an error, or the callback's nonzero value.  Only one run at a time
+ * per process is supported. */
+int vss_summarize( int argc, const char *argv[], vss_snp_callback callback, void *userData, int writeSummaryFiles );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif